@@ -0,0 +1,903 @@
+/*
+ *	Benchmark harness of the bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "bench.hpp"
+#include "../rshift/rshift.hpp"
+#include "../rshift/rshift_batch.hpp"
+#include "../rshift/rshift_qc.hpp"
+#include "../rshift/rshift_sliced.hpp"
+#include "../rshift/rshift_x86.hpp"
+#include "../rshift/rshift_avx2.hpp"
+#include "bench_counters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #include <cpuid.h>
+    #define BENCH_HAS_TSC
+#endif
+
+void print_usage(const char* program)
+{
+    printf("Usage: %s [options]\n", program);
+    printf("  --kernel  a,b,...   operations to run (default: all, --list shows them)\n");
+    printf("  --isa     a,b,...   x86, sse4, avx2, avx512, vec/neon, dispatch, tuned, std, naive (default: all)\n");
+    printf("  --size    list      sizes in bits, e.g. 32,100,1000 or a range 32:2048 (x2)\n");
+    printf("  --shift   list      shift amounts (default: random shift per call)\n");
+    printf("  --pattern list      random, zeros, ones, single, alternating, sparse, runs\n");
+    printf("  --iters   n         calls per repetition (default: calibrated to ~1 ms)\n");
+    printf("  --reps    n         repetitions used for the statistics (default: 15)\n");
+    printf("  --seed    n         seed of the random patterns and shifts\n");
+    printf("  --format  f         table, csv or json (default: table)\n");
+    printf("  --throughput        process independent frames spread over a working set\n");
+    printf("  --ws      list      working sets in bytes (K, M, G suffixes), e.g. 4K:1G (x2)\n");
+    printf("  --batch             permutation_batch / rotate_batch on a working set\n");
+    printf("  --threads list      thread counts of the batch mode, e.g. 1,2,4 or 1:32 (x2)\n");
+    printf("  --qc                QC-LDPC encoding on BG1/BG2 shaped base graphs, --size\n");
+    printf("                      giving the lifting sizes Z (default: 52,104,208,384)\n");
+    printf("  --sliced            bit-sliced batches (rshift_sliced) against permutation_avx2,\n");
+    printf("                      per frame over the batch sizes of --frames\n");
+    printf("  --frames  list      batch sizes of the sliced mode (default: 1, 4, 16 ... 16384)\n");
+    printf("  --rounds  n         rotations per conversion in the sliced mode (default: 8)\n");
+    printf("  --counters          hardware counters per call (perf_event_open: cycles,\n");
+    printf("                      instructions, L1D misses, store forwarding blocks,\n");
+    printf("                      loads, stores, uops of ports 0/1/5/6), rdtsc otherwise;\n");
+    printf("                      the cycles per bit are core cycles with perf, TSC\n");
+    printf("                      ticks (tsc/bit) without\n");
+    printf("  --list              list the available kernels and exit\n");
+}
+
+static std::vector<std::string> split(const std::string& s)
+{
+    std::vector<std::string> list;
+    size_t start = 0;
+    while( start <= s.size() )
+    {
+        const size_t end = s.find(',', start);
+        const std::string item = s.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+        if( item.empty() == false )
+            list.push_back(item);
+        if( end == std::string::npos )
+            break;
+        start = end + 1;
+    }
+    return list;
+}
+
+static bool parse_sizes(const std::string& s, std::vector<int32_t>& sizes)
+{
+    for(const std::string& item : split(s))
+    {
+        const size_t colon = item.find(':');
+        if( colon == std::string::npos )
+        {
+            const int32_t v = atoi( item.c_str() );
+            if( v <= 0 )
+                return false;
+            sizes.push_back( v );
+        }
+        else
+        {
+            const int32_t first = atoi( item.substr(0, colon).c_str() );
+            const int32_t last  = atoi( item.substr(colon + 1).c_str() );
+            if( (first <= 0) || (last < first) )
+                return false;
+            for(int64_t v = first; v <= last; v *= 2)
+                sizes.push_back( (int32_t)v );
+        }
+    }
+    return true;
+}
+
+static int64_t parse_bytes(const std::string& s)
+{
+    char* end = nullptr;
+    int64_t v = strtoll(s.c_str(), &end, 10);
+    switch( *end )
+    {
+        case 'k' : case 'K' : v <<= 10; end += 1; break;
+        case 'm' : case 'M' : v <<= 20; end += 1; break;
+        case 'g' : case 'G' : v <<= 30; end += 1; break;
+    }
+    return (*end == '\0') ? v : -1;
+}
+
+static bool parse_working_sets(const std::string& s, std::vector<int64_t>& sizes)
+{
+    for(const std::string& item : split(s))
+    {
+        const size_t  colon = item.find(':');
+        const int64_t first = parse_bytes( item.substr(0, colon) );
+        const int64_t last  = (colon == std::string::npos) ? first : parse_bytes( item.substr(colon + 1) );
+        if( (first <= 0) || (last < first) )
+            return false;
+        for(int64_t v = first; v <= last; v *= 2)
+            sizes.push_back( v );
+    }
+    return true;
+}
+
+bool parse_options(int argc, char* argv[], bench_options& opt)
+{
+    for(int32_t i = 1; i < argc; i += 1)
+    {
+        const std::string arg   = argv[i];
+        const bool        has_v = (i + 1 < argc);
+        const std::string value = has_v ? argv[i + 1] : "";
+
+        if( arg == "--list" )
+        {
+            opt.list = true;
+            continue;
+        }
+        if( arg == "--throughput" )
+        {
+            opt.throughput = true;
+            continue;
+        }
+        if( arg == "--batch" )
+        {
+            opt.batch = true;
+            continue;
+        }
+        if( arg == "--qc" )
+        {
+            opt.qc = true;
+            continue;
+        }
+        if( arg == "--counters" )
+        {
+            opt.counters = true;
+            continue;
+        }
+        if( arg == "--sliced" )
+        {
+            opt.sliced = true;
+            continue;
+        }
+        if( (arg == "--help") || (arg == "-h") )
+            return false;
+        if( has_v == false )
+        {
+            printf("(EE) Missing value after %s\n", arg.c_str());
+            return false;
+        }
+        i += 1;
+
+        if     ( arg == "--kernel"  ) opt.kernels  = split(value);
+        else if( arg == "--isa"     ) opt.isas     = split(value);
+        else if( arg == "--pattern" ) opt.patterns = split(value);
+        else if( arg == "--format"  ) opt.format   = value;
+        else if( arg == "--iters"   ) opt.iters    = atoi( value.c_str() );
+        else if( arg == "--reps"    ) opt.reps     = atoi( value.c_str() );
+        else if( arg == "--seed"    ) opt.seed     = strtoull( value.c_str(), nullptr, 10 );
+        else if( arg == "--rounds"  ) opt.rounds   = atoi( value.c_str() );
+        else if( arg == "--size"    )
+        {
+            opt.sizes.clear();
+            if( parse_sizes(value, opt.sizes) == false )
+            {
+                printf("(EE) Invalid size list: %s\n", value.c_str());
+                return false;
+            }
+        }
+        else if( arg == "--ws"      )
+        {
+            opt.working_sets.clear();
+            if( parse_working_sets(value, opt.working_sets) == false )
+            {
+                printf("(EE) Invalid working set list: %s\n", value.c_str());
+                return false;
+            }
+        }
+        else if( arg == "--frames"  )
+        {
+            opt.frames.clear();
+            if( parse_sizes(value, opt.frames) == false )
+            {
+                printf("(EE) Invalid batch size list: %s\n", value.c_str());
+                return false;
+            }
+        }
+        else if( arg == "--threads" )
+        {
+            opt.threads.clear();
+            if( parse_sizes(value, opt.threads) == false )
+            {
+                printf("(EE) Invalid thread list: %s\n", value.c_str());
+                return false;
+            }
+        }
+        else if( arg == "--shift"   )
+        {
+            opt.shifts.clear();
+            for(const std::string& item : split(value))
+                opt.shifts.push_back( atoi( item.c_str() ) );
+        }
+        else
+        {
+            printf("(EE) Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if( (opt.format != "table") && (opt.format != "csv") && (opt.format != "json") )
+    {
+        printf("(EE) Unknown output format %s\n", opt.format.c_str());
+        return false;
+    }
+    if( (opt.reps < 1) || (opt.iters < 0) || (opt.rounds < 1) )
+    {
+        printf("(EE) --reps and --rounds must be >= 1, --iters >= 0\n");
+        return false;
+    }
+    return true;
+}
+
+int32_t layout_bytes(const bench_layout layout, const int32_t n)
+{
+    switch( layout )
+    {
+        case BENCH_BITS  : return (n + 7) / 8;
+        case BENCH_BYTES : return n;
+        case BENCH_INT8  : return n;
+        case BENCH_INT16 : return 2 * n;
+        case BENCH_INT32 : return 4 * n;
+    }
+    return 0;
+}
+
+//
+// The bit patterns are generated on n bits and expanded to the layout: one
+// byte per bit for BENCH_BYTES, one soft value per bit (-1 / +1 scaled) for
+// the LLR layouts. "runs" alternates runs of 1 to 64 identical bits and
+// "sparse" sets one bit out of 64 on average.
+//
+bool fill_pattern(uint8_t* buffer, const bench_layout layout, const int32_t n, const std::string& pattern, std::mt19937_64& rng)
+{
+    std::vector<uint8_t> bits(n);
+    if( pattern == "random" )
+    {
+        for(int32_t i = 0; i < n; i += 1)
+            bits[i] = rng() & 1;
+    }
+    else if( pattern == "zeros" )
+    {
+        std::fill(bits.begin(), bits.end(), 0);
+    }
+    else if( pattern == "ones" )
+    {
+        std::fill(bits.begin(), bits.end(), 1);
+    }
+    else if( pattern == "single" )
+    {
+        for(int32_t i = 0; i < n; i += 1)
+            bits[i] = (i == 0);
+    }
+    else if( pattern == "alternating" )
+    {
+        for(int32_t i = 0; i < n; i += 1)
+            bits[i] = i & 1;
+    }
+    else if( pattern == "sparse" )
+    {
+        for(int32_t i = 0; i < n; i += 1)
+            bits[i] = (rng() % 64) == 0;
+    }
+    else if( pattern == "runs" )
+    {
+        uint8_t v = 0;
+        for(int32_t i = 0; i < n; v ^= 1)
+        {
+            const int32_t run = 1 + (int32_t)(rng() % 64);
+            for(int32_t j = 0; (j < run) && (i < n); j += 1, i += 1)
+                bits[i] = v;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    for(int32_t i = 0; i < n; i += 1)
+    {
+        switch( layout )
+        {
+            case BENCH_BITS  : buffer[i / 8] |= bits[i] << (i % 8);                                   break;
+            case BENCH_BYTES : buffer[i] = bits[i];                                                   break;
+            case BENCH_INT8  : ((int8_t *)buffer)[i] = (int8_t )((bits[i] ? -1 : 1) * (1 + rng() % 127)); break;
+            case BENCH_INT16 : ((int16_t*)buffer)[i] = (int16_t)((bits[i] ? -1 : 1) * (1 + rng() % 32767)); break;
+            case BENCH_INT32 : ((int32_t*)buffer)[i] = bits[i];                                       break;
+        }
+    }
+    return true;
+}
+
+static uint64_t read_cycles()
+{
+#ifdef BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//
+// 64-byte aligned buffer with some slack after the end (kernels may read or
+// write whole words past a partial last byte of a std::bitset).
+//
+struct bench_buffer
+{
+    uint8_t* data;
+    explicit bench_buffer(const size_t nBytes)
+    {
+        const size_t size = (nBytes + 128 + 63) / 64 * 64;
+        data = (uint8_t*)aligned_alloc(64, size);
+        memset(data, 0, size);
+    }
+    ~bench_buffer() { free( data ); }
+};
+
+static bench_result new_result(const bench_kernel& kernel, const int32_t n, const int32_t k, const std::string& pattern, const bench_options& opt)
+{
+    bench_result r;
+    r.kernel      = kernel.name;
+    r.isa         = kernel.isa;
+    r.pattern     = pattern;
+    r.n           = n;
+    r.k           = k;
+    r.working_set = 0;
+    r.frames      = 0;
+    r.threads     = 1;
+    r.reps        = opt.reps;
+    r.check       = -1;
+    return r;
+}
+
+static std::vector<int32_t> new_shifts(const int32_t n, const int32_t k, std::mt19937_64& rng)
+{
+    std::vector<int32_t> shifts(256);
+    for(int32_t& s : shifts)
+        s = (k >= 0) ? k : (int32_t)(rng() % n);
+    return shifts;
+}
+
+//
+// Statistics of the ns and cycles per call measured by each repetition.
+//
+static void summarize(bench_result& r, std::vector<double>& ns, std::vector<double>& cycles, const int32_t out_bytes)
+{
+    const int32_t reps = (int32_t)ns.size();
+    std::sort(ns.begin(),     ns.end()    );
+    std::sort(cycles.begin(), cycles.end());
+    const int32_t mid = reps / 2;
+    const double  med = (reps % 2) ? ns[mid] : (ns[mid - 1] + ns[mid]) / 2;
+
+    double sum = 0;
+    for(const double v : ns)
+        sum += v;
+    const double mean = sum / reps;
+    double var = 0;
+    for(const double v : ns)
+        var += (v - mean) * (v - mean);
+
+    r.ns_median      = med;
+    r.ns_p99         = ns[ std::min(reps - 1, (int32_t)std::ceil(0.99 * reps) - 1) ];
+    r.ns_mean        = mean;
+    r.ns_stddev      = (reps > 1) ? std::sqrt( var / (reps - 1) ) : 0.0;
+    r.ns_min         = ns[0];
+#ifdef BENCH_HAS_TSC
+    r.cycles_per_bit = cycles[mid] / r.n;
+#else
+    r.cycles_per_bit = -1.0;
+#endif
+    r.gbps           = out_bytes / med;
+    r.mbps           = 1e3 * r.n / med;
+}
+
+//
+// Index of the core cycles in counters_names(), -1 when the counters are
+// not opened or fell back to rdtsc.
+//
+static int32_t core_cycles_index(const bench_options& opt)
+{
+    if( opt.counters == false )
+        return -1;
+    const std::vector<std::string>& names = counters_names();
+    for(size_t i = 0; i < names.size(); i += 1)
+        if( names[i] == "cycles" )
+            return (int32_t)i;
+    return -1;
+}
+
+//
+// Timed part of every mode. pass(i) runs the i-th pass, which makes "calls"
+// kernel calls (the frames of a pass, 1 in latency mode), and reset() puts
+// back its input before each repetition. The passes per repetition are
+// --iters or calibrated to ~1 ms. The cycles per bit are the core cycles of
+// the perf counters when --counters opened them, TSC ticks otherwise (at
+// the nominal frequency, whatever the actual clock of the core).
+//
+template<typename Pass, typename Reset>
+static void measure_loop(bench_result& r, const Pass& pass, const Reset& reset, const double calls, const int32_t out_bytes, const bench_options& opt)
+{
+    int32_t passes = opt.iters;
+    if( passes == 0 )
+    {
+        for(passes = 1; passes < (1 << 26); passes *= 2)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for(int32_t i = 0; i < passes; i += 1)
+                pass(i);
+            auto end = std::chrono::steady_clock::now();
+            if( std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() >= 1000 )
+                break;
+        }
+    }
+    r.iters = passes;
+
+    std::vector<double> ns    ( opt.reps );
+    std::vector<double> cycles( opt.reps );
+    if( opt.counters )
+        counters_start();
+    for(int32_t rep = 0; rep < opt.reps; rep += 1)
+    {
+        reset();
+        auto           start   = std::chrono::steady_clock::now();
+        const uint64_t c_start = read_cycles();
+        for(int32_t i = 0; i < passes; i += 1)
+            pass(i);
+        const uint64_t c_end   = read_cycles();
+        auto           end     = std::chrono::steady_clock::now();
+        ns    [rep] = std::chrono::duration<double, std::nano>(end - start).count() / ((double)passes * calls);
+        cycles[rep] = (double)(c_end - c_start) / ((double)passes * calls);
+    }
+    if( opt.counters )
+        r.counters = counters_stop( (double)opt.reps * passes * calls );
+
+    summarize(r, ns, cycles, out_bytes);
+    const int32_t core = core_cycles_index(opt);
+    if( core >= 0 )
+        r.cycles_per_bit = r.counters[core] / r.n;
+}
+
+template<typename Pass>
+static void measure_loop(bench_result& r, const Pass& pass, const double calls, const int32_t out_bytes, const bench_options& opt)
+{
+    measure_loop(r, pass, [](){}, calls, out_bytes, opt);
+}
+
+bench_result measure(const bench_kernel& kernel, const int32_t n, const int32_t k, const std::string& pattern, const bench_options& opt)
+{
+    std::mt19937_64 rng( opt.seed * 0x9E3779B97F4A7C15ULL + n );
+
+    const int32_t in_bytes  = layout_bytes(kernel.in,  n);
+    const int32_t out_bytes = layout_bytes(kernel.out, n);
+    bench_buffer src( in_bytes  );
+    bench_buffer dst( out_bytes );
+    bench_buffer ref( out_bytes );
+    fill_pattern(src.data, kernel.in, n, pattern, rng);
+
+    // in-place functions work on a copy of src
+    const int32_t reset_bytes = kernel.inplace ? in_bytes : 0;
+
+    const std::vector<int32_t> shifts = new_shifts(n, k, rng);
+    bench_result r = new_result(kernel, n, k, pattern, opt);
+
+    if( kernel.reference != nullptr )
+    {
+        memcpy(dst.data, src.data, reset_bytes);
+        memcpy(ref.data, src.data, reset_bytes);
+        kernel.run      (dst.data, src.data, n, shifts[0]);
+        kernel.reference(ref.data, src.data, n, shifts[0]);
+        r.check = (memcmp(dst.data, ref.data, out_bytes) == 0);
+    }
+
+    measure_loop(r, [&](const int32_t i) { kernel.run(dst.data, src.data, n, shifts[i & 255]); },
+                    [&]() { memcpy(dst.data, src.data, reset_bytes); }, 1, out_bytes, opt);
+    return r;
+}
+
+//
+// The frames are laid out back to back with a 64-byte stride, so that every
+// frame starts on a cache line as a batch of aligned bitsets would. Their
+// content repeats a set of 64 different initial frames (the pattern of a 1
+// GiB working set would take longer to draw than to benchmark). Only the
+// destination frames are counted in the working set of in-place functions.
+//
+bench_result measure_throughput(const bench_kernel& kernel, const int32_t n, const int32_t k, const int64_t ws, const std::string& pattern, const bench_options& opt)
+{
+    std::mt19937_64 rng( opt.seed * 0x9E3779B97F4A7C15ULL + n );
+
+    const int32_t in_bytes   = layout_bytes(kernel.in,  n);
+    const int32_t out_bytes  = layout_bytes(kernel.out, n);
+    const int64_t in_stride  = kernel.inplace ? 0 : ((in_bytes  + 63) / 64 * 64);
+    const int64_t out_stride = (out_bytes + 63) / 64 * 64;
+    const int64_t nFrames    = std::max((int64_t)1, ws / (in_stride + out_stride));
+    const int32_t nInit      = 64;
+
+    // initial content of the frames (in the input layout)
+    const int64_t init_stride = (std::max(in_bytes, out_bytes) + 63) / 64 * 64;
+    bench_buffer init( nInit * init_stride );
+    for(int32_t i = 0; i < nInit; i += 1)
+        fill_pattern(init.data + i * init_stride, kernel.in, n, pattern, rng);
+
+    bench_buffer src( in_stride  * nFrames );
+    bench_buffer dst( out_stride * nFrames );
+    for(int64_t f = 0; f < nFrames; f += 1)
+    {
+        const uint8_t* frame = init.data + (f % nInit) * init_stride;
+        if( kernel.inplace )
+            memcpy(dst.data + f * out_stride, frame, out_bytes);
+        else
+            memcpy(src.data + f * in_stride,  frame, in_bytes );
+    }
+
+    const std::vector<int32_t> shifts = new_shifts(n, k, rng);
+    bench_result r = new_result(kernel, n, k, pattern, opt);
+    r.working_set  = nFrames * (in_stride + out_stride);
+    r.frames       = nFrames;
+
+    auto pass = [&]()
+    {
+        for(int64_t f = 0; f < nFrames; f += 1)
+            kernel.run(dst.data + f * out_stride, src.data + f * in_stride, n, shifts[f & 255]);
+    };
+
+    // first pass checked on the first frames
+    pass();
+    if( kernel.reference != nullptr )
+    {
+        bench_buffer ref( out_bytes );
+        r.check = 1;
+        for(int64_t f = 0; f < std::min(nFrames, (int64_t)nInit); f += 1)
+        {
+            const uint8_t* frame = init.data + f * init_stride;
+            memset(ref.data, 0, out_bytes);
+            if( kernel.inplace )
+                memcpy(ref.data, frame, out_bytes);
+            kernel.reference(ref.data, frame, n, shifts[f & 255]);
+            r.check &= (memcmp(dst.data + f * out_stride, ref.data, out_bytes) == 0);
+        }
+    }
+
+    measure_loop(r, [&](const int32_t) { pass(); }, (double)nFrames, out_bytes, opt);
+    return r;
+}
+
+bench_result measure_batch(const char* name, const int32_t n, const int32_t k, const int64_t ws, const int32_t nThreads, const std::string& pattern, const bench_options& opt)
+{
+    std::mt19937_64 rng( opt.seed * 0x9E3779B97F4A7C15ULL + n );
+
+    const bool    rotation = (strcmp(name, "rotate_batch") == 0);
+    const int32_t nBytes   = layout_bytes(BENCH_BITS, n);
+    const int64_t nFrames  = std::max((int64_t)1, ws / nBytes);
+    const int32_t nInit    = 64;
+
+    bench_buffer init( nInit * nBytes );
+    for(int32_t i = 0; i < nInit; i += 1)
+        fill_pattern(init.data + i * nBytes, BENCH_BITS, n, pattern, rng);
+
+    bench_buffer frames( nFrames * nBytes );
+    for(int64_t f = 0; f < nFrames; f += 1)
+        memcpy(frames.data + f * nBytes, init.data + (f % nInit) * nBytes, nBytes);
+
+    const std::vector<int32_t> shifts = new_shifts(n, k, rng);
+
+    bench_kernel kernel = { name, "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true, nullptr, nullptr, nullptr };
+    bench_result r = new_result(kernel, n, k, pattern, opt);
+    r.working_set  = nFrames * nBytes;
+    r.frames       = nFrames;
+    r.threads      = nThreads;
+
+    rshift_set_threads( nThreads );
+    auto pass = [&]()
+    {
+        if( rotation ) rotate_batch     (frames.data, n, nFrames, shifts.data(), (int32_t)shifts.size());
+        else           permutation_batch(frames.data, n, nFrames);
+    };
+
+    // first pass checked on the first frames
+    pass();
+    bench_buffer ref( nBytes );
+    r.check = 1;
+    for(int64_t f = 0; f < std::min(nFrames, (int64_t)nInit); f += 1)
+    {
+        memcpy(ref.data, init.data + f * nBytes, nBytes);
+        rotate_x86(ref.data, n, rotation ? shifts[f % shifts.size()] : 1);
+        r.check &= (memcmp(frames.data + f * nBytes, ref.data, nBytes) == 0);
+    }
+
+    measure_loop(r, [&](const int32_t) { pass(); }, (double)nFrames, nBytes, opt);
+    return r;
+}
+
+bench_result measure_sliced(const char* name, const int32_t n, const int64_t nFrames, const std::string& pattern, const bench_options& opt)
+{
+    std::mt19937_64 rng( opt.seed * 0x9E3779B97F4A7C15ULL + n );
+
+    const bool    sliced = (strcmp(name, "sliced") == 0);
+    const int32_t nBytes = layout_bytes(BENCH_BITS, n);
+    bench_buffer  init  ( nFrames * nBytes );
+    bench_buffer  frames( nFrames * nBytes );
+    for(int64_t f = 0; f < nFrames; f += 1)
+        fill_pattern(init.data + f * nBytes, BENCH_BITS, n, pattern, rng);
+    memcpy(frames.data, init.data, nFrames * nBytes);
+
+    bench_kernel kernel = { name, sliced ? "dispatch" : "avx2", sliced ? RSHIFT_X86 : RSHIFT_AVX2, BENCH_BITS, BENCH_BITS, true, nullptr, nullptr, nullptr };
+    bench_result r = new_result(kernel, n, 1, pattern, opt);
+    r.working_set  = nFrames * nBytes;
+    r.frames       = nFrames;
+
+    rshift_sliced batch(n, nFrames);
+    auto pass = [&]()
+    {
+        if( sliced )
+        {
+            batch.load( frames.data );
+            for(int32_t i = 0; i < opt.rounds; i += 1)
+                batch.permutation();
+            batch.store( frames.data );
+        }
+#ifdef RSHIFT_HAS_AVX2
+        else
+        {
+            for(int32_t i = 0; i < opt.rounds; i += 1)
+                permutation_avx2(frames.data, n, (int32_t)nFrames);
+        }
+#endif
+    };
+
+    // first pass checked on every frame
+    pass();
+    bench_buffer ref( nBytes );
+    r.check = 1;
+    for(int64_t f = 0; f < nFrames; f += 1)
+    {
+        memcpy(ref.data, init.data + f * nBytes, nBytes);
+        rotate_x86(ref.data, n, opt.rounds % n);
+        r.check &= (memcmp(frames.data + f * nBytes, ref.data, nBytes) == 0);
+    }
+
+    measure_loop(r, [&](const int32_t) { pass(); }, (double)nFrames, nBytes, opt);
+    return r;
+}
+
+//
+// Base matrix with the shape of the 5G NR base graphs restricted to their
+// information columns: BG1 has 46 parity rows over 22 information blocks,
+// BG2 42 rows over 10, the first 4 rows (the core) being dense and the
+// extension rows sparse, for about 250 resp. 145 circulants. Positions and
+// shift values are drawn from rng: this is a workload of the same size and
+// density, not the 3GPP tables.
+//
+static std::vector<int16_t> qc_base(const char* name, const int32_t Z, int32_t& rows, int32_t& cols, std::mt19937_64& rng)
+{
+    const bool    bg1       = (strcmp(name, "qc_bg1") == 0);
+    const int32_t core      = bg1 ? 18 : 8;     // weight of the 4 core rows
+    const int32_t ext_min   = bg1 ?  3 : 2;     // weights of the extension rows
+    const int32_t ext_range = bg1 ?  4 : 3;
+    rows = bg1 ? 46 : 42;
+    cols = bg1 ? 22 : 10;
+
+    std::vector<int16_t> base(rows * cols, -1);
+    for(int32_t r = 0; r < rows; r += 1)
+    {
+        const int32_t weight = (r < 4) ? core : std::min(cols, ext_min + (int32_t)(rng() % ext_range));
+        for(int32_t w = 0; w < weight; )
+        {
+            const int32_t c = (int32_t)(rng() % cols);
+            if( base[r * cols + c] >= 0 )
+                continue;
+            base[r * cols + c] = (int16_t)(rng() % Z);
+            w += 1;
+        }
+    }
+    return base;
+}
+
+bench_result measure_qc(const char* name, const char* isa, const int32_t level, const int32_t Z, const std::string& pattern, const bench_options& opt)
+{
+    std::mt19937_64 rng( opt.seed * 0x9E3779B97F4A7C15ULL + Z );
+
+    int32_t rows = 0;
+    int32_t cols = 0;
+    const std::vector<int16_t> base = qc_base(name, Z, rows, cols, rng);
+    rshift_qc_encoder encoder(base.data(), rows, cols, Z, level);
+
+    const int32_t nBytes = layout_bytes(BENCH_BITS, Z);
+    bench_buffer info  ( cols * nBytes );
+    bench_buffer parity( rows * nBytes );
+    for(int32_t c = 0; c < cols; c += 1)
+        fill_pattern(info.data + c * nBytes, BENCH_BITS, Z, pattern, rng);
+
+    bench_kernel kernel = { name, isa, level, BENCH_BITS, BENCH_BITS, false, nullptr, nullptr, nullptr };
+    bench_result r = new_result(kernel, cols * Z, -1, pattern, opt);
+
+    // reference: every circulant rotated by rotate_x86 then XORed
+    encoder.encode(parity.data, info.data);
+    bench_buffer ref  ( rows * nBytes );
+    bench_buffer block( nBytes );
+    for(int32_t row = 0; row < rows; row += 1)
+    {
+        for(int32_t c = 0; c < cols; c += 1)
+        {
+            if( base[row * cols + c] < 0 )
+                continue;
+            memcpy(block.data, info.data + c * nBytes, nBytes);
+            rotate_x86(block.data, Z, base[row * cols + c]);
+            for(int32_t i = 0; i < nBytes; i += 1)
+                ref.data[row * nBytes + i] ^= block.data[i];
+        }
+    }
+    r.check = (memcmp(parity.data, ref.data, rows * nBytes) == 0);
+
+    measure_loop(r, [&](const int32_t) { encoder.encode(parity.data, info.data); }, 1, rows * nBytes, opt);
+    return r;
+}
+
+static std::string compiler_name()
+{
+    char buffer[64];
+#if defined (__clang__)
+    snprintf(buffer, sizeof(buffer), "clang %d.%d.%d", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined (__GNUC__)
+    snprintf(buffer, sizeof(buffer), "gcc %d.%d.%d", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#else
+    snprintf(buffer, sizeof(buffer), "unknown");
+#endif
+    return buffer;
+}
+
+static std::string cpu_name()
+{
+#ifdef BENCH_HAS_TSC
+    uint32_t brand[12];
+    if( __get_cpuid_max(0x80000000, nullptr) >= 0x80000004 )
+    {
+        __get_cpuid(0x80000002, brand + 0, brand + 1, brand + 2,  brand + 3 );
+        __get_cpuid(0x80000003, brand + 4, brand + 5, brand + 6,  brand + 7 );
+        __get_cpuid(0x80000004, brand + 8, brand + 9, brand + 10, brand + 11);
+        std::string name( (const char*)brand, sizeof(brand) );
+        name = name.substr(0, name.find('\0'));
+        const size_t first = name.find_first_not_of(' ');
+        return (first == std::string::npos) ? "unknown" : name.substr(first);
+    }
+#endif
+    return "unknown";
+}
+
+bench_context make_context(const bench_options& opt)
+{
+    bench_context ctx;
+    ctx.compiler = compiler_name();
+    ctx.cpu      = cpu_name();
+    ctx.dispatch = rshift_isa_name();
+    if( opt.counters )
+    {
+        counters_open();
+        ctx.counters      = counters_source();
+        ctx.counter_names = counters_names();
+    }
+#ifdef BENCH_HAS_TSC
+    ctx.cycles = (core_cycles_index(opt) >= 0) ? "cycles" : "tsc";
+#else
+    ctx.cycles = (core_cycles_index(opt) >= 0) ? "cycles" : "none";
+#endif
+    return ctx;
+}
+
+void print_header(const std::string& format, const bench_context& ctx)
+{
+    if( format == "csv" )
+    {
+        printf("kernel,isa,pattern,n,k,working_set,frames,threads,iters,reps,ns_median,ns_p99,ns_mean,ns_stddev,ns_min,cycles_per_bit,gbps,mbps,check,compiler,cpu,cycle_counter");
+        for(const std::string& name : ctx.counter_names)
+            printf(",%s", name.c_str());
+        printf("\n");
+    }
+    else if( format == "json" )
+    {
+        printf("{\n  \"compiler\": \"%s\",\n  \"cpu\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"cycle_counter\": \"%s\",\n",
+               ctx.compiler.c_str(), ctx.cpu.c_str(), ctx.dispatch.c_str(), ctx.cycles.c_str());
+        if( ctx.counters.empty() == false )
+            printf("  \"counters\": \"%s\",\n", ctx.counters.c_str());
+        printf("  \"results\": [\n");
+    }
+    else
+    {
+        printf("(II) %s, %s, dispatch = %s\n", ctx.compiler.c_str(), ctx.cpu.c_str(), ctx.dispatch.c_str());
+        if( ctx.counters.empty() == false )
+            printf("(II) counters per call: %s\n", ctx.counters.c_str());
+        printf("| %-18s | %-8s | %-11s | %7s | %6s | %6s | %8s | %3s | %10s | %10s | %8s | %7s | %8s | %9s | %5s |",
+               "kernel", "isa", "pattern", "n", "k", "ws", "frames", "thr", "ns/call", "p99", "stddev", (ctx.cycles == "cycles") ? "cyc/bit" : "tsc/bit", "GB/s", "Mbit/s", "check");
+        for(const std::string& name : ctx.counter_names)
+            printf(" %12s |", name.c_str());
+        printf("\n");
+    }
+}
+
+void print_result(const std::string& format, const bench_context& ctx, const bench_result& r, const bool first)
+{
+    const char* check = (r.check < 0) ? "-" : (r.check ? "ok" : "FAIL");
+    if( format == "csv" )
+    {
+        printf("%s,%s,%s,%d,%d,%lld,%lld,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%.3f,%.1f,%s,%s,\"%s\",%s",
+               r.kernel.c_str(), r.isa.c_str(), r.pattern.c_str(), r.n, r.k, (long long)r.working_set, (long long)r.frames, r.threads, r.iters, r.reps,
+               r.ns_median, r.ns_p99, r.ns_mean, r.ns_stddev, r.ns_min, r.cycles_per_bit, r.gbps, r.mbps,
+               check, ctx.compiler.c_str(), ctx.cpu.c_str(), ctx.cycles.c_str());
+        for(const double v : r.counters)
+            printf(",%.3f", v);
+        printf("\n");
+    }
+    else if( format == "json" )
+    {
+        printf("%s    {\"kernel\": \"%s\", \"isa\": \"%s\", \"pattern\": \"%s\", \"n\": %d, \"k\": %d, \"working_set\": %lld, \"frames\": %lld, \"threads\": %d, \"iters\": %d, \"reps\": %d, "
+               "\"ns_median\": %.3f, \"ns_p99\": %.3f, \"ns_mean\": %.3f, \"ns_stddev\": %.3f, \"ns_min\": %.3f, "
+               "\"cycles_per_bit\": %.4f, \"gbps\": %.3f, \"mbps\": %.1f, \"check\": \"%s\"",
+               first ? "" : ",\n", r.kernel.c_str(), r.isa.c_str(), r.pattern.c_str(), r.n, r.k, (long long)r.working_set, (long long)r.frames, r.threads, r.iters, r.reps,
+               r.ns_median, r.ns_p99, r.ns_mean, r.ns_stddev, r.ns_min, r.cycles_per_bit, r.gbps, r.mbps, check);
+        if( r.counters.empty() == false )
+        {
+            printf(", \"counters\": {");
+            for(size_t i = 0; i < r.counters.size(); i += 1)
+                printf("%s\"%s\": %.3f", (i == 0) ? "" : ", ", ctx.counter_names[i].c_str(), r.counters[i]);
+            printf("}");
+        }
+        printf("}");
+    }
+    else
+    {
+        char k[16];
+        if( r.k < 0 ) snprintf(k, sizeof(k), "rand");
+        else          snprintf(k, sizeof(k), "%d", r.k);
+        char ws[24];
+        if     ( r.working_set == 0         ) snprintf(ws, sizeof(ws), "-");
+        else if( r.working_set >= (1 << 30) ) snprintf(ws, sizeof(ws), "%lldG", (long long)(r.working_set >> 30));
+        else if( r.working_set >= (1 << 20) ) snprintf(ws, sizeof(ws), "%lldM", (long long)(r.working_set >> 20));
+        else                                  snprintf(ws, sizeof(ws), "%lldK", (long long)(r.working_set >> 10));
+        char frames[24];
+        if( r.frames == 0 ) snprintf(frames, sizeof(frames), "-");
+        else                snprintf(frames, sizeof(frames), "%lld", (long long)r.frames);
+        printf("| %-18s | %-8s | %-11s | %7d | %6s | %6s | %8s | %3d | %10.2f | %10.2f | %8.2f | %7.3f | %8.2f | %9.1f | %5s |",
+               r.kernel.c_str(), r.isa.c_str(), r.pattern.c_str(), r.n, k, ws, frames, r.threads,
+               r.ns_median, r.ns_p99, r.ns_stddev, r.cycles_per_bit, r.gbps, r.mbps, check);
+        for(const double v : r.counters)
+            printf(" %12.2f |", v);
+        printf("\n");
+    }
+}
+
+void print_footer(const std::string& format)
+{
+    if( format == "json" )
+        printf("\n  ]\n}\n");
+}
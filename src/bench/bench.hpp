@@ -0,0 +1,172 @@
+/*
+ *	Benchmark harness of the bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _bench_
+#define _bench_
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+//
+// Layout of the source and destination buffers of a benchmarked function
+// for a size of n elements.
+//
+enum bench_layout
+{
+    BENCH_BITS  = 0,    // n packed bits, (n + 7) / 8 bytes
+    BENCH_BYTES = 1,    // n bytes holding 0 or 1 (bit_pack input)
+    BENCH_INT8  = 2,    // n int8_t soft values
+    BENCH_INT16 = 3,    // n int16_t soft values
+    BENCH_INT32 = 4     // n int32_t values (correlation vectors)
+};
+
+//
+// Every function is benchmarked through the same signature. In-place
+// functions work on dst, which holds a copy of src before each run.
+//
+typedef void (*bench_run_t)(uint8_t* dst, const uint8_t* src, const int32_t n, const int32_t k);
+
+struct bench_kernel
+{
+    const char*  name;          // operation (rotate, permutation, bit_pack...)
+    const char*  isa;           // x86, sse4, avx2, avx512, vec/neon, dispatch, tuned, std or naive
+    int32_t      level;         // rshift_isa level the CPU must support
+    bench_layout in;
+    bench_layout out;
+    bool         inplace;       // run() transforms dst and ignores src
+    bench_run_t  run;
+    bench_run_t  reference;     // result compared with it (nullptr: not checked)
+    bool       (*accepts)(const int32_t n);    // nullptr: any size
+};
+
+struct bench_options
+{
+    std::vector<std::string> kernels;               // empty: all of them
+    std::vector<std::string> isas;                  // empty: all of them
+    std::vector<int32_t>     sizes;
+    std::vector<int32_t>     shifts;                // empty: random shift per call
+    std::vector<std::string> patterns = { "random" };
+    std::string              format   = "table";    // table, csv or json
+    int32_t                  iters    = 0;          // calls per repetition, 0: calibrated
+    int32_t                  reps     = 15;
+    uint64_t                 seed     = 1;
+    bool                     list     = false;
+    bool                     throughput = false;    // independent frames spread over a working set
+    std::vector<int64_t>     working_sets;          // bytes, throughput and batch modes
+    bool                     batch    = false;      // rshift_batch entry points
+    std::vector<int32_t>     threads;               // batch mode only
+    bool                     qc       = false;      // QC-LDPC encoding, sizes being lifting sizes
+    bool                     counters = false;      // hardware counters (bench_counters)
+    bool                     sliced   = false;      // rshift_sliced against permutation_avx2
+    std::vector<int32_t>     frames;                // batch sizes of the sliced mode
+    int32_t                  rounds   = 8;          // rotations per load/store, sliced mode
+};
+
+struct bench_result
+{
+    std::string kernel;
+    std::string isa;
+    std::string pattern;
+    int32_t     n;
+    int32_t     k;              // -1: random shift per call
+    int64_t     working_set;    // bytes, 0 in latency mode
+    int64_t     frames;         // frames per pass, 0 in latency mode
+    int32_t     threads;
+    int32_t     iters;
+    int32_t     reps;
+    double      ns_median;      // per call (per frame in throughput mode)
+    double      ns_p99;
+    double      ns_mean;
+    double      ns_stddev;
+    double      ns_min;
+    double      cycles_per_bit; // bench_context::cycles, < 0 when no cycle counter is available
+    double      gbps;           // bytes of the destination written per ns
+    double      mbps;           // Mbit of the n bits processed per second
+    int32_t     check;          // 1: matches the reference, 0: differs, -1: not checked
+    std::vector<double> counters;   // per call over all the repetitions, see counters_names()
+};
+
+extern bool    parse_options(int argc, char* argv[], bench_options& opt);
+extern void    print_usage  (const char* program);
+
+extern int32_t layout_bytes (const bench_layout layout, const int32_t n);
+extern bool    fill_pattern (uint8_t* buffer, const bench_layout layout, const int32_t n, const std::string& pattern, std::mt19937_64& rng);
+
+//
+// Latency mode: the same buffer is processed by every call, so each call
+// depends on the previous one and the data stays in L1.
+//
+extern bench_result measure (const bench_kernel& kernel, const int32_t n, const int32_t k, const std::string& pattern, const bench_options& opt);
+
+//
+// Throughput mode: one pass processes all the independent frames that fit
+// in a working set of ws bytes (sources and destinations), in memory order.
+//
+extern bench_result measure_throughput(const bench_kernel& kernel, const int32_t n, const int32_t k, const int64_t ws, const std::string& pattern, const bench_options& opt);
+
+//
+// Batch mode: permutation_batch or rotate_batch on all the frames of a
+// working set (packed back to back) with a pool of nThreads threads.
+//
+extern bench_result measure_batch(const char* name, const int32_t n, const int32_t k, const int64_t ws, const int32_t nThreads, const std::string& pattern, const bench_options& opt);
+
+//
+// QC-LDPC mode: rshift_qc_encoder with the kernels of one ISA level on a
+// BG1 or BG2 shaped base matrix (name qc_bg1 or qc_bg2) lifted by Z. One
+// call encodes one codeword; n is its number of information bits.
+//
+extern bench_result measure_qc(const char* name, const char* isa, const int32_t level, const int32_t Z, const std::string& pattern, const bench_options& opt);
+
+//
+// Sliced mode: nFrames frames rotated rounds times by 1 (opt.rounds), either
+// in place by permutation_avx2 (name permutation) or through a bit-sliced
+// copy, rshift_sliced (name sliced: load, rounds relabellings, store). Times
+// are per frame and per pass, the conversions included.
+//
+extern bench_result measure_sliced(const char* name, const int32_t n, const int64_t nFrames, const std::string& pattern, const bench_options& opt);
+
+//
+// Description of the build and of the machine, repeated in the CSV rows and
+// in the JSON header so that results of different runs can be compared.
+//
+struct bench_context
+{
+    std::string compiler;
+    std::string cpu;
+    std::string dispatch;       // kernels bound by the runtime dispatcher
+    std::string counters;       // source of the counters, empty without --counters
+    std::string cycles;         // counter of cycles_per_bit: "cycles" (core, perf), "tsc" or "none"
+    std::vector<std::string> counter_names;
+};
+
+extern bench_context make_context(const bench_options& opt);
+
+extern void    print_header (const std::string& format, const bench_context& ctx);
+extern void    print_result (const std::string& format, const bench_context& ctx, const bench_result& r, const bool first);
+extern void    print_footer (const std::string& format);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ *	Hardware performance counters of the benchmark - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "bench_counters.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #include <cpuid.h>
+    #define BENCH_HAS_TSC
+#endif
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define BENCH_HAS_PERF
+#endif
+
+struct raw_event
+{
+    const char* name;
+    uint64_t    config;     // umask << 8 | event
+};
+
+// Skylake, Cascade Lake, Kaby/Coffee/Comet Lake, Ice Lake, Tiger Lake, Rocket Lake
+static const uint32_t  skylake_models[] = { 0x4E, 0x5E, 0x55, 0x8E, 0x9E, 0xA5, 0xA6, 0x66, 0x7D, 0x7E, 0x6A, 0x6C, 0x8C, 0x8D, 0xA7 };
+static const raw_event skylake_events[] =
+{
+    { "st_fwd_blk", 0x0203 },   // LD_BLOCKS.STORE_FORWARD
+    { "loads",      0x81D0 },   // MEM_INST_RETIRED.ALL_LOADS
+    { "stores",     0x82D0 },   // MEM_INST_RETIRED.ALL_STORES
+    { "p0",         0x01A1 },   // UOPS_DISPATCHED.PORT_0
+    { "p1",         0x02A1 },   // UOPS_DISPATCHED.PORT_1
+    { "p5",         0x20A1 },   // UOPS_DISPATCHED.PORT_5
+    { "p6",         0x40A1 },   // UOPS_DISPATCHED.PORT_6
+};
+
+// Sapphire Rapids, Emerald Rapids
+static const uint32_t  golden_cove_models[] = { 0x8F, 0xCF };
+static const raw_event golden_cove_events[] =
+{
+    { "st_fwd_blk", 0x8203 },   // LD_BLOCKS.STORE_FORWARD
+    { "loads",      0x81D0 },   // MEM_INST_RETIRED.ALL_LOADS
+    { "stores",     0x82D0 },   // MEM_INST_RETIRED.ALL_STORES
+    { "p0",         0x01B2 },   // UOPS_DISPATCHED.PORT_0
+    { "p1",         0x02B2 },   // UOPS_DISPATCHED.PORT_1
+    { "p5",         0x20B2 },   // UOPS_DISPATCHED.PORT_5_11
+    { "p6",         0x40B2 },   // UOPS_DISPATCHED.PORT_6
+};
+
+static std::vector<std::string> names;
+static std::string              source = "rdtsc (--counters not given)";
+static std::vector<int>         fds;
+#ifdef BENCH_HAS_TSC
+static uint64_t                 tsc_start = 0;
+#else
+static std::chrono::steady_clock::time_point clock_start;
+#endif
+
+static bool contains(const uint32_t* models, const int32_t count, const uint32_t model)
+{
+    for(int32_t i = 0; i < count; i += 1)
+        if( models[i] == model )
+            return true;
+    return false;
+}
+
+//
+// Raw events of the CPU, nullptr (and count = 0) when its model is not in
+// one of the tables above.
+//
+static const raw_event* intel_events(int32_t& count)
+{
+    count = 0;
+#ifdef BENCH_HAS_TSC
+    uint32_t eax, ebx, ecx, edx;
+    if( __get_cpuid(0, &eax, &ebx, &ecx, &edx) == 0 )
+        return nullptr;
+    const bool intel = (ebx == 0x756E6547) && (edx == 0x49656E69) && (ecx == 0x6C65746E);    // GenuineIntel
+    if( (intel == false) || (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) )
+        return nullptr;
+    const uint32_t family = (eax >> 8) & 0xF;
+    const uint32_t model  = ((eax >> 4) & 0xF) | (((eax >> 16) & 0xF) << 4);
+    if( family != 6 )
+        return nullptr;
+    if( contains(skylake_models, sizeof(skylake_models) / sizeof(uint32_t), model) )
+    {
+        count = sizeof(skylake_events) / sizeof(raw_event);
+        return skylake_events;
+    }
+    if( contains(golden_cove_models, sizeof(golden_cove_models) / sizeof(uint32_t), model) )
+    {
+        count = sizeof(golden_cove_events) / sizeof(raw_event);
+        return golden_cove_events;
+    }
+#endif
+    return nullptr;
+}
+
+#ifdef BENCH_HAS_PERF
+static int open_event(const uint32_t type, const uint64_t config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = type;
+    attr.size           = sizeof(attr);
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.inherit        = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void add_event(const char* name, const uint32_t type, const uint64_t config)
+{
+    const int fd = open_event(type, config);
+    if( fd < 0 )
+        return;
+    names.push_back( name );
+    fds.push_back( fd );
+}
+#endif
+
+static void use_tsc(const char* reason)
+{
+    names  = { "tsc" };
+    source = std::string("rdtsc (") + reason + ")";
+#ifndef BENCH_HAS_TSC
+    names  = { "ns" };
+    source = std::string("steady_clock (") + reason + ")";
+#endif
+}
+
+bool counters_open()
+{
+    names.clear();
+#ifdef BENCH_HAS_PERF
+    const int cycles = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if( cycles < 0 )
+    {
+        const int error = errno;
+        if( (error == EACCES) || (error == EPERM) )
+            use_tsc( "perf_event_open not permitted, see /proc/sys/kernel/perf_event_paranoid" );
+        else if( (error == ENOENT) || (error == ENODEV) || (error == EOPNOTSUPP) )
+            use_tsc( "no hardware counters exposed by the kernel" );
+        else
+            use_tsc( strerror(error) );
+        return false;
+    }
+    names.push_back( "cycles" );
+    fds.push_back( cycles );
+
+    add_event("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    add_event("l1d_miss",     PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    int32_t count = 0;
+    const raw_event* events = intel_events(count);
+    for(int32_t i = 0; i < count; i += 1)
+        add_event(events[i].name, PERF_TYPE_RAW, events[i].config);
+
+    source = "perf";
+    return true;
+#else
+    use_tsc("perf_event_open is Linux only");
+    return false;
+#endif
+}
+
+const std::vector<std::string>& counters_names()
+{
+    return names;
+}
+
+const std::string& counters_source()
+{
+    return source;
+}
+
+void counters_start()
+{
+#ifdef BENCH_HAS_PERF
+    for(const int fd : fds)
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    for(const int fd : fds)
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+#ifdef BENCH_HAS_TSC
+    tsc_start = __rdtsc();
+#else
+    clock_start = std::chrono::steady_clock::now();
+#endif
+}
+
+std::vector<double> counters_stop(const double calls)
+{
+#ifdef BENCH_HAS_TSC
+    const uint64_t tsc_end = __rdtsc();
+#else
+    const auto clock_end = std::chrono::steady_clock::now();
+#endif
+    std::vector<double> values;
+
+#ifdef BENCH_HAS_PERF
+    for(const int fd : fds)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    for(const int fd : fds)
+    {
+        uint64_t data[3] = { 0, 0, 0 };     // value, time enabled, time running
+        double   v       = 0;
+        if( (read(fd, data, sizeof(data)) == (ssize_t)sizeof(data)) && (data[2] != 0) )
+            v = (double)data[0] * ((double)data[1] / (double)data[2]);
+        values.push_back( v / calls );
+    }
+    if( fds.empty() == false )
+        return values;
+#endif
+
+#ifdef BENCH_HAS_TSC
+    values.push_back( (double)(tsc_end - tsc_start) / calls );
+#else
+    values.push_back( std::chrono::duration<double, std::nano>(clock_end - clock_start).count() / calls );
+#endif
+    return values;
+}
@@ -0,0 +1,63 @@
+/*
+ *	Hardware performance counters of the benchmark - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _bench_counters_
+#define _bench_counters_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Optional hardware counters read around the timed loops (--counters). On
+// Linux they are opened with perf_event_open for the calling thread (and
+// the threads it creates afterwards), user space only:
+//
+//     cycles, instructions        generic events
+//     l1d_miss                    L1D read misses (generic cache event)
+//     st_fwd_blk                  loads blocked by a failed store forwarding
+//     loads, stores               retired load / store instructions
+//     p0, p1, p5, p6              uops dispatched to ports 0, 1, 5 and 6
+//
+// The last four groups are raw Intel events, opened only on the cores
+// whose encodings are known (Skylake to Ice Lake / Tiger Lake, and Golden
+// Cove server parts where p5 also counts port 11); every event the kernel
+// refuses is dropped on its own. When not even cycles can be opened (perf not
+// permitted, no PMU in the VM, not Linux) the only counter is "tsc", the
+// time stamp counter read with rdtsc.
+//
+extern bool                            counters_open   ();     // false: rdtsc fallback
+extern const std::vector<std::string>& counters_names  ();
+extern const std::string&              counters_source ();     // "perf" or "rdtsc (reason)"
+
+//
+// counters_start resets and enables the counters, counters_stop disables
+// them and returns their values divided by calls, in the order of
+// counters_names (scaled when the kernel had to multiplex them).
+//
+extern void                counters_start();
+extern std::vector<double> counters_stop (const double calls);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_pack_avx2.hpp"
+#ifdef RSHIFT_HAS_AVX2
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_pack_x86.hpp"
+
+//
+// 32 bytes per vpmovmskb once bit 0 of every byte is moved to bit 7, two
+// independent registers per iteration. The last length % 32 bytes are
+// packed by bit_pack_x86.
+//
+RSHIFT_TARGET_AVX2 void bit_pack_avx2(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length)
+{
+    int32_t i = 0;
+    for(; i + 64 <= length; i += 64)
+    {
+        const __m256i  A = _mm256_loadu_si256( (const __m256i*)(src + i     ) );
+        const __m256i  B = _mm256_loadu_si256( (const __m256i*)(src + i + 32) );
+        const uint32_t a = (uint32_t)_mm256_movemask_epi8( _mm256_slli_epi16(A, 7) );
+        const uint32_t b = (uint32_t)_mm256_movemask_epi8( _mm256_slli_epi16(B, 7) );
+        const uint64_t m = ((uint64_t)b << 32) | a;
+        memcpy(dst + i / 8, &m, sizeof(uint64_t));
+    }
+    if( i + 32 <= length )
+    {
+        const __m256i  A = _mm256_loadu_si256( (const __m256i*)(src + i) );
+        const uint32_t m = (uint32_t)_mm256_movemask_epi8( _mm256_slli_epi16(A, 7) );
+        memcpy(dst + i / 8, &m, sizeof(uint32_t));
+        i += 32;
+    }
+    if( i < length )
+        bit_pack_x86(dst + i / 8, src + i, length - i);
+}
+
+//
+// Fused packing + rotation (see bit_pack_rotated_x86), 32 source bytes of
+// the rotated array per vpmovmskb.
+//
+RSHIFT_TARGET_AVX2 void bit_pack_rotated_avx2(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length,
+        const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    uint8_t buf[32];
+
+    int32_t i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+        const uint8_t* p = rotated_bytes(src, length, shift, i, 32, buf);
+        const __m256i  A = _mm256_loadu_si256( (const __m256i*)p );
+        const uint32_t m = (uint32_t)_mm256_movemask_epi8( _mm256_slli_epi16(A, 7) );
+        memcpy(dst + i / 8, &m, sizeof(uint32_t));
+    }
+    if( i < length )
+        bit_pack_x86(dst + i / 8, rotated_bytes(src, length, shift, i, length - i, buf), length - i);
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_pack_avx512.hpp"
+#ifdef RSHIFT_HAS_AVX512
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_pack_x86.hpp"
+
+//
+// 64 bytes per vptestmb (bit 0 of every byte) straight into a __mmask64.
+// The tail is a masked load of the last length % 64 bytes, so no byte past
+// src + length is read and (length % 64 + 7) / 8 bytes are written.
+//
+RSHIFT_TARGET_AVX512 void bit_pack_avx512(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length)
+{
+    const __m512i one = _mm512_set1_epi8(1);
+    int32_t i = 0;
+    for(; i + 64 <= length; i += 64)
+    {
+        const __m512i   A = _mm512_loadu_si512( src + i );
+        const uint64_t  m = _mm512_test_epi8_mask( A, one );
+        memcpy(dst + i / 8, &m, sizeof(uint64_t));
+    }
+    if( i < length )
+    {
+        const int32_t   rem = length - i;
+        const __mmask64 M   = (1ULL << rem) - 1;
+        const __m512i   A   = _mm512_maskz_loadu_epi8( M, src + i );
+        const uint64_t  m   = _mm512_test_epi8_mask( A, one );
+        memcpy(dst + i / 8, &m, (rem + 7) / 8);
+    }
+}
+
+//
+// Fused packing + rotation (see bit_pack_rotated_x86), 64 source bytes of
+// the rotated array per vptestmb.
+//
+RSHIFT_TARGET_AVX512 void bit_pack_rotated_avx512(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length,
+        const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    const __m512i one   = _mm512_set1_epi8(1);
+    uint8_t buf[64];
+
+    int32_t i = 0;
+    for(; i + 64 <= length; i += 64)
+    {
+        const __m512i  A = _mm512_loadu_si512( rotated_bytes(src, length, shift, i, 64, buf) );
+        const uint64_t m = _mm512_test_epi8_mask( A, one );
+        memcpy(dst + i / 8, &m, sizeof(uint64_t));
+    }
+    if( i < length )
+    {
+        const int32_t   rem = length - i;
+        const __mmask64 M   = (1ULL << rem) - 1;
+        const __m512i   A   = _mm512_maskz_loadu_epi8( M, rotated_bytes(src, length, shift, i, rem, buf) );
+        const uint64_t  m   = _mm512_test_epi8_mask( A, one );
+        memcpy(dst + i / 8, &m, (rem + 7) / 8);
+    }
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_pack_sse4.hpp"
+#ifdef RSHIFT_HAS_SSE4
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_pack_x86.hpp"
+
+//
+// 16 bytes per pmovmskb once bit 0 of every byte is moved to bit 7. The last
+// length % 16 bytes are packed by bit_pack_x86.
+//
+RSHIFT_TARGET_SSE4 void bit_pack_sse4(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length)
+{
+    int32_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        const __m128i  A = _mm_loadu_si128( (const __m128i*)(src + i) );
+        const uint16_t m = (uint16_t)_mm_movemask_epi8( _mm_slli_epi16(A, 7) );
+        memcpy(dst + i / 8, &m, sizeof(uint16_t));
+    }
+    if( i < length )
+        bit_pack_x86(dst + i / 8, src + i, length - i);
+}
+
+//
+// Fused packing + rotation (see bit_pack_rotated_x86), 16 source bytes of
+// the rotated array per pmovmskb.
+//
+RSHIFT_TARGET_SSE4 void bit_pack_rotated_sse4(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length,
+        const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    uint8_t buf[16];
+
+    int32_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        const uint8_t* p = rotated_bytes(src, length, shift, i, 16, buf);
+        const __m128i  A = _mm_loadu_si128( (const __m128i*)p );
+        const uint16_t m = (uint16_t)_mm_movemask_epi8( _mm_slli_epi16(A, 7) );
+        memcpy(dst + i / 8, &m, sizeof(uint16_t));
+    }
+    if( i < length )
+        bit_pack_x86(dst + i / 8, rotated_bytes(src, length, shift, i, length - i, buf), length - i);
+}
+
+#endif
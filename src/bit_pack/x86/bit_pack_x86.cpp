@@ -25,29 +25,67 @@
 
 #include "bit_pack_x86.hpp"
 
+#include <string.h>
+
+//
+// Eight 0/1 bytes are gathered into one byte with a single multiply: byte i
+// of the 64-bit word times byte 7 - i of 0x0102040810204080 (1 << i) lands
+// in bit 56 + i, and no other partial product reaches the top byte. A
+// length that is not a multiple of 8 fills the low bits of the last byte,
+// its high bits are 0.
+//
 void bit_pack_x86(
               uint8_t* __restrict dst,
         const uint8_t* __restrict src,
         const int32_t length)
 {
-    if( length%8 != 0 )
+    const int32_t ll = length / 8;
+
+    for(int32_t i = 0; i < ll; i += 1)
     {
-        printf("(EE) The array length that have (length%%8 != 0) are not currently managed !");
-        exit( EXIT_FAILURE );
+        uint64_t v;
+        memcpy(&v, src + 8 * i, sizeof(uint64_t));
+        dst[i] = (uint8_t)((v * 0x0102040810204080ULL) >> 56);
     }
 
-    const uint8_t* ptr = src;
-    const int32_t ll = length / 8;
+    if( length % 8 != 0 )
+    {
+        const uint8_t* ptr = src + 8 * ll;
+        uint8_t v = 0;
+        for( int32_t q = 0; q < length % 8 ; q += 1 )
+            v = v | (ptr[q] << q);
+        dst[ll] = v;
+    }
+}
+
+//
+// Same packing, the 8 source bytes of every output byte being taken from
+// the rotated byte array (see rotated_bytes): a single pass replaces
+// bit_pack followed by a rotation of the packed array.
+//
+void bit_pack_rotated_x86(
+              uint8_t* __restrict dst,
+        const uint8_t* __restrict src,
+        const int32_t length,
+        const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    const int32_t ll    = length / 8;
+    uint8_t buf[8];
 
     for(int32_t i = 0; i < ll; i += 1)
     {
-        uint8_t v = (*ptr++);
-#pragma clang loop unroll(full)
-        for( uint32_t q = 1; q < 8 ; q += 1 )
-        {
-            v = v | ((*ptr) << q);
-            ptr += 1;
-        }
-        dst[i] = v;
+        uint64_t v;
+        memcpy(&v, rotated_bytes(src, length, shift, 8 * i, 8, buf), sizeof(uint64_t));
+        dst[i] = (uint8_t)((v * 0x0102040810204080ULL) >> 56);
+    }
+
+    if( length % 8 != 0 )
+    {
+        const uint8_t* ptr = rotated_bytes(src, length, shift, 8 * ll, length % 8, buf);
+        uint8_t v = 0;
+        for( int32_t q = 0; q < length % 8 ; q += 1 )
+            v = v | (ptr[q] << q);
+        dst[ll] = v;
     }
 }
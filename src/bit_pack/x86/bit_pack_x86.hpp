@@ -29,8 +29,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 extern void bit_pack_x86(uint8_t* __restrict dst, const uint8_t* __restrict src, const int32_t length);
 
+//
+// Packing with a cyclic rotation of k bits in the same pass:
+// src[i] lands in bit (i + k) % length of dst, as bit_pack followed by
+// rotate(k) would do.
+//
+extern void bit_pack_rotated_x86(uint8_t* __restrict dst, const uint8_t* __restrict src, const int32_t length, const int32_t k);
+
+//
+// Pointer on the w bytes that start at index i of src rotated by shift
+// (element i of the rotated array being src[(i - shift) mod length]). It is
+// src itself unless the w bytes straddle the wrap point, in which case they
+// are gathered in buf (w bytes).
+//
+inline const uint8_t* rotated_bytes(const uint8_t* src, const int32_t length, const int32_t shift, const int32_t i, const int32_t w, uint8_t* buf)
+{
+    if( i + w <= shift )
+        return src + length - shift + i;
+    if( i >= shift )
+        return src + i - shift;
+    memcpy(buf,               src + length - shift + i, shift - i    );
+    memcpy(buf + (shift - i), src,                      w - shift + i);
+    return buf;
+}
+
 #endif
     
@@ -0,0 +1,86 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_unpack_avx2.hpp"
+#ifdef RSHIFT_HAS_AVX2
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_unpack_x86.hpp"
+
+//
+// 4 bytes are broadcast to every 32-bit lane, vpshufb spreads byte q over
+// the bytes 8q..8q+7 (bytes 0-1 in the low 128-bit lane, 2-3 in the high
+// one) and vpcmpeqb turns the selected bits into 0/1. The last
+// length % 32 bits are unpacked by bit_unpack_x86.
+//
+RSHIFT_TARGET_AVX2 void bit_unpack_avx2(uint8_t* dst, const uint8_t* src, const int32_t length)
+{
+    const __m256i shuf = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x( 0x8040201008040201LL );
+    const __m256i one  = _mm256_set1_epi8(1);
+
+    int32_t i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+        uint32_t m;
+        memcpy(&m, src + i / 8, sizeof(uint32_t));
+        const __m256i A = _mm256_shuffle_epi8( _mm256_set1_epi32(m), shuf );
+        const __m256i D = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_and_si256(A, bits), bits ), one );
+        _mm256_storeu_si256( (__m256i*)(dst + i), D );
+    }
+    if( i < length )
+        bit_unpack_x86(dst + i, src + i / 8, length - i);
+}
+
+//
+// Fused rotation + unpacking (see bit_unpack_rotated_x86), 32 bits of the
+// rotated array per register.
+//
+RSHIFT_TARGET_AVX2 void bit_unpack_rotated_avx2(uint8_t* dst, const uint8_t* src, const int32_t length, const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    const __m256i shuf  = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                           2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits  = _mm256_set1_epi64x( 0x8040201008040201LL );
+    const __m256i one   = _mm256_set1_epi8(1);
+
+    int32_t i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+        const uint32_t m = (uint32_t)rotated_bits(src, length, shift, i, 32);
+        const __m256i  A = _mm256_shuffle_epi8( _mm256_set1_epi32(m), shuf );
+        const __m256i  D = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_and_si256(A, bits), bits ), one );
+        _mm256_storeu_si256( (__m256i*)(dst + i), D );
+    }
+    if( i < length )
+    {
+        const uint64_t m = rotated_bits(src, length, shift, i, length - i);
+        bit_unpack_x86(dst + i, (const uint8_t*)&m, length - i);
+    }
+}
+
+#endif
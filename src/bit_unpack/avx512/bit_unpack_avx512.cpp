@@ -0,0 +1,81 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_unpack_avx512.hpp"
+#ifdef RSHIFT_HAS_AVX512
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_unpack_x86.hpp"
+
+//
+// 8 bytes are a __mmask64 selecting which of the 64 output bytes are 1
+// (vmovdqu8 with zero masking). The tail reads the (length % 64 + 7) / 8
+// remaining bytes and stores length % 64 bytes under a mask.
+//
+RSHIFT_TARGET_AVX512 void bit_unpack_avx512(uint8_t* dst, const uint8_t* src, const int32_t length)
+{
+    const __m512i one = _mm512_set1_epi8(1);
+    int32_t i = 0;
+    for(; i + 64 <= length; i += 64)
+    {
+        uint64_t m;
+        memcpy(&m, src + i / 8, sizeof(uint64_t));
+        _mm512_storeu_si512( dst + i, _mm512_maskz_mov_epi8( m, one ) );
+    }
+    if( i < length )
+    {
+        const int32_t   rem = length - i;
+        const __mmask64 M   = (1ULL << rem) - 1;
+        uint64_t m = 0;
+        memcpy(&m, src + i / 8, (rem + 7) / 8);
+        _mm512_mask_storeu_epi8( dst + i, M, _mm512_maskz_mov_epi8( m, one ) );
+    }
+}
+
+//
+// Fused rotation + unpacking (see bit_unpack_rotated_x86), 64 bits of the
+// rotated array per masked vmovdqu8.
+//
+RSHIFT_TARGET_AVX512 void bit_unpack_rotated_avx512(uint8_t* dst, const uint8_t* src, const int32_t length, const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    const __m512i one   = _mm512_set1_epi8(1);
+    int32_t i = 0;
+    for(; i + 64 <= length; i += 64)
+    {
+        const uint64_t m = rotated_bits(src, length, shift, i, 64);
+        _mm512_storeu_si512( dst + i, _mm512_maskz_mov_epi8( m, one ) );
+    }
+    if( i < length )
+    {
+        const int32_t   rem = length - i;
+        const __mmask64 M   = (1ULL << rem) - 1;
+        const uint64_t  m   = rotated_bits(src, length, shift, i, rem);
+        _mm512_mask_storeu_epi8( dst + i, M, _mm512_maskz_mov_epi8( m, one ) );
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+*	Bit-unpacking functions - Copyright (c) 2021 Bertrand LE GAL
+*
+*  This software is provided 'as-is', without any express or
+*  implied warranty. In no event will the authors be held
+*  liable for any damages arising from the use of this software.
+*
+*  Permission is granted to anyone to use this software for any purpose,
+*  including commercial applications, and to alter it and redistribute
+*  it freely, subject to the following restrictions:
+*
+*  1. The origin of this software must not be misrepresented;
+*  you must not claim that you wrote the original software.
+*  If you use this software in a product, an acknowledgment
+*  in the product documentation would be appreciated but
+*  is not required.
+*
+*  2. Altered source versions must be plainly marked as such,
+*  and must not be misrepresented as being the original software.
+*
+*  3. This notice may not be removed or altered from any
+*  source distribution.
+*
+*/
+
+#include "bit_unpack_sse4.hpp"
+#ifdef RSHIFT_HAS_SSE4
+
+#include <string.h>
+#include <immintrin.h>
+#include "../x86/bit_unpack_x86.hpp"
+
+//
+// 2 bytes are broadcast to the two halves of a register (pshufb), every
+// byte keeps its own bit and pcmpeqb turns it into 0/1. The last
+// length % 16 bits are unpacked by bit_unpack_x86.
+//
+RSHIFT_TARGET_SSE4 void bit_unpack_sse4(uint8_t* dst, const uint8_t* src, const int32_t length)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits = _mm_set1_epi64x( 0x8040201008040201LL );
+    const __m128i one  = _mm_set1_epi8(1);
+
+    int32_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        uint16_t m;
+        memcpy(&m, src + i / 8, sizeof(uint16_t));
+        const __m128i A = _mm_shuffle_epi8( _mm_cvtsi32_si128(m), shuf );
+        const __m128i D = _mm_and_si128( _mm_cmpeq_epi8( _mm_and_si128(A, bits), bits ), one );
+        _mm_storeu_si128( (__m128i*)(dst + i), D );
+    }
+    if( i < length )
+        bit_unpack_x86(dst + i, src + i / 8, length - i);
+}
+
+//
+// Fused rotation + unpacking (see bit_unpack_rotated_x86), 16 bits of the
+// rotated array per register.
+//
+RSHIFT_TARGET_SSE4 void bit_unpack_rotated_sse4(uint8_t* dst, const uint8_t* src, const int32_t length, const int32_t k)
+{
+    const int32_t shift = ((k % length) + length) % length;
+    const __m128i shuf  = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits  = _mm_set1_epi64x( 0x8040201008040201LL );
+    const __m128i one   = _mm_set1_epi8(1);
+
+    int32_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        const uint32_t m = (uint32_t)rotated_bits(src, length, shift, i, 16);
+        const __m128i  A = _mm_shuffle_epi8( _mm_cvtsi32_si128(m), shuf );
+        const __m128i  D = _mm_and_si128( _mm_cmpeq_epi8( _mm_and_si128(A, bits), bits ), one );
+        _mm_storeu_si128( (__m128i*)(dst + i), D );
+    }
+    if( i < length )
+    {
+        const uint64_t m = rotated_bits(src, length, shift, i, length - i);
+        bit_unpack_x86(dst + i, (const uint8_t*)&m, length - i);
+    }
+}
+
+#endif
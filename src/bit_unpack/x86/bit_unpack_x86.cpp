@@ -25,24 +25,52 @@
 
 #include "bit_unpack_x86.hpp"
 
+#include <string.h>
+
+//
+// One byte is spread over eight 0/1 bytes without a loop: the byte is
+// broadcast to the 8 bytes of a word, byte q keeps bit q, and adding 0x7F
+// moves any non-zero byte to 0x80 or above. Only length bytes are written,
+// the last source byte being partially used when length % 8 != 0.
+//
 void bit_unpack_x86(uint8_t* dst, const uint8_t* src, const int32_t length)
 {
-    if( length%8 != 0 )
+    const int32_t nBytes = length / 8;
+    for(int32_t i = 0; i < nBytes; i += 1)
     {
-        printf("(EE) The array length that have (length%%8 != 0) are not currently managed !");
-        exit( EXIT_FAILURE );
+        const uint64_t b = src[i] * 0x0101010101010101ULL;
+        const uint64_t v = (((b & 0x8040201008040201ULL) + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL;
+        memcpy(dst + 8 * i, &v, sizeof(uint64_t));
     }
 
-    const int32_t nBytes = length / 8;
-    for(int32_t i = 0; i < nBytes; i += 1)
+    if( length % 8 != 0 )
     {
-        const uint32_t v = src[i];
-#pragma clang loop unroll(full)
-        for( uint32_t q = 0; q < 8 ; q += 1 )
-        {
-            (*dst++) = (v >> q) & 0x01;
-        }
+        const uint32_t v = src[nBytes];
+        for( int32_t q = 0; q < length % 8 ; q += 1 )
+            dst[8 * nBytes + q] = (v >> q) & 0x01;
     }
 }
 
+//
+// Same unpacking, every output byte reading its 8 bits from the rotated
+// bit array (see rotated_bits): a single pass replaces a rotation of the
+// packed array followed by bit_unpack.
+//
+void bit_unpack_rotated_x86(uint8_t* dst, const uint8_t* src, const int32_t length, const int32_t k)
+{
+    const int32_t shift  = ((k % length) + length) % length;
+    const int32_t nBytes = length / 8;
+    for(int32_t i = 0; i < nBytes; i += 1)
+    {
+        const uint64_t b = rotated_bits(src, length, shift, 8 * i, 8) * 0x0101010101010101ULL;
+        const uint64_t v = (((b & 0x8040201008040201ULL) + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL;
+        memcpy(dst + 8 * i, &v, sizeof(uint64_t));
+    }
 
+    if( length % 8 != 0 )
+    {
+        const uint64_t v = rotated_bits(src, length, shift, 8 * nBytes, length % 8);
+        for( int32_t q = 0; q < length % 8 ; q += 1 )
+            dst[8 * nBytes + q] = (v >> q) & 0x01;
+    }
+}
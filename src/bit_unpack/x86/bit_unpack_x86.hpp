@@ -29,8 +29,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 extern void bit_unpack_x86(uint8_t* dst, const uint8_t* src, const int32_t length);
 
+//
+// Unpacking with a cyclic rotation of k bits in the same pass: dst[(i + k)
+// % length] receives bit i of src, as rotate(k) followed by bit_unpack
+// would do.
+//
+extern void bit_unpack_rotated_x86(uint8_t* dst, const uint8_t* src, const int32_t length, const int32_t k);
+
+//
+// The 0 < w <= 64 bits of src starting at bit o (o + w <= length). No byte
+// past (length + 7) / 8 is read.
+//
+inline uint64_t fetch_bits(const uint8_t* src, const int32_t length, const int32_t o, const int32_t w)
+{
+    const int32_t first = o / 8;
+    const int32_t sh    = o % 8;
+    const uint32_t count = (sh + w + 7) / 8;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    if( first + 9 <= (length + 7) / 8 )
+    {
+        memcpy(&lo, src + first, 8);
+        hi = src[first + 8];
+    }
+    else
+    {
+        memcpy(&lo, src + first, (count < 8) ? count : 8);
+        if( count > 8 )
+            hi = src[first + 8];
+    }
+    const uint64_t v = (sh == 0) ? lo : (lo >> sh) | (hi << (64 - sh));
+    return (w == 64) ? v : v & ((1ULL << w) - 1);
+}
+
+//
+// The w bits that start at bit i of src rotated by shift (bit i of the
+// rotated array being bit (i - shift) mod length of src), wrapping around
+// the end of src when needed.
+//
+inline uint64_t rotated_bits(const uint8_t* src, const int32_t length, const int32_t shift, const int32_t i, const int32_t w)
+{
+    const int32_t o = (i >= shift) ? i - shift : i - shift + length;
+    if( o + w <= length )
+        return fetch_bits(src, length, o, w);
+    const int32_t a = length - o;
+    return fetch_bits(src, length, o, a) | (fetch_bits(src, length, 0, w - a) << a);
+}
+
 #endif
     
@@ -23,172 +23,592 @@
 *
 */
 
-//#ifndef __ARM_NEON__
-//    #define __ARM_NEON__ // Mode emulation
-//#endif
-
 #include "./rshift/rshift_x86.hpp"
 #include "./rshift/rshift_sse4.hpp"
 #include "./rshift/rshift_avx2.hpp"
+#include "./rshift/rshift_avx512.hpp"
+#include "./rshift/rshift_vec.hpp"
+#include "./rshift/rshift.hpp"
+#include "./rshift/rshift_static.hpp"
 
 #include "./bit_pack/x86/bit_pack_x86.hpp"
+#include "./bit_pack/sse4/bit_pack_sse4.hpp"
+#include "./bit_pack/avx2/bit_pack_avx2.hpp"
+#include "./bit_pack/avx512/bit_pack_avx512.hpp"
 #include "./bit_unpack/x86/bit_unpack_x86.hpp"
+#include "./bit_unpack/sse4/bit_unpack_sse4.hpp"
+#include "./bit_unpack/avx2/bit_unpack_avx2.hpp"
+#include "./bit_unpack/avx512/bit_unpack_avx512.hpp"
+
+#include "./vshift/vshift_x86.hpp"
+#include "./vshift/vshift_sse4.hpp"
+#include "./vshift/vshift_avx2.hpp"
+#include "./vshift/vshift_avx512.hpp"
+
+#include "./rshift/rshift_batch.hpp"
+#include "./rshift/rshift_large.hpp"
+#include "./rshift/rshift_view.hpp"
+#include "./rshift/rshift_bitset.hpp"
+#include "./rshift/rshift_qc.hpp"
+#include "./rshift/rshift_correlate.hpp"
+#include "./rshift/rshift_permute.hpp"
+#include "./rshift/rshift_tune.hpp"
 
-#include <cstring>
-#include <chrono>
+#include "./bench/bench.hpp"
 
-void dump_uint8_bits(const uint8_t* bits, const int32_t ll)
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+
+//
+// The shift_left/shift_right kernels only accept 0 <= k <= min(64, n): the
+// benchmarked shift amount is folded into that range.
+//
+static int32_t shift_amount(const int32_t n, const int32_t k)
 {
-    for(int32_t i = 0; i < ll; i += 1)
+    return k % (std::min(n, 64) + 1);
+}
+
+//
+// Every kernel of one ISA, checked against the x86 version of the same
+// operation.
+//
+#define BENCH_KERNELS(ISA, LEVEL)                                                                       \
+    { "permutation", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                         \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_##ISA(d, n); },  \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86  (d, n); },  \
+        nullptr },                                                                                      \
+    { "rotate", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                              \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_##ISA(d, n, k); },    \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86  (d, n, k); },    \
+        nullptr },                                                                                      \
+    { "rotate_copy", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, false,                                        \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_##ISA(d, s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86  (d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "rotate_stream", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, false,                                      \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_##ISA(d, s, n, k, 1, true); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86  (d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "permutation_static", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                  \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_static<LEVEL>(d, n); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86(d, n); },    \
+        accepts_static },                                                                               \
+    { "rotate_static", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                       \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_static<LEVEL>(d, n, k); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },      \
+        accepts_static },                                                                               \
+    { "rotate_right", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                        \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_right_##ISA(d, n, k); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_right_x86  (d, n, k); }, \
+        nullptr },                                                                                      \
+    { "shift_left", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                          \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_left_##ISA(d, n, shift_amount(n, k)); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_left_x86  (d, n, shift_amount(n, k)); }, \
+        nullptr },                                                                                      \
+    { "shift_right", #ISA, LEVEL, BENCH_BITS, BENCH_BITS, true,                                         \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_right_##ISA(d, n, shift_amount(n, k)); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_right_x86  (d, n, shift_amount(n, k)); }, \
+        nullptr },                                                                                      \
+    { "bit_pack", #ISA, LEVEL, BENCH_BYTES, BENCH_BITS, false,                                          \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { bit_pack_##ISA(d, s, n); },  \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { bit_pack_x86  (d, s, n); },  \
+        nullptr },                                                                                      \
+    { "bit_unpack", #ISA, LEVEL, BENCH_BITS, BENCH_BYTES, false,                                        \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { bit_unpack_##ISA(d, s, n); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { bit_unpack_x86  (d, s, n); }, \
+        nullptr },                                                                                      \
+    { "bit_pack_rotated", #ISA, LEVEL, BENCH_BYTES, BENCH_BITS, false,                                  \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { bit_pack_rotated_##ISA(d, s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { bit_pack_rotated_x86  (d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "bit_unpack_rotated", #ISA, LEVEL, BENCH_BITS, BENCH_BYTES, false,                                \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { bit_unpack_rotated_##ISA(d, s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { bit_unpack_rotated_x86  (d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "vrotate8", #ISA, LEVEL, BENCH_INT8, BENCH_INT8, false,                                           \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { vrotate_##ISA((int8_t*)d, (const int8_t*)s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { vrotate_x86  ((int8_t*)d, (const int8_t*)s, n, k); }, \
+        nullptr },                                                                                      \
+    { "vrotate16", #ISA, LEVEL, BENCH_INT16, BENCH_INT16, false,                                        \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { vrotate_##ISA((int16_t*)d, (const int16_t*)s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { vrotate_x86  ((int16_t*)d, (const int16_t*)s, n, k); }, \
+        nullptr },
+
+//
+// The portable backend (rshift_vec) only has the rotation kernels, listed
+// as "vec" ("neon" in the NEON builds).
+//
+#define BENCH_VEC_KERNELS                                                                               \
+    { "permutation", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, true,                   \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_vec(d, n); },    \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86(d, n); },    \
+        nullptr },                                                                                      \
+    { "rotate", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, true,                        \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_vec(d, n, k); },      \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },      \
+        nullptr },                                                                                      \
+    { "rotate_copy", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, false,                  \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_vec(d, s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "rotate_stream", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, false,                \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_vec(d, s, n, k, 1, true); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); }, \
+        nullptr },                                                                                      \
+    { "rotate_right", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, true,                  \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_right_vec(d, n, k); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_right_x86(d, n, k); }, \
+        nullptr },                                                                                      \
+    { "shift_left", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, true,                    \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_left_vec(d, n, shift_amount(n, k)); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_left_x86(d, n, shift_amount(n, k)); }, \
+        nullptr },                                                                                      \
+    { "shift_right", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, true,                   \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_right_vec(d, n, shift_amount(n, k)); }, \
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { shift_right_x86(d, n, shift_amount(n, k)); }, \
+        nullptr },                                                                                      \
+    { "rotate_xor", RSHIFT_VEC_NAME, RSHIFT_VEC_LEVEL, BENCH_BITS, BENCH_BITS, false,                   \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_xor_vec(d, s, n, k); }, \
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_xor_x86(d, s, n, k); }, \
+        nullptr },
+
+//
+// Baseline of the correlation: one rotation by 1 and one XOR popcount per
+// shift. The benchmarked correlation is the autocorrelation of src.
+//
+static void correlate_naive(uint8_t* d, const uint8_t* s, const int32_t n, const int32_t)
+{
+    const int32_t nBytes = (n + 7) / 8;
+    std::vector<uint8_t> b(s, s + nBytes);
+    int32_t* out = (int32_t*)d;
+    for(int32_t k = 0; k < n; k += 1)
     {
-             if( (i%128 == 0) && (i!=0) ) printf("\n");
-        //else if( (i%8   == 0) && (i!=0) ) printf(" ");
-        printf("%d", bits[i]);
+        int32_t sum = 0;
+        for(int32_t i = 0; i < nBytes; i += 1)
+            sum += __builtin_popcount( s[i] ^ b[i] );
+        out[k] = sum;
+        permutation(b.data(), n);
     }
-    printf("\n");
 }
 
-void dump_bits(const uint8_t* bits, const int32_t ll)
+//
+// Baseline: the shift-or rotation of a std::bitset, only defined for the
+// sizes instantiated below. The bitset is built in place over the buffer
+// (libstdc++/libc++ store it as an array of words in bit order).
+//
+template<int32_t N>
+static void rotate_bitset(uint8_t* d, const int32_t k)
 {
-    for(int32_t i = 0; i < ll; i += 8)
+    std::bitset<N>& b = *reinterpret_cast<std::bitset<N>*>( d );
+    b = (b << k) | (b >> (N - k));
+}
+
+static void rotate_std(uint8_t* d, const uint8_t*, const int32_t n, const int32_t k)
+{
+    switch( n )
     {
-//        if( (i%128 == 0) && (i!=0) ) printf("\n");
-        const uint32_t v = bits[i/8];
-        for(int32_t q = 0; q < 8; q += 1)
-            printf("%d", ((v >> q) & 0x01));
+        case   32 : rotate_bitset<  32>(d, k); break;
+        case   64 : rotate_bitset<  64>(d, k); break;
+        case  128 : rotate_bitset< 128>(d, k); break;
+        case  256 : rotate_bitset< 256>(d, k); break;
+        case  512 : rotate_bitset< 512>(d, k); break;
+        case 1024 : rotate_bitset<1024>(d, k); break;
+        case 2048 : rotate_bitset<2048>(d, k); break;
+        case 4096 : rotate_bitset<4096>(d, k); break;
+        case 8192 : rotate_bitset<8192>(d, k); break;
     }
-    printf("\n");
 }
 
+static bool accepts_std(const int32_t n)
+{
+    return (n >= 32) && (n <= 8192) && ((n & (n - 1)) == 0);
+}
 
-void p128_hex_u64(__m128i in) {
-    alignas(16) unsigned long long v[2];  // uint64_t might give format-string warnings with %llx; it's just long in some ABIs
-    _mm_store_si128((__m128i*)v, in);
-    printf("v2_u64: %llx %llx\n", v[0], v[1]);
+//
+// Compile-time front end (rshift_static.hpp) of each ISA, instantiated for
+// a few sizes, powers of 2 or not, and checked like the runtime kernels.
+//
+template<rshift_isa ISA>
+static void permutation_static(uint8_t* d, const int32_t n)
+{
+    switch( n )
+    {
+        case  256 : permutation< 256, ISA>(d); break;
+        case  384 : permutation< 384, ISA>(d); break;
+        case 1088 : permutation<1088, ISA>(d); break;
+        case 2112 : permutation<2112, ISA>(d); break;
+    }
 }
 
+template<rshift_isa ISA>
+static void rotate_static(uint8_t* d, const int32_t n, const int32_t k)
+{
+    switch( n )
+    {
+        case  256 : rotate< 256, ISA>(d, k); break;
+        case  384 : rotate< 384, ISA>(d, k); break;
+        case 1088 : rotate<1088, ISA>(d, k); break;
+        case 2112 : rotate<2112, ISA>(d, k); break;
+    }
+}
 
+static bool accepts_static(const int32_t n)
+{
+    return (n == 256) || (n == 384) || (n == 1088) || (n == 2112);
+}
+
+//
+// Fixed permutations of the frame: 8-row interleaver, bit reversal and the
+// puncturing of every fourth bit. The plan of each size is built on first
+// use and checked against a bit by bit gather with the same map.
+//
+enum bench_permutation { PERM_INTERLEAVE, PERM_BIT_REVERSAL, PERM_PUNCTURE };
 
-bool check_result(const uint8_t* i_bits, const uint8_t* t_bits, const int32_t size_bits)
+static const std::vector<int32_t>& permutation_map(const bench_permutation p, const int32_t n)
 {
-    const int32_t size_bytes = size_bits / 8;
-    for(int32_t x = 0; x < size_bytes; x += 1)
+    static std::map<std::pair<int32_t, int32_t>, std::vector<int32_t>> maps;
+    std::vector<int32_t>& map = maps[{ p, n }];
+    if( map.empty() )
     {
-        if( i_bits[x] != t_bits[x] )
-            return false;
+        if( p == PERM_INTERLEAVE )
+            map = rshift_interleaver_map(8, n / 8);
+        else if( p == PERM_BIT_REVERSAL )
+            map = rshift_bit_reversal_map(__builtin_ctz(n));
+        else
+        {
+            std::vector<uint8_t> keep( n );
+            for(int32_t i = 0; i < n; i += 1)
+                keep[i] = (i % 4) != 3;
+            map = rshift_puncture_map(keep.data(), n);
+        }
     }
-    return true;
+    return map;
 }
 
+static void permute(const bench_permutation p, uint8_t* d, const uint8_t* s, const int32_t n)
+{
+    static std::map<std::pair<int32_t, int32_t>, std::unique_ptr<rshift_permutation_plan>> plans;
+    std::unique_ptr<rshift_permutation_plan>& plan = plans[{ p, n }];
+    if( plan == nullptr )
+        plan.reset( new rshift_permutation_plan(permutation_map(p, n), n) );
+    plan->execute(d, s);
+}
 
+static void permute_naive(const bench_permutation p, uint8_t* d, const uint8_t* s, const int32_t n)
+{
+    const std::vector<int32_t>& map = permutation_map(p, n);
+    memset(d, 0, (map.size() + 7) / 8);
+    for(size_t i = 0; i < map.size(); i += 1)
+        d[i / 8] |= ((s[map[i] / 8] >> (map[i] % 8)) & 1) << (i % 8);
+}
 
-int main(int argc, char* argv[])
+static bool accepts_interleave(const int32_t n)
 {
+    return (n >= 8) && (n % 8 == 0);
+}
 
-#if defined (__APPLE__)
-    printf("(II) Benchmarking the bit_pack/bit_unpack functions on MacOS\n");
-#elif defined (__linux__)
-    printf("(II) Benchmarking the bit_pack/bit_unpack functions on Linux\n");
-#else
-    printf("(II) Benchmarking the bit_pack/bit_unpack functions on a undefined platform\n");
+static bool accepts_bit_reversal(const int32_t n)
+{
+    return (n >= 2) && ((n & (n - 1)) == 0);
+}
+
+static const bench_kernel kernels[] =
+{
+    BENCH_KERNELS(x86, RSHIFT_X86)
+#ifdef RSHIFT_HAS_SSE4
+    BENCH_KERNELS(sse4, RSHIFT_SSE4)
 #endif
+#ifdef RSHIFT_HAS_AVX2
+    BENCH_KERNELS(avx2, RSHIFT_AVX2)
+#endif
+#ifdef RSHIFT_HAS_AVX512
+    BENCH_KERNELS(avx512, RSHIFT_AVX512)
+#endif
+    BENCH_VEC_KERNELS
+    { "permutation", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation(d, n); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86(d, n); },
+        nullptr },
+    { "rotate", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate(d, n, k); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },
+        nullptr },
+    { "rotate_copy", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate(d, s, n, k); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); },
+        nullptr },
+    { "rotate_stream", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate(d, s, n, k, 1, true); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); },
+        nullptr },
+    { "permutation", "tuned", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_tuned(d, n); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86(d, n); },
+        nullptr },
+    { "rotate", "tuned", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_tuned(d, n, k); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },
+        nullptr },
+    { "rotate_copy", "tuned", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_tuned(d, s, n, k); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); },
+        nullptr },
+    { "permutation_large", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_large(d, n); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t)   { permutation_x86(d, n); },
+        nullptr },
+    { "rotate_large", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_large(d, n, k); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },
+        nullptr },
+    { "rotate_large_copy", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_large(d, s, n, k); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_x86(d, s, n, k); },
+        nullptr },
+    { "rotate_view", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rshift_view v(d, n); v.rotate(k); v.permutation(); v.rotate_right(k / 2); v.data(); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); permutation_x86(d, n); rotate_right_x86(d, n, k / 2); },
+        nullptr },
+    { "rotate_padded", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_padded(d, n, k); },
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },
+        nullptr },
+    { "rotate_xor", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_xor(d, s, n, k); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t k) { rotate_xor_x86(d, s, n, k); },
+        nullptr },
+    { "correlate", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_INT32, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { correlate((int32_t*)d, s, s, n); },
+        correlate_naive,
+        nullptr },
+    { "correlate", "naive", RSHIFT_X86, BENCH_BITS, BENCH_INT32, false,
+        correlate_naive,
+        correlate_naive,
+        nullptr },
+    { "interleave", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute(PERM_INTERLEAVE, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_INTERLEAVE, d, s, n); },
+        accepts_interleave },
+    { "interleave", "naive", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_INTERLEAVE, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_INTERLEAVE, d, s, n); },
+        accepts_interleave },
+    { "bit_reversal", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute(PERM_BIT_REVERSAL, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_BIT_REVERSAL, d, s, n); },
+        accepts_bit_reversal },
+    { "bit_reversal", "naive", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_BIT_REVERSAL, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_BIT_REVERSAL, d, s, n); },
+        accepts_bit_reversal },
+    { "puncture", "dispatch", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute(PERM_PUNCTURE, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_PUNCTURE, d, s, n); },
+        nullptr },
+    { "puncture", "naive", RSHIFT_X86, BENCH_BITS, BENCH_BITS, false,
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_PUNCTURE, d, s, n); },
+        [](uint8_t* d, const uint8_t* s, const int32_t n, const int32_t) { permute_naive(PERM_PUNCTURE, d, s, n); },
+        nullptr },
+    { "rotate", "std", RSHIFT_X86, BENCH_BITS, BENCH_BITS, true,
+        rotate_std,
+        [](uint8_t* d, const uint8_t*, const int32_t n, const int32_t k) { rotate_x86(d, n, k); },
+        accepts_std },
+};
 
+static bool selected(const std::vector<std::string>& filter, const char* name)
+{
+    return filter.empty() || (std::find(filter.begin(), filter.end(), name) != filter.end());
+}
 
-#if defined (__clang__)
-    printf("(II) Code compiled with LLVM (%d.%d.%d)\n", __clang_major__, __clang_minor__, __clang_patchlevel__);
-#elif defined (__GNUC__)
-    printf("(II) Code compiled with GCC (%d.%d.%d)\n", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
-#else
-    printf("(II) Code compiled with UNKWON compiler\n");
-#endif
+int main(int argc, char* argv[])
+{
+    bench_options opt;
+    if( parse_options(argc, argv, opt) == false )
+    {
+        print_usage( argv[0] );
+        return EXIT_FAILURE;
+    }
 
-    const int32_t v_begin =   32;
-    const int32_t v_end   = 2048;
-    const int32_t v_step  =   2;
+    const int32_t cpu_level = rshift_cpu_level();
 
-    printf("|  LENGTH  |    x86   |   SSE4   |   AVX2   |\n");
+    if( opt.list == true )
+    {
+        for(const bench_kernel& kernel : kernels)
+            printf("%-20s %-8s %s\n", kernel.name, kernel.isa, (cpu_level >= kernel.level) ? "" : "(not supported by this CPU)");
+        return EXIT_SUCCESS;
+    }
 
-    for( int32_t size_bits = v_begin; size_bits <= v_end; size_bits *= v_step )
+    if( opt.sizes.empty() && opt.qc )
     {
-        const int32_t bench_loop = 16*67108864 / size_bits;
+        opt.sizes = { 52, 104, 208, 384 };
+    }
+    else if( opt.sizes.empty() && opt.sliced )
+    {
+        opt.sizes = { 128, 384, 2048 };
+    }
+    else if( opt.sizes.empty() && (opt.throughput || opt.batch) )
+    {
+        opt.sizes.push_back( 2048 );
+    }
+    else if( opt.sizes.empty() )
+    {
+        for(int32_t n = 32; n <= 2048; n *= 2)
+            opt.sizes.push_back( n );
+    }
 
-        const int32_t size_bytes = size_bits / 8;
-        printf("| %8d |", size_bits);
+    // batch mode: a working set in L2 and one in DRAM
+    if( opt.working_sets.empty() && opt.batch )
+    {
+        opt.working_sets = { 1LL << 20, 1LL << 28 };
+    }
+    // throughput mode: from L1 resident frames to DRAM
+    else if( opt.working_sets.empty() )
+    {
+        for(int64_t ws = 4096; ws <= (1LL << 30); ws *= 2)
+            opt.working_sets.push_back( ws );
+    }
+    if( (opt.throughput == false) && (opt.batch == false) )
+        opt.working_sets = { 0 };
 
-        uint8_t i_bits   [size_bits ];
-        uint8_t x86_bits [size_bytes];   // reference bit array from x86 code
-        uint8_t sse4_bits[size_bytes];   // optimized bit array from x86 code
-        uint8_t avx2_bits[size_bytes];   // optimized bit array from x86 code
+    // sliced mode: from a single frame to batches far past the break-even
+    if( opt.frames.empty() )
+    {
+        for(int32_t f = 1; f <= 16384; f *= 4)
+            opt.frames.push_back( f );
+    }
 
-        for(int i = 0; i < size_bits; i+= 1)
+    if( opt.threads.empty() )
+    {
+        const int32_t hw = rshift_threads();
+        for(int32_t t = 1; t < hw; t *= 2)
+            opt.threads.push_back( t );
+        opt.threads.push_back( hw );
+    }
+
+    // a negative shift means a random shift per call
+    std::vector<int32_t> shifts = opt.shifts;
+    if( shifts.empty() )
+        shifts.push_back( -1 );
+
+    for(const std::string& pattern : opt.patterns)
+    {
+        std::mt19937_64 rng( 0 );
+        uint8_t probe[8] = { 0 };
+        if( fill_pattern(probe, BENCH_BITS, 1, pattern, rng) == false )
         {
-            i_bits[i] = (i == 0); //rand()%2;
+            printf("(EE) Unknown pattern %s\n", pattern.c_str());
+            return EXIT_FAILURE;
         }
+    }
+
+    const bench_context ctx = make_context(opt);
+    print_header(opt.format, ctx);
 
-        //
-        // On compresse les bytes en bits
-        //
+    bool first  = true;
+    bool failed = false;
 
-        bit_pack_x86(x86_bits,  i_bits, size_bits);
-        bit_pack_x86(sse4_bits, i_bits, size_bits);
-        bit_pack_x86(avx2_bits, i_bits, size_bits);
+    static const char* batch_kernels[] = { "permutation_batch", "rotate_batch" };
+    for(const char* name : batch_kernels)
+    {
+        if( (opt.batch == false) || (selected(opt.kernels, name) == false) )
+            continue;
+        for(const int32_t n : opt.sizes)
+            for(const int32_t k : shifts)
+                for(const std::string& pattern : opt.patterns)
+                    for(const int64_t ws : opt.working_sets)
+                        for(const int32_t t : opt.threads)
+                        {
+                            const bench_result r = measure_batch(name, n, (k < 0) ? -1 : (k % n), ws, t, pattern, opt);
+                            print_result(opt.format, ctx, r, first);
+                            fflush( stdout );
+                            failed = failed || (r.check == 0);
+                            first  = false;
+                        }
+    }
 
-#if 0
-        for(int32_t i = 0; i < size_bits; i+= 1)
+    static const char* qc_kernels[] = { "qc_bg1", "qc_bg2" };
+    static const char* qc_isas[]    = { "x86", "sse4", "avx2", "avx512" };
+    for(const char* name : qc_kernels)
+    {
+        if( (opt.qc == false) || (selected(opt.kernels, name) == false) )
+            continue;
+        for(int32_t level = RSHIFT_X86; level <= cpu_level; level += 1)
         {
-            printf("%3d : ", i); dump_bits(avx2_bits, size_bits);
-            permutation_avx2(avx2_bits, size_bits);
+            if( selected(opt.isas, qc_isas[level]) == false )
+                continue;
+            for(const int32_t Z : opt.sizes)
+                for(const std::string& pattern : opt.patterns)
+                {
+                    const bench_result r = measure_qc(name, qc_isas[level], level, Z, pattern, opt);
+                    print_result(opt.format, ctx, r, first);
+                    fflush( stdout );
+                    failed = failed || (r.check == 0);
+                    first  = false;
+                }
         }
-        dump_bits(avx2_bits, size_bits);
-//        exit( EXIT_FAILURE );
-#endif
+    }
 
-            auto start = std::chrono::steady_clock::now();
-            for(int32_t z = 0; z < bench_loop; z += 1)
-                for(int32_t i = 0; i < size_bits; i+= 1)
-                    permutation_x86 (x86_bits, size_bits);
-            auto end = std::chrono::steady_clock::now();
-            const int32_t time_x86 = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / bench_loop;
-            printf("  %6d  |", time_x86);
-
-            //
-            ////////////////////////////////////////////////////
-            //
-#ifdef __SSE4_2__
-            auto start_sse4 = std::chrono::steady_clock::now();
-            for(int32_t z = 0; z < bench_loop; z += 1)
-                for(int32_t i = 0; i < size_bits; i+= 1)
-                    permutation_sse4(sse4_bits, size_bits);
-            auto end_sse4 = std::chrono::steady_clock::now();
-            const int32_t time_sse4 = std::chrono::duration_cast<std::chrono::nanoseconds>(end_sse4 - start_sse4).count() / bench_loop;
-            if( check_result(x86_bits, sse4_bits, size_bits) == false )
-                printf("  \x1B[31m%6d\x1B[0m  |", time_sse4);
-            else
-                printf("  \x1B[32m%6d\x1B[0m  |", time_sse4);
-#endif
-            //
-            ////////////////////////////////////////////////////
-            //
-#ifdef __AVX2__
-            auto start_avx2 = std::chrono::steady_clock::now();
-            for(int32_t z = 0; z < bench_loop; z += 1)
-                for(int32_t i = 0; i < size_bits; i+= 1)
-                    permutation_avx2(avx2_bits, size_bits);
-            auto end_avx2 = std::chrono::steady_clock::now();
-            const int32_t time_avx2 = std::chrono::duration_cast<std::chrono::nanoseconds>(end_avx2 - start_avx2).count() / bench_loop;
-            if( check_result(x86_bits, avx2_bits, size_bits) == false )
-                printf("  \x1B[31m%6d\x1B[0m  |", time_avx2);
-            else
-                printf("  \x1B[32m%6d\x1B[0m  |", time_avx2);
-#endif
-            //
-            ////////////////////////////////////////////////////
-            //
-            printf("\n");
+    static const char* sliced_kernels[] = { "permutation", "sliced" };
+    for(const char* name : sliced_kernels)
+    {
+        if( (opt.sliced == false) || (selected(opt.kernels, name) == false) )
+            continue;
+        if( (strcmp(name, "permutation") == 0) && (cpu_level < RSHIFT_AVX2) )
+            continue;
+        for(const int32_t n : opt.sizes)
+            for(const std::string& pattern : opt.patterns)
+                for(const int32_t nFrames : opt.frames)
+                {
+                    const bench_result r = measure_sliced(name, n, nFrames, pattern, opt);
+                    print_result(opt.format, ctx, r, first);
+                    fflush( stdout );
+                    failed = failed || (r.check == 0);
+                    first  = false;
+                }
     }
 
+    for(const bench_kernel& kernel : kernels)
+    {
+        if( (opt.batch == true) || (opt.qc == true) || (opt.sliced == true) )
+            break;
+        if( (selected(opt.kernels, kernel.name) == false) || (selected(opt.isas, kernel.isa) == false) )
+            continue;
+        if( cpu_level < kernel.level )
+            continue;
+
+        for(const int32_t n : opt.sizes)
+        {
+            if( (kernel.accepts != nullptr) && (kernel.accepts(n) == false) )
+                continue;
+            for(const int32_t k : shifts)
+            {
+                for(const std::string& pattern : opt.patterns)
+                {
+                    for(const int64_t ws : opt.working_sets)
+                    {
+                        const int32_t      s = (k < 0) ? -1 : (k % n);
+                        const bench_result r = opt.throughput ? measure_throughput(kernel, n, s, ws, pattern, opt)
+                                                              : measure           (kernel, n, s,     pattern, opt);
+                        print_result(opt.format, ctx, r, first);
+                        fflush( stdout );
+                        failed = failed || (r.check == 0);
+                        first  = false;
+                    }
+                }
+            }
+        }
+    }
 
+    print_footer(opt.format);
 
+    if( failed == true )
+    {
+        fprintf(stderr, "(EE) Some kernels returned a result different from their reference\n");
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
-    
@@ -0,0 +1,193 @@
+/*
+ *	Runtime dispatch of the bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+#include "rshift_vec.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+typedef void (*permutation_t)(void*, const int32_t, const int32_t);
+typedef void (*rotate_t     )(void*, const int32_t, const int32_t, const int32_t);
+
+typedef void (*permutation_copy_t)(void*, const void*, const int32_t, const int32_t, const bool);
+typedef void (*rotate_copy_t     )(void*, const void*, const int32_t, const int32_t, const int32_t, const bool);
+
+#ifdef RSHIFT_VEC_BASELINE
+static const char* isa_names[] = { RSHIFT_VEC_NAME, "sse4", "avx2", "avx512" };
+#else
+static const char* isa_names[] = { "x86", "sse4", "avx2", "avx512" };
+#endif
+
+static void resolve_permutation(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames);
+static void resolve_rotate     (void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames);
+static void resolve_permutation_copy(void* ptr_dst, const void* ptr_src, const int32_t nBits, const int32_t nFrames, const bool stream);
+static void resolve_rotate_copy     (void* ptr_dst, const void* ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames, const bool stream);
+
+//
+// The pointers start on the resolvers (constant initialization), so a call
+// made before the load-time binding below still lands on a valid kernel.
+//
+static std::atomic<permutation_t> ptr_permutation( resolve_permutation );
+static std::atomic<rotate_t>      ptr_rotate     ( resolve_rotate      );
+static std::atomic<int32_t>       bound_level    ( -1                  );
+
+static std::atomic<permutation_copy_t> ptr_permutation_copy( resolve_permutation_copy );
+static std::atomic<rotate_copy_t>      ptr_rotate_copy     ( resolve_rotate_copy      );
+
+int32_t rshift_cpu_level()
+{
+#ifdef RSHIFT_X86_DISPATCH
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") ) return RSHIFT_AVX512;
+    if( __builtin_cpu_supports("avx2")    ) return RSHIFT_AVX2;
+    if( __builtin_cpu_supports("sse4.2")  ) return RSHIFT_SSE4;
+    return RSHIFT_X86;
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+    return RSHIFT_AVX512;
+#elif defined(__AVX2__)
+    return RSHIFT_AVX2;
+#elif defined(__SSE4_2__)
+    return RSHIFT_SSE4;
+#else
+    return RSHIFT_X86;
+#endif
+}
+
+static int32_t bind_kernels()
+{
+    int32_t level = rshift_cpu_level();
+
+    const char* forced = getenv("RSHIFT_ISA");
+    if( forced != nullptr )
+    {
+        for(int32_t i = RSHIFT_X86; i <= RSHIFT_AVX512; i += 1)
+            if( (strcmp(forced, isa_names[i]) == 0) && (i < level) )
+                level = i;
+    }
+
+#ifdef RSHIFT_NEON_EMULATION
+    level = RSHIFT_X86;     // the emulated NEON kernels are the whole point of this build
+#endif
+
+#ifdef RSHIFT_VEC_BASELINE
+    permutation_t      p  = permutation_vec;
+    rotate_t           r  = rotate_vec;
+    permutation_copy_t pc = permutation_vec;
+    rotate_copy_t      rc = rotate_vec;
+#else
+    permutation_t      p  = permutation_x86;
+    rotate_t           r  = rotate_x86;
+    permutation_copy_t pc = permutation_x86;
+    rotate_copy_t      rc = rotate_x86;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) { p = permutation_sse4;   r = rotate_sse4;   pc = permutation_sse4;   rc = rotate_sse4;   }
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) { p = permutation_avx2;   r = rotate_avx2;   pc = permutation_avx2;   rc = rotate_avx2;   }
+#endif
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) { p = permutation_avx512; r = rotate_avx512; pc = permutation_avx512; rc = rotate_avx512; }
+#endif
+#ifdef RSHIFT_HAS_AVX512_VBMI2
+    if( (level >= RSHIFT_AVX512) && rshift_has_avx512_vbmi2() )
+    {
+        p  = permutation_avx512_vbmi2;
+        r  = rotate_avx512_vbmi2;
+        pc = permutation_avx512_vbmi2;
+        rc = rotate_avx512_vbmi2;
+    }
+#endif
+
+    ptr_permutation     .store(p,  std::memory_order_relaxed);
+    ptr_rotate          .store(r,  std::memory_order_relaxed);
+    ptr_permutation_copy.store(pc, std::memory_order_relaxed);
+    ptr_rotate_copy     .store(rc, std::memory_order_relaxed);
+    bound_level    .store(level, std::memory_order_relaxed);
+    return level;
+}
+
+[[maybe_unused]] static const int32_t load_time_level = bind_kernels();
+
+static void resolve_permutation(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames)
+{
+    bind_kernels();
+    ptr_permutation.load(std::memory_order_relaxed)(ptr_bit_array, nBits, nFrames);
+}
+
+static void resolve_rotate(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames)
+{
+    bind_kernels();
+    ptr_rotate.load(std::memory_order_relaxed)(ptr_bit_array, nBits, k, nFrames);
+}
+
+static void resolve_permutation_copy(void* ptr_dst, const void* ptr_src, const int32_t nBits, const int32_t nFrames, const bool stream)
+{
+    bind_kernels();
+    ptr_permutation_copy.load(std::memory_order_relaxed)(ptr_dst, ptr_src, nBits, nFrames, stream);
+}
+
+static void resolve_rotate_copy(void* ptr_dst, const void* ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames, const bool stream)
+{
+    bind_kernels();
+    ptr_rotate_copy.load(std::memory_order_relaxed)(ptr_dst, ptr_src, nBits, k, nFrames, stream);
+}
+
+void permutation(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames)
+{
+    ptr_permutation.load(std::memory_order_relaxed)(ptr_bit_array, nBits, nFrames);
+}
+
+void rotate(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames)
+{
+    ptr_rotate.load(std::memory_order_relaxed)(ptr_bit_array, nBits, k, nFrames);
+}
+
+void permutation(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames, const bool stream)
+{
+    ptr_permutation_copy.load(std::memory_order_relaxed)(ptr_dst, ptr_src, nBits, nFrames, stream);
+}
+
+void rotate(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames, const bool stream)
+{
+    ptr_rotate_copy.load(std::memory_order_relaxed)(ptr_dst, ptr_src, nBits, k, nFrames, stream);
+}
+
+int32_t rshift_isa_level()
+{
+    const int32_t level = bound_level.load(std::memory_order_relaxed);
+    return (level < 0) ? bind_kernels() : level;
+}
+
+const char* rshift_isa_name()
+{
+    return isa_names[ rshift_isa_level() ];
+}
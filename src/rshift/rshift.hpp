@@ -0,0 +1,66 @@
+/*
+ *	Runtime dispatch of the bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_
+#define _rshift_
+
+#include <cstdint>
+
+//
+// ISA levels of the rotation kernels, ordered by preference. Outside x86
+// (and in the RSHIFT_NEON_EMULATION build) the lowest level is the portable
+// rshift_vec backend, reported as "neon" or "vec".
+//
+enum rshift_isa
+{
+    RSHIFT_X86    = 0,
+    RSHIFT_SSE4   = 1,
+    RSHIFT_AVX2   = 2,
+    RSHIFT_AVX512 = 3
+};
+
+//
+// Entry points bound at load time (or at first call) to the best kernel the
+// CPU supports: permutation_avx512, permutation_avx2, permutation_sse4 and
+// finally permutation_x86 on CPUs without SSE4.2. Setting the RSHIFT_ISA
+// environment variable to x86, sse4, avx2 or avx512 caps the selection.
+//
+extern void permutation(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1);
+extern void rotate     (void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1);
+
+//
+// Out-of-place entry points: the rotated frames of src are written to dst
+// (the buffers must not overlap), with non-temporal stores when stream is
+// set and the output is large enough to bypass the caches (see rotate_copy).
+// Bound together with the in-place ones.
+//
+extern void permutation(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false);
+extern void rotate     (void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false);
+
+extern int32_t     rshift_cpu_level();  // best ISA level supported by the CPU
+extern int32_t     rshift_isa_level();  // ISA level of the bound kernels
+extern const char* rshift_isa_name ();  // name of the bound kernels
+
+#endif
@@ -25,172 +25,903 @@
 
 #ifndef _rshift_avx2_
 #define _rshift_avx2_
-#ifdef __AVX2__
+
+#include "rshift_common.hpp"
+#include "rshift_sse4.hpp"
+#ifdef RSHIFT_HAS_AVX2
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstdint>
 #include <immintrin.h>
 
-void permutation_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+//
+// The last 1 to 3 words are processed with masked loads/stores so that no
+// scalar tail loop is needed.
+//
+RSHIFT_TARGET_AVX2 inline void funnel_avx2(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    int32_t x = 0;
+    for(; x + 4 <= nWords; x += 4)
+    {
+        const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + x    ) );
+        const __m256i B = _mm256_loadu_si256( (const __m256i*)(src + x + 1) );
+        const __m256i D = _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) );
+        _mm256_storeu_si256( (__m256i*)(dst + x), D );
+    }
+    if( x < nWords )
+    {
+        const __m256i M = _mm256_cmpgt_epi64( _mm256_set1_epi64x(nWords - x), _mm256_setr_epi64x(0, 1, 2, 3) );
+        const __m256i A = _mm256_maskload_epi64( (const long long*)(src + x    ), M );
+        const __m256i B = _mm256_maskload_epi64( (const long long*)(src + x + 1), M );
+        const __m256i D = _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) );
+        _mm256_maskstore_epi64( (long long*)(dst + x), M, D );
+    }
+}
+
+//
+// Non-temporal variant of funnel_avx2: regular stores up to the first
+// 32-byte boundary of dst and for the last 1 to 3 words, vmovntdq for the
+// others. The caller issues the sfence.
+//
+RSHIFT_TARGET_AVX2 inline void funnel_avx2_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    if( ((uintptr_t)dst % 8 != 0) || (nWords < 8) )
+    {
+        funnel_avx2(dst, src, nWords, b);
+        return;
+    }
+    const int32_t head = ((32 - (uintptr_t)dst % 32) % 32) / 8;
+    funnel_avx2(dst, src, head, b);
+
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    int32_t x = head;
+    for(; x + 4 <= nWords; x += 4)
+    {
+        const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + x    ) );
+        const __m256i B = _mm256_loadu_si256( (const __m256i*)(src + x + 1) );
+        _mm256_stream_si256( (__m256i*)(dst + x), _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) ) );
+    }
+    funnel_avx2(dst + x, src + x, nWords - x, b);
+}
+
+//
+// Funnel copy to a 32-byte aligned dst that may be written up to the next
+// multiple of 4 words (padded arrays): aligned stores and no masked tail.
+//
+RSHIFT_TARGET_AVX2 inline void funnel_avx2_padded(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    for(int32_t x = 0; x < nWords; x += 4)
+    {
+        const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + x    ) );
+        const __m256i B = _mm256_loadu_si256( (const __m256i*)(src + x + 1) );
+        _mm256_store_si256( (__m256i*)(dst + x), _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) ) );
+    }
+}
+
+//
+// Compile-time sized kernels, NBits being a multiple of 256 (other sizes are
+// forwarded to the SSE4 templates). The carry word of register x is moved
+// to lane 0 by vpermpd and blended with the one coming from register x - 1.
+//
+template<int32_t NBits>
+RSHIFT_TARGET_AVX2 inline void permutation_avx2(void* ptr_bit_array)
+{
+    if constexpr ( NBits % 256 != 0 )
+    {
+        permutation_sse4<NBits>(ptr_bit_array);
+    }
+    else
+    {
+        constexpr int32_t regs = NBits / 256;
+        __m256i A[regs], B[regs];
+        __m256d D[regs];
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            A[x] = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + x );
+            B[x] = _mm256_slli_epi64 (A[x],  1);
+            D[x] = _mm256_permute4x64_pd( _mm256_castsi256_pd(_mm256_srli_epi64(A[x], 63)), 0x93 );
+        }
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            const __m256i E = _mm256_castpd_si256( _mm256_blend_pd(D[x], D[(x + regs - 1) % regs], 0x01) );
+            _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + x, _mm256_or_si256(B[x], E) );
+        }
+    }
+}
+
+template<int32_t NBits>
+RSHIFT_TARGET_AVX2 inline void rotate_avx2(void* ptr_bit_array, const int32_t k)
+{
+    if constexpr ( NBits % 256 != 0 )
+    {
+        rotate_sse4<NBits>(ptr_bit_array, k);
+    }
+    else
+    {
+        const int32_t shift = ((k % NBits) + NBits) % NBits;
+        if( shift == 0 )
+            return;
+
+        constexpr int32_t words = NBits / 64;
+        uint64_t tmp[2 * words + 4];
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < words; x += 4)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(((uint64_t*)ptr_bit_array) + x) );
+            _mm256_storeu_si256( (__m256i*)(tmp + x),         A );
+            _mm256_storeu_si256( (__m256i*)(tmp + x + words), A );
+        }
+        _mm256_storeu_si256( (__m256i*)(tmp + 2 * words), _mm256_setzero_si256() );
+
+        const uint64_t* src = tmp + (NBits - shift) / 64;
+        const __m128i   cr  = _mm_cvtsi32_si128( (NBits - shift) % 64      );
+        const __m128i   cl  = _mm_cvtsi32_si128( 64 - (NBits - shift) % 64 );
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < words; x += 4)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + x    ) );
+            const __m256i B = _mm256_loadu_si256( (const __m256i*)(src + x + 1) );
+            const __m256i D = _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) );
+            _mm256_storeu_si256( (__m256i*)(((uint64_t*)ptr_bit_array) + x), D );
+        }
+    }
+}
+
+RSHIFT_SIZED_TABLES(avx2)
+
+//
+// Frames of nBits % 64 != 0 bits up to RSHIFT_SIZED_BITS (rshift_odd_t), in
+// place or not. Output word x is word x of (frame << shift) | (frame >>
+// (nBits - shift)). Below 256 bits the frame is one register and the word
+// moves are vpermd with a zeroing mask, above it is copied to the stack
+// between zero words and both terms are unaligned loads. The full words are
+// read and written by 32, 16 and 8 bytes and the partial last word through
+// load_tail/store_tail: a rotation reading the frame just rotated in place
+// gets every load forwarded from a store of the same bytes.
+//
+// odd_words_avx2 loads the words src[0 .. n - 1] of a register (all four
+// when n >= 4) and puts tail in lane n, odd_store_avx2 stores the first n
+// (up to four) words of D, odd_move_avx2 returns A moved up by q words
+// (down when q < 0), zero-filled.
+//
+RSHIFT_TARGET_AVX2 inline __m256i odd_words_avx2(const uint8_t* src, const int32_t n, const uint64_t tail)
+{
+    if( n >= 4 )
+    {
+        return _mm256_loadu_si256( (const __m256i*)src );
+    }
+    const __m128i T  = _mm_cvtsi64_si128( (long long)tail );
+    __m128i       lo = T;
+    __m128i       hi = _mm_setzero_si128();
+    if( n >= 2 )
+    {
+        lo = _mm_loadu_si128( (const __m128i*)src );
+        hi = (n == 3) ? _mm_unpacklo_epi64( _mm_loadl_epi64((const __m128i*)(src + 16)), T ) : T;
+    }
+    else if( n == 1 )
+    {
+        lo = _mm_unpacklo_epi64( _mm_loadl_epi64((const __m128i*)src), T );
+    }
+    return _mm256_inserti128_si256( _mm256_castsi128_si256(lo), hi, 1 );
+}
+
+RSHIFT_TARGET_AVX2 inline void odd_store_avx2(uint8_t* dst, const int32_t n, const __m256i D)
+{
+    if( n >= 4 )
+    {
+        _mm256_storeu_si256( (__m256i*)dst, D );
+    }
+    else if( n >= 2 )
+    {
+        _mm_storeu_si128( (__m128i*)dst, _mm256_castsi256_si128(D) );
+        if( n == 3 )
+            _mm_storel_epi64( (__m128i*)(dst + 16), _mm256_extracti128_si256(D, 1) );
+    }
+    else if( n == 1 )
+    {
+        _mm_storel_epi64( (__m128i*)dst, _mm256_castsi256_si128(D) );
+    }
+}
+
+RSHIFT_TARGET_AVX2 inline __m256i odd_move_avx2(const __m256i A, const int32_t q)
+{
+    const __m256i idx  = _mm256_sub_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(2 * q) );
+    const __m256i keep = _mm256_cmpgt_epi32( _mm256_set1_epi32(8), idx );
+    return _mm256_and_si256( _mm256_permutevar8x32_epi32(A, idx), _mm256_andnot_si256(_mm256_srai_epi32(idx, 31), keep) );
+}
+
+RSHIFT_TARGET_AVX2 inline void rotate_odd_avx2(uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t shift)
+{
+    const int32_t  full = nBits / 64;
+    const uint64_t tail = load_tail(src, nBits);
+    if( full == 0 )
+    {
+        store_tail(dst, nBits, (tail << shift) | (tail >> (nBits - shift)));
+        return;
+    }
+
+    const int32_t regs = full / 4 + 1;
+    const int32_t q1   = shift / 64;
+    const int32_t q2   = (nBits - shift) / 64;
+    const __m128i c1   = _mm_cvtsi32_si128( shift % 64      );
+    const __m128i c1n  = _mm_cvtsi32_si128( 64 - shift % 64 );
+    const __m128i c2   = _mm_cvtsi32_si128( (nBits - shift) % 64      );
+    const __m128i c2n  = _mm_cvtsi32_si128( 64 - (nBits - shift) % 64 );
+
+    // output word full, the partial one, ends up in lane full % 4 of last
+    alignas(32) uint64_t last[4];
+    if( full < 4 )
+    {
+        const __m256i X = odd_words_avx2(src, full, tail);
+        const __m256i P = odd_move_avx2(X,  q1);
+        const __m256i U = odd_move_avx2(X, -q2);
+        const __m256i Q = _mm256_blend_epi32( _mm256_permute4x64_epi64(P, 0x90), _mm256_setzero_si256(), 0x03 );
+        const __m256i V = _mm256_blend_epi32( _mm256_permute4x64_epi64(U, 0x39), _mm256_setzero_si256(), 0xC0 );
+        const __m256i L = _mm256_or_si256( _mm256_sll_epi64(P, c1), _mm256_srl_epi64(Q, c1n) );
+        const __m256i R = _mm256_or_si256( _mm256_srl_epi64(U, c2), _mm256_sll_epi64(V, c2n) );
+        const __m256i D = _mm256_or_si256(L, R);
+        odd_store_avx2(dst, full, D);
+        _mm256_store_si256( (__m256i*)last, D );
+    }
+    else
+    {
+        // X[-full - 4 .. 2 * full + 8] with the frame at X[0 .. full]
+        alignas(32) uint64_t tmp[4 * (RSHIFT_SIZED_BITS / 64) + 32];
+        uint64_t* X = tmp + RSHIFT_SIZED_BITS / 64 + 8;
+        for(int32_t c = 0; 4 * c < full + 8; c += 1)
+        {
+            _mm256_store_si256( (__m256i*)(X - 4 * c - 4), _mm256_setzero_si256() );
+            _mm256_store_si256( (__m256i*)(X + 4 * regs + 4 * c), _mm256_setzero_si256() );
+        }
+        for(int32_t c = 0; c < regs; c += 1)
+            _mm256_store_si256( (__m256i*)(X + 4 * c), odd_words_avx2(src + 32 * c, full - 4 * c, tail) );
+
+        for(int32_t c = 0; c < regs; c += 1)
+        {
+            const __m256i P = _mm256_loadu_si256( (const __m256i*)(X + 4 * c - q1    ) );
+            const __m256i Q = _mm256_loadu_si256( (const __m256i*)(X + 4 * c - q1 - 1) );
+            const __m256i U = _mm256_loadu_si256( (const __m256i*)(X + 4 * c + q2    ) );
+            const __m256i V = _mm256_loadu_si256( (const __m256i*)(X + 4 * c + q2 + 1) );
+            const __m256i L = _mm256_or_si256( _mm256_sll_epi64(P, c1), _mm256_srl_epi64(Q, c1n) );
+            const __m256i R = _mm256_or_si256( _mm256_srl_epi64(U, c2), _mm256_sll_epi64(V, c2n) );
+            const __m256i D = _mm256_or_si256(L, R);
+            odd_store_avx2(dst + 32 * c, full - 4 * c, D);
+            _mm256_store_si256( (__m256i*)last, D );
+        }
+    }
+    store_tail(dst, nBits, last[full % 4]);
+}
+
+//
+// One-bit cyclic rotation of nFrames contiguous frames of nBits each (frames
+// are (nBits + 7) / 8 bytes apart). Eight 32-bit, four 64-bit or two 128-bit
+// frames share one register.
+//
+RSHIFT_TARGET_AVX2 inline void permutation_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
 {
     if( nBits == 32 )
     {
         uint32_t* bit_array = (uint32_t*)ptr_bit_array;
-        bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 31);
+        int32_t f = 0;
+        for(; f + 8 <= nFrames; f += 8)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(bit_array + f) );
+            const __m256i D = _mm256_or_si256( _mm256_slli_epi32(A, 1), _mm256_srli_epi32(A, 31) );
+            _mm256_storeu_si256( (__m256i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi32( _mm256_set1_epi32(nFrames - f), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) );
+            const __m256i A = _mm256_maskload_epi32( (const int*)(bit_array + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_slli_epi32(A, 1), _mm256_srli_epi32(A, 31) );
+            _mm256_maskstore_epi32( (int*)(bit_array + f), M, D );
+        }
     }
     else if( nBits == 64 )
     {
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 63);
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(bit_array + f) );
+            const __m256i D = _mm256_or_si256( _mm256_slli_epi64(A, 1), _mm256_srli_epi64(A, 63) );
+            _mm256_storeu_si256( (__m256i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi64( _mm256_set1_epi64x(nFrames - f), _mm256_setr_epi64x(0, 1, 2, 3) );
+            const __m256i A = _mm256_maskload_epi64( (const long long*)(bit_array + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_slli_epi64(A, 1), _mm256_srli_epi64(A, 63) );
+            _mm256_maskstore_epi64( (long long*)(bit_array + f), M, D );
+        }
+    }
+    else if( nBits == 128 )
+    {
+        // two frames per register, the carries being swapped inside each 128-bit lane
+        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m256i A  = _mm256_loadu_si256( (const __m256i*)(bit_array + 2 * f) );
+            const __m256i B0 = _mm256_slli_epi64 (A,  1);
+            const __m256i B1 = _mm256_srli_epi64 (A, 63);
+            const __m256i C0 = _mm256_shuffle_epi32(B1, 0x4E);
+            const __m256i D0 = _mm256_or_si256(B0, C0);
+            _mm256_storeu_si256( (__m256i*)(bit_array + 2 * f), D0 );
+        }
+        if( f < nFrames )
+        {
+            const __m128i A  = _mm_loadu_si128((const __m128i*)(bit_array + 2 * f));
+            const __m128i B0 = _mm_slli_epi64 (A,  1);
+            const __m128i B1 = _mm_srli_epi64 (A, 63);
+            const __m128i C0 = _mm_castpd_si128( _mm_permute_pd(_mm_castsi128_pd(B1), 1) );
+            const __m128i D0 = _mm_or_si128(B0, C0);
+            _mm_storeu_si128((__m128i*)(bit_array + 2 * f), D0);
+        }
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_permutation_t kernel = permutation_avx2_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64) );
+    }
+    else if( (nBits % 64 != 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_odd_avx2(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, ((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1);
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1, funnel_avx2);
+    }
+}
+
+//
+// Cyclic rotation by k positions in a single pass (see rotate_x86), the
+// funnel copy working on 256-bit lanes. Any nBits is accepted and nFrames
+// contiguous frames are rotated by the same amount, the 32-, 64- and 128-bit
+// frames being packed several per register.
+//
+RSHIFT_TARGET_AVX2 inline void rotate_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 32 - shift );
+        int32_t f = 0;
+        for(; f + 8 <= nFrames; f += 8)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(bit_array + f) );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi32(A, cl), _mm256_srl_epi32(A, cr) );
+            _mm256_storeu_si256( (__m256i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi32( _mm256_set1_epi32(nFrames - f), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) );
+            const __m256i A = _mm256_maskload_epi32( (const int*)(bit_array + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi32(A, cl), _mm256_srl_epi32(A, cr) );
+            _mm256_maskstore_epi32( (int*)(bit_array + f), M, D );
+        }
+    }
+    else if( nBits == 64 )
+    {
+        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 64 - shift );
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(bit_array + f) );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(A, cr) );
+            _mm256_storeu_si256( (__m256i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi64( _mm256_set1_epi64x(nFrames - f), _mm256_setr_epi64x(0, 1, 2, 3) );
+            const __m256i A = _mm256_maskload_epi64( (const long long*)(bit_array + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(A, cr) );
+            _mm256_maskstore_epi64( (long long*)(bit_array + f), M, D );
+        }
+    }
+    else if( nBits == 128 )
+    {
+        // two frames per register: word swap inside each 128-bit lane when
+        // shift >= 64, then one funnel shift by shift % 64
+        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+        const bool    swap = (shift >= 64);
+        const __m128i cl   = _mm_cvtsi32_si128( shift % 64      );
+        const __m128i cr   = _mm_cvtsi32_si128( 64 - shift % 64 );
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m256i X = _mm256_loadu_si256( (const __m256i*)(bit_array + 2 * f) );
+            const __m256i S = _mm256_shuffle_epi32(X, 0x4E);
+            const __m256i A = swap ? S : X;
+            const __m256i B = swap ? X : S;
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(B, cr) );
+            _mm256_storeu_si256( (__m256i*)(bit_array + 2 * f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m128i X = _mm_loadu_si128( (const __m128i*)(bit_array + 2 * f) );
+            const __m128i S = _mm_shuffle_epi32(X, 0x4E);
+            const __m128i A = swap ? S : X;
+            const __m128i B = swap ? X : S;
+            const __m128i D = _mm_or_si128( _mm_sll_epi64(A, cl), _mm_srl_epi64(B, cr) );
+            _mm_storeu_si128( (__m128i*)(bit_array + 2 * f), D );
+        }
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_rotate_t kernel = rotate_avx2_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
+    }
+    else if( (nBits % 64 != 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_odd_avx2(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, ((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift);
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift, funnel_avx2);
+    }
+}
+
+//
+// Out-of-place variants (see rotate_x86 for the contract). 32-, 64- and
+// 128-bit frames are packed eight, four or two per register as in place,
+// streamed when dst is 32-byte aligned; the other sizes go through
+// rotate_copy.
+//
+RSHIFT_TARGET_AVX2 inline void rotate_avx2(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    const bool    nt    = stream && ((uintptr_t)ptr_dst % 32 == 0);
+
+    if( nBits == 32 )
+    {
+        const uint32_t* src = (const uint32_t*)ptr_src;
+        uint32_t*       dst = (uint32_t*)ptr_dst;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 32 - shift );
+        int32_t f = 0;
+        for(; f + 8 <= nFrames; f += 8)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + f) );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi32(A, cl), _mm256_srl_epi32(A, cr) );
+            if( nt ) _mm256_stream_si256( (__m256i*)(dst + f), D );
+            else     _mm256_storeu_si256( (__m256i*)(dst + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi32( _mm256_set1_epi32(nFrames - f), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) );
+            const __m256i A = _mm256_maskload_epi32( (const int*)(src + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi32(A, cl), _mm256_srl_epi32(A, cr) );
+            _mm256_maskstore_epi32( (int*)(dst + f), M, D );
+        }
+    }
+    else if( nBits == 64 )
+    {
+        const uint64_t* src = (const uint64_t*)ptr_src;
+        uint64_t*       dst = (uint64_t*)ptr_dst;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 64 - shift );
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m256i A = _mm256_loadu_si256( (const __m256i*)(src + f) );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(A, cr) );
+            if( nt ) _mm256_stream_si256( (__m256i*)(dst + f), D );
+            else     _mm256_storeu_si256( (__m256i*)(dst + f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m256i M = _mm256_cmpgt_epi64( _mm256_set1_epi64x(nFrames - f), _mm256_setr_epi64x(0, 1, 2, 3) );
+            const __m256i A = _mm256_maskload_epi64( (const long long*)(src + f), M );
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(A, cr) );
+            _mm256_maskstore_epi64( (long long*)(dst + f), M, D );
+        }
     }
     else if( nBits == 128 )
     {
-        const __m128i A  = _mm_loadu_si128((const __m128i*) ptr_bit_array);
-        const __m128i B0 = _mm_slli_epi64 (A,  1);
-        const __m128i B1 = _mm_srli_epi64 (A, 63);
-        const __m128i C0 = _mm_castpd_si128( _mm_permute_pd(_mm_castsi128_pd(B1), 1) );
-        const __m128i D0 = _mm_or_si128(B0, C0);
-        _mm_storeu_si128((__m128i*) ptr_bit_array, D0);
-    }
-    else if( nBits == 256 )
-    {
-        const __m256i A  = _mm256_loadu_si256((const __m256i*) ptr_bit_array);
-        const __m256i B0 = _mm256_slli_epi64 (A,  1);
-        const __m256i B1 = _mm256_srli_epi64 (A, 63);
-        const __m256i C0 = _mm256_permute4x64_epi64(B1, 0x93);
-        const __m256i D0 = _mm256_or_si256(B0, C0);
-        _mm256_storeu_si256((__m256i*) ptr_bit_array, D0);
-    }
-    else if( nBits == 512 )
-    {
-        const __m256i A0 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 0 );
-        const __m256i A1 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 1);
-
-        const __m256i B0 = _mm256_slli_epi64 (A0,  1);
-        const __m256i B1 = _mm256_slli_epi64 (A1,  1);
-
-        const __m256i C0 = _mm256_srli_epi64 (A0, 63);
-        const __m256i C1 = _mm256_srli_epi64 (A1, 63);
-
-        const __m256d D0 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C0), 0x93);
-        const __m256d D1 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C1), 0x93);
-
-        const __m256i E0 = _mm256_castpd_si256( _mm256_blend_pd (D0, D1, 0x01) );
-        const __m256i E1 = _mm256_castpd_si256( _mm256_blend_pd (D1, D0, 0x01) );
-
-        const __m256i F0 = _mm256_or_si256(B0, E0);
-        const __m256i F1 = _mm256_or_si256(B1, E1);
-
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 0, F0);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 1, F1);
-    }
-    else if( nBits == 1024 )
-    {
-        const __m256i A0 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 0 );
-        const __m256i A1 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 1);
-        const __m256i A2 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 2);
-        const __m256i A3 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 3);
-
-        const __m256i B0 = _mm256_slli_epi64 (A0,  1);
-        const __m256i B1 = _mm256_slli_epi64 (A1,  1);
-        const __m256i B2 = _mm256_slli_epi64 (A2,  1);
-        const __m256i B3 = _mm256_slli_epi64 (A3,  1);
-
-        const __m256i C0 = _mm256_srli_epi64 (A0, 63);
-        const __m256i C1 = _mm256_srli_epi64 (A1, 63);
-        const __m256i C2 = _mm256_srli_epi64 (A2, 63);
-        const __m256i C3 = _mm256_srli_epi64 (A3, 63);
-
-        const __m256d D0 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C0), 0x93);
-        const __m256d D1 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C1), 0x93);
-        const __m256d D2 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C2), 0x93);
-        const __m256d D3 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C3), 0x93);
-
-        const __m256i E0 = _mm256_castpd_si256( _mm256_blend_pd (D0, D3, 0x01) );
-        const __m256i E1 = _mm256_castpd_si256( _mm256_blend_pd (D1, D0, 0x01) );
-        const __m256i E2 = _mm256_castpd_si256( _mm256_blend_pd (D2, D1, 0x01) );
-        const __m256i E3 = _mm256_castpd_si256( _mm256_blend_pd (D3, D2, 0x01) );
-
-        const __m256i F0 = _mm256_or_si256(B0, E0);
-        const __m256i F1 = _mm256_or_si256(B1, E1);
-        const __m256i F2 = _mm256_or_si256(B2, E2);
-        const __m256i F3 = _mm256_or_si256(B3, E3);
-
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 0, F0);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 1, F1);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 2, F2);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 3, F3);
-    }
-    else if( nBits == 2048 )
-    {
-        const __m256i A0 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 0);
-        const __m256i A1 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 1);
-        const __m256i A2 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 2);
-        const __m256i A3 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 3);
-        const __m256i A4 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 4);
-        const __m256i A5 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 5);
-        const __m256i A6 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 6);
-        const __m256i A7 = _mm256_loadu_si256( ((const __m256i*)ptr_bit_array) + 7);
-
-        const __m256i B0 = _mm256_slli_epi64 (A0,  1);
-        const __m256i B1 = _mm256_slli_epi64 (A1,  1);
-        const __m256i B2 = _mm256_slli_epi64 (A2,  1);
-        const __m256i B3 = _mm256_slli_epi64 (A3,  1);
-        const __m256i B4 = _mm256_slli_epi64 (A4,  1);
-        const __m256i B5 = _mm256_slli_epi64 (A5,  1);
-        const __m256i B6 = _mm256_slli_epi64 (A6,  1);
-        const __m256i B7 = _mm256_slli_epi64 (A7,  1);
-
-        const __m256i C0 = _mm256_srli_epi64 (A0, 63);
-        const __m256i C1 = _mm256_srli_epi64 (A1, 63);
-        const __m256i C2 = _mm256_srli_epi64 (A2, 63);
-        const __m256i C3 = _mm256_srli_epi64 (A3, 63);
-        const __m256i C4 = _mm256_srli_epi64 (A4, 63);
-        const __m256i C5 = _mm256_srli_epi64 (A5, 63);
-        const __m256i C6 = _mm256_srli_epi64 (A6, 63);
-        const __m256i C7 = _mm256_srli_epi64 (A7, 63);
-
-        const __m256d D0 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C0), 0x93);
-        const __m256d D1 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C1), 0x93);
-        const __m256d D2 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C2), 0x93);
-        const __m256d D3 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C3), 0x93);
-        const __m256d D4 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C4), 0x93);
-        const __m256d D5 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C5), 0x93);
-        const __m256d D6 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C6), 0x93);
-        const __m256d D7 = _mm256_permute4x64_pd (_mm256_castsi256_pd(C7), 0x93);
-
-        const __m256i E0 = _mm256_castpd_si256( _mm256_blend_pd (D0, D7, 0x01) );
-        const __m256i E1 = _mm256_castpd_si256( _mm256_blend_pd (D1, D0, 0x01) );
-        const __m256i E2 = _mm256_castpd_si256( _mm256_blend_pd (D2, D1, 0x01) );
-        const __m256i E3 = _mm256_castpd_si256( _mm256_blend_pd (D3, D2, 0x01) );
-        const __m256i E4 = _mm256_castpd_si256( _mm256_blend_pd (D4, D3, 0x01) );
-        const __m256i E5 = _mm256_castpd_si256( _mm256_blend_pd (D5, D4, 0x01) );
-        const __m256i E6 = _mm256_castpd_si256( _mm256_blend_pd (D6, D5, 0x01) );
-        const __m256i E7 = _mm256_castpd_si256( _mm256_blend_pd (D7, D6, 0x01) );
-
-        const __m256i F0 = _mm256_or_si256(B0, E0);
-        const __m256i F1 = _mm256_or_si256(B1, E1);
-        const __m256i F2 = _mm256_or_si256(B2, E2);
-        const __m256i F3 = _mm256_or_si256(B3, E3);
-        const __m256i F4 = _mm256_or_si256(B4, E4);
-        const __m256i F5 = _mm256_or_si256(B5, E5);
-        const __m256i F6 = _mm256_or_si256(B6, E6);
-        const __m256i F7 = _mm256_or_si256(B7, E7);
-
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 0, F0);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 1, F1);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 2, F2);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 3, F3);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 4, F4);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 5, F5);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 6, F6);
-        _mm256_storeu_si256( ((__m256i*)ptr_bit_array) + 7, F7);
+        const uint64_t* src  = (const uint64_t*)ptr_src;
+        uint64_t*       dst  = (uint64_t*)ptr_dst;
+        const bool      swap = (shift >= 64);
+        const __m128i   cl   = _mm_cvtsi32_si128( shift % 64      );
+        const __m128i   cr   = _mm_cvtsi32_si128( 64 - shift % 64 );
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m256i X = _mm256_loadu_si256( (const __m256i*)(src + 2 * f) );
+            const __m256i S = _mm256_shuffle_epi32(X, 0x4E);
+            const __m256i A = swap ? S : X;
+            const __m256i B = swap ? X : S;
+            const __m256i D = _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(B, cr) );
+            if( nt ) _mm256_stream_si256( (__m256i*)(dst + 2 * f), D );
+            else     _mm256_storeu_si256( (__m256i*)(dst + 2 * f), D );
+        }
+        if( f < nFrames )
+        {
+            const __m128i X = _mm_loadu_si128( (const __m128i*)(src + 2 * f) );
+            const __m128i S = _mm_shuffle_epi32(X, 0x4E);
+            const __m128i A = swap ? S : X;
+            const __m128i B = swap ? X : S;
+            const __m128i D = _mm_or_si128( _mm_sll_epi64(A, cl), _mm_srl_epi64(B, cr) );
+            _mm_storeu_si128( (__m128i*)(dst + 2 * f), D );
+        }
     }
     else
     {
-        printf("permutation_avx2(%d) : AVX2 IMPLEMENTATION NOT DONE YET !\n", nBits);
-        exit( EXIT_FAILURE );
+        rotate_copy(ptr_dst, ptr_src, nBits, shift, nFrames, funnel_avx2, stream ? funnel_avx2_stream : nullptr, rotate_odd_avx2);
+    }
+
+    if( stream )
+        _mm_sfence();
+}
+
+RSHIFT_TARGET_AVX2 inline void permutation_avx2(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_avx2(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+
+//
+// Rotations toward the low bits, the inverse of permutation_avx2 /
+// rotate_avx2.
+//
+RSHIFT_TARGET_AVX2 inline void rotate_right_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    rotate_avx2(ptr_bit_array, nBits, -(k % nBits), nFrames);
+}
+
+RSHIFT_TARGET_AVX2 inline void permutation_right_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    rotate_avx2(ptr_bit_array, nBits, nBits - 1, nFrames);
+}
+
+//
+// Word kernels of the non-cyclic shifts, four words per register (see
+// shl_words_sse4 for the in-place ordering).
+//
+RSHIFT_TARGET_AVX2 inline void shl_words_avx2(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    const __m128i cl = _mm_cvtsi32_si128( k      );
+    const __m128i cr = _mm_cvtsi32_si128( 64 - k );
+    int32_t x = nWords - 4;
+    for(; x >= 1; x -= 4)
+    {
+        const __m256i A = _mm256_loadu_si256( (const __m256i*)(w + x    ) );
+        const __m256i B = _mm256_loadu_si256( (const __m256i*)(w + x - 1) );
+        _mm256_storeu_si256( (__m256i*)(w + x), _mm256_or_si256( _mm256_sll_epi64(A, cl), _mm256_srl_epi64(B, cr) ) );
+    }
+    for(x = x + 3; x >= 1; x -= 1)
+        w[x] = funnel_left(w[x], w[x - 1], k);
+}
+
+RSHIFT_TARGET_AVX2 inline void shr_words_avx2(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    const __m128i cr = _mm_cvtsi32_si128( k      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - k );
+    int32_t x = 0;
+    for(; x + 4 < nWords; x += 4)
+    {
+        const __m256i A = _mm256_loadu_si256( (const __m256i*)(w + x    ) );
+        const __m256i B = _mm256_loadu_si256( (const __m256i*)(w + x + 1) );
+        _mm256_storeu_si256( (__m256i*)(w + x), _mm256_or_si256( _mm256_srl_epi64(A, cr), _mm256_sll_epi64(B, cl) ) );
+    }
+    for(; x < nWords - 1; x += 1)
+        w[x] = funnel_right(w[x], w[x + 1], k);
+}
+
+RSHIFT_TARGET_AVX2 inline uint64_t shift_left_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_left_generic(ptr_bit_array, nBits, k, carry_in, shl_words_avx2);
+}
+
+RSHIFT_TARGET_AVX2 inline uint64_t shift_right_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_right_generic(ptr_bit_array, nBits, k, carry_in, shr_words_avx2);
+}
+
+RSHIFT_TARGET_AVX2 inline void rotate_padded_avx2(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( (nBits % 64 == 0) || (nBits == 32) )
+        rotate_avx2(ptr_bit_array, nBits, shift);
+    else if( shift != 0 )
+        rotate_padded_generic(ptr_bit_array, nBits, shift, funnel_avx2, funnel_avx2_padded);
+}
+
+//
+// Circulant kernel (see rshift_circulant_t) on chunks of up to 4 ymm
+// accumulators (16 words), the last chunk of a block using only the V
+// registers it needs.
+//
+template<int32_t V>
+RSHIFT_TARGET_AVX2 inline void circulant_chunk_avx2(uint8_t* dst, const uint64_t* doubled, const int32_t j, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    const bool whole = (nBits >= 64 * 4 * V);
+    alignas(32) uint64_t tmp[4 * V];
+    const uint64_t* in = (const uint64_t*)dst;
+    if( accumulate && (whole == false) )
+    {
+        load_bits(tmp, 4 * V, dst, nBits);
+        in = tmp;
+    }
+
+    __m256i a[V];
+    for(int32_t v = 0; v < V; v += 1)
+        a[v] = _mm256_setzero_si256();
+    if( accumulate )
+    {
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = _mm256_loadu_si256( (const __m256i*)(in + 4 * v) );
+    }
+    for(int32_t t = 0; t < nTerms; t += 1)
+    {
+        const uint64_t* s  = doubled + terms[t].word + j;
+        const __m128i   cr = _mm_cvtsi32_si128( terms[t].b      );
+        const __m128i   cl = _mm_cvtsi32_si128( 64 - terms[t].b );
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = _mm256_xor_si256(a[v], _mm256_or_si256( _mm256_srl_epi64(_mm256_loadu_si256( (const __m256i*)(s + 4 * v) ), cr), _mm256_sll_epi64(_mm256_loadu_si256( (const __m256i*)(s + 4 * v + 1) ), cl) ));
+    }
+
+    uint64_t* out = whole ? (uint64_t*)dst : tmp;
+    for(int32_t v = 0; v < V; v += 1)
+        _mm256_storeu_si256( (__m256i*)(out + 4 * v), a[v] );
+    if( whole == false )
+        store_bits(dst, tmp, nBits);
+}
+
+RSHIFT_TARGET_AVX2 inline void circulant_row_avx2(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    for(int32_t j = 0; 64 * j < nBits; j += 4 * 4)
+    {
+        const int32_t rest = nBits - 64 * j;
+        switch( (rest + 64 * 4 - 1) / (64 * 4) )
+        {
+            case  1 : circulant_chunk_avx2<1>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  2 : circulant_chunk_avx2<2>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  3 : circulant_chunk_avx2<3>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            default : circulant_chunk_avx2<4>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+        }
+    }
+}
+
+RSHIFT_TARGET_AVX2 inline void rotate_xor_avx2(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    rotate_xor_generic(ptr_dst, ptr_src, nBits, shift, funnel_avx2, circulant_row_avx2);
+}
+
+//
+// Popcount of the 4 lanes: nibble lookup (vpshufb) then vpsadbw.
+//
+RSHIFT_TARGET_AVX2 inline __m256i popcount_avx2(const __m256i v)
+{
+    const __m256i lut  = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low  = _mm256_set1_epi8( 0x0F );
+    const __m256i lo   = _mm256_shuffle_epi8( lut, _mm256_and_si256( v, low ) );
+    const __m256i hi   = _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16(v, 4), low ) );
+    return _mm256_sad_epu8( _mm256_add_epi8(lo, hi), _mm256_setzero_si256() );
+}
+
+// carry-save adder: h:l = a + b + c, bit by bit
+#define CSA_AVX2(h, l, a, b, c)                                                       \
+    {                                                                                 \
+        const __m256i u = _mm256_xor_si256( (a), (b) );                               \
+        (h) = _mm256_or_si256( _mm256_and_si256( (a), (b) ), _mm256_and_si256( u, (c) ) ); \
+        (l) = _mm256_xor_si256( u, (c) );                                             \
+    }
+
+//
+// Cyclic correlation kernel (see rshift_correlate_t). The lookup popcount
+// being the expensive part, groups of 4 vectors go through a Harley-Seal
+// carry-save tree (ones, twos, fours) and only the fours are counted, the
+// ones and twos once per shift.
+//
+RSHIFT_TARGET_AVX2 inline void correlate_avx2(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = rshift_padded_words(nBits);
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o  = (nBits - k) % nBits;
+        const uint64_t* s  = doubled + o / 64;
+        const __m128i   cr = _mm_cvtsi32_si128( o % 64      );
+        const __m128i   cl = _mm_cvtsi32_si128( 64 - o % 64 );
+
+        __m256i v[4];
+        __m256i ones  = _mm256_setzero_si256();
+        __m256i twos  = _mm256_setzero_si256();
+        __m256i fours = _mm256_setzero_si256();
+        __m256i total = _mm256_setzero_si256();
+        int32_t x = 0;
+        for(; x + 16 <= words; x += 16)
+        {
+            for(int32_t i = 0; i < 4; i += 1)
+            {
+                const __m256i w = _mm256_or_si256( _mm256_srl_epi64(_mm256_loadu_si256( (const __m256i*)(s + x + 4 * i) ), cr),
+                                                   _mm256_sll_epi64(_mm256_loadu_si256( (const __m256i*)(s + x + 4 * i + 1) ), cl) );
+                v[i] = _mm256_and_si256( _mm256_load_si256( (const __m256i*)(a + x + 4 * i) ), w );
+            }
+            __m256i twos_a, twos_b;
+            CSA_AVX2(twos_a, ones,  ones, v[0],   v[1]  );
+            CSA_AVX2(twos_b, ones,  ones, v[2],   v[3]  );
+            CSA_AVX2(fours,  twos,  twos, twos_a, twos_b);
+            total = _mm256_add_epi64( total, popcount_avx2(fours) );
+        }
+        total = _mm256_slli_epi64( total, 2 );
+        total = _mm256_add_epi64( total, _mm256_slli_epi64( popcount_avx2(twos), 1 ) );
+        total = _mm256_add_epi64( total, popcount_avx2(ones) );
+        for(; x < words; x += 4)
+        {
+            const __m256i w = _mm256_or_si256( _mm256_srl_epi64(_mm256_loadu_si256( (const __m256i*)(s + x) ), cr),
+                                               _mm256_sll_epi64(_mm256_loadu_si256( (const __m256i*)(s + x + 1) ), cl) );
+            total = _mm256_add_epi64( total, popcount_avx2( _mm256_and_si256( _mm256_load_si256( (const __m256i*)(a + x) ), w ) ) );
+        }
+        const __m128i sum = _mm_add_epi64( _mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1) );
+        out[k - k0] = (int32_t)(_mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1));
+    }
+}
+
+//
+// Small frames (see rshift_small_t): eight frames of up to 32 bits or four
+// of up to 64 bits per register. Each 128-bit half is loaded from the
+// frames it holds and spread to one frame per lane by vpshufb (a plain
+// load when frames fill whole lanes), then every lane is rotated within
+// its own nBits by vpsllv / vpsrlv. The frames go back by the inverse
+// shuffle and stores of exactly their bytes, so that no frame outside the
+// register is rewritten. Loads read up to 16 bytes past the frames they
+// use, the last frames being left to rotate_small_generic.
+//
+RSHIFT_TARGET_AVX2 inline void store_bytes_avx2(uint8_t* p, __m128i v, const int32_t n)
+{
+    if( n == 16 )
+    {
+        _mm_storeu_si128((__m128i*)p, v);
+        return;
+    }
+    if( n & 8 )
+    {
+        _mm_storel_epi64((__m128i*)p, v);
+        v  = _mm_srli_si128(v, 8);
+        p += 8;
+    }
+    if( n & 4 )
+    {
+        const int32_t x = _mm_cvtsi128_si32( v );
+        memcpy(p, &x, 4);
+        v  = _mm_srli_si128(v, 4);
+        p += 4;
+    }
+    if( n & 2 )
+    {
+        const int16_t x = (int16_t)_mm_extract_epi16(v, 0);
+        memcpy(p, &x, 2);
+    }
+}
+
+template<int32_t W>    // bytes per lane, 4 or 8
+RSHIFT_TARGET_AVX2 inline void rotate_small_lanes_avx2(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    constexpr int32_t lanes  = 32 / W;
+    const int32_t     nBytes = (nBits + 7) / 8;
+    const int32_t     half   = (16 / W) * nBytes;    // frame bytes per 128-bit half
+    const bool        packed = (nBytes == W);
+
+    alignas(16) uint8_t expand  [16];
+    alignas(16) uint8_t compress[16];
+    for(int32_t i = 0; i < 16; i += 1)
+    {
+        expand  [i] = (i % W < nBytes) ? (uint8_t)((i / W) * nBytes + i % W) : 0x80;
+        compress[i] = (i < half      ) ? (uint8_t)((i / nBytes) * W + i % nBytes) : 0x80;
+    }
+    const __m256i to_lanes  = _mm256_broadcastsi128_si256( _mm_load_si128((const __m128i*)expand  ) );
+    const __m256i to_frames = _mm256_broadcastsi128_si256( _mm_load_si128((const __m128i*)compress) );
+
+    const uint64_t m    = (nBits == 64) ? ~0ULL : ((1ULL << nBits) - 1);
+    const __m256i  mask = (W == 4) ? _mm256_set1_epi32( (int32_t)m ) : _mm256_set1_epi64x( (long long)m );
+    const __m256i  top  = (W == 4) ? _mm256_set1_epi32( nBits - 1 ) : _mm256_set1_epi64x( nBits - 1 );
+
+    // a single shift amount is broadcast once
+    int32_t              j = (int32_t)(first % nShifts);
+    alignas(32) uint32_t k32[8];
+    alignas(32) uint64_t k64[4];
+    __m256i              c = (W == 4) ? _mm256_set1_epi32( small_shift(shifts[0], nBits) ) : _mm256_set1_epi64x( small_shift(shifts[0], nBits) );
+
+    int64_t f = 0;
+    for(; (f + lanes) * nBytes + 16 - half <= nFrames * nBytes; f += lanes)
+    {
+        uint8_t* p = ptr + f * nBytes;
+        __m256i  v;
+        if( packed )
+            v = _mm256_loadu_si256((const __m256i*)p);
+        else
+            v = _mm256_shuffle_epi8( _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128((const __m128i*)p) ), _mm_loadu_si128((const __m128i*)(p + half)), 1 ), to_lanes );
+
+        if( nShifts != 1 )
+        {
+            for(int32_t l = 0; l < lanes; l += 1)
+            {
+                if( W == 4 ) k32[l] = small_shift(shifts[j], nBits);
+                else         k64[l] = small_shift(shifts[j], nBits);
+                j = (j + 1 == nShifts) ? 0 : (j + 1);
+            }
+            c = (W == 4) ? _mm256_load_si256((const __m256i*)k32) : _mm256_load_si256((const __m256i*)k64);
+        }
+
+        const __m256i bits = _mm256_and_si256( v, mask );
+        __m256i       r;
+        if( W == 4 )
+            r = _mm256_or_si256( _mm256_sllv_epi32(bits, c), _mm256_srlv_epi32(_mm256_srli_epi32(bits, 1), _mm256_sub_epi32(top, c)) );
+        else
+            r = _mm256_or_si256( _mm256_sllv_epi64(bits, c), _mm256_srlv_epi64(_mm256_srli_epi64(bits, 1), _mm256_sub_epi64(top, c)) );
+        r = _mm256_or_si256( _mm256_and_si256(r, mask), _mm256_xor_si256(v, bits) );
+
+        if( packed )
+            _mm256_storeu_si256((__m256i*)p, r);
+        else
+        {
+            r = _mm256_shuffle_epi8( r, to_frames );
+            store_bytes_avx2(p,        _mm256_castsi256_si128  ( r ),    half);
+            store_bytes_avx2(p + half, _mm256_extracti128_si256( r, 1 ), half);
+        }
+    }
+    rotate_small_generic(ptr + f * nBytes, nBits, nFrames - f, shifts, nShifts, first + f);
+}
+
+RSHIFT_TARGET_AVX2 inline void rotate_small_avx2(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    if( nBits <= 32 ) rotate_small_lanes_avx2<4>(ptr, nBits, nFrames, shifts, nShifts, first);
+    else              rotate_small_lanes_avx2<8>(ptr, nBits, nFrames, shifts, nShifts, first);
+}
+
+//
+// Bit transposes (see rshift_transpose_t): a row of the four matrices is one
+// register, i.e. bit c of 256 frames once transposed. The 64 rows do not
+// fit in the 16 registers, the stages go through memory (L1).
+//
+RSHIFT_TARGET_AVX2 inline void transpose64x4_avx2(uint64_t* a)
+{
+    for(int32_t s = 0; s < 6; s += 1)
+    {
+        const int32_t j = 32 >> s;
+        const __m128i c = _mm_cvtsi32_si128( j );
+        const __m256i m = _mm256_set1_epi64x( (long long)rshift_transpose_masks[s] );
+        for(int32_t r = 0; r < 64; r += 1)
+        {
+            if( r & j )
+                continue;
+            const __m256i A = _mm256_load_si256((const __m256i*)(a + 4 * r));
+            const __m256i B = _mm256_load_si256((const __m256i*)(a + 4 * (r + j)));
+            const __m256i t = _mm256_and_si256( _mm256_xor_si256(_mm256_srl_epi64(A, c), B), m );
+            _mm256_store_si256((__m256i*)(a + 4 * r),       _mm256_xor_si256(A, _mm256_sll_epi64(t, c)));
+            _mm256_store_si256((__m256i*)(a + 4 * (r + j)), _mm256_xor_si256(B, t));
+        }
     }
 }
 
@@ -0,0 +1,1108 @@
+/*
+ *	Optimized AVX-512 bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_avx512_
+#define _rshift_avx512_
+
+#include "rshift_common.hpp"
+#include "rshift_avx2.hpp"
+#ifdef RSHIFT_HAS_AVX512
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <immintrin.h>
+
+//
+// Funnel shifts on 64-bit lanes. With VBMI2 they are a single vpshldq /
+// vpshrdvq, otherwise they fall back to two shifts and an or (vpsllvq /
+// vpsrlvq by a broadcast count: the count of 64 gives 0 as required and,
+// unlike vpsllq with an xmm count, GCC's intrinsics do not warn about an
+// uninitialized operand).
+//
+//     shl1 (a, b)    = (a << 1) | (b >> 63)
+//     shlv (a, b, c) = (a << c) | (b >> (64 - c))     0 <= c < 64
+//     shrv (a, b, c) = (a >> c) | (b << (64 - c))     0 <= c < 64
+//
+#ifdef __AVX512VBMI2__
+    #define SHL1_AVX512(a, b)    _mm512_shldi_epi64 ((a), (b), 1)
+    #define SHLV_AVX512(a, b, c) _mm512_shldv_epi64 ((a), (b), _mm512_set1_epi64(c))
+    #define SHRV_AVX512(a, b, c) _mm512_shrdv_epi64 ((a), (b), _mm512_set1_epi64(c))
+#else
+    #define SHL1_AVX512(a, b)    _mm512_or_si512( _mm512_slli_epi64((a), 1), _mm512_srli_epi64((b), 63) )
+    #define SHLV_AVX512(a, b, c) _mm512_or_si512( _mm512_sllv_epi64((a), _mm512_set1_epi64(c)), _mm512_srlv_epi64((b), _mm512_set1_epi64(64 - (c))) )
+    #define SHRV_AVX512(a, b, c) _mm512_or_si512( _mm512_srlv_epi64((a), _mm512_set1_epi64(c)), _mm512_sllv_epi64((b), _mm512_set1_epi64(64 - (c))) )
+#endif
+
+//
+// The last 1 to 7 words are processed with a __mmask8, the masked loads
+// suppressing faults past the end of the source.
+//
+RSHIFT_TARGET_AVX512 inline void funnel_avx512(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    int32_t x = 0;
+    for(; x + 8 <= nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x     );
+        const __m512i B = _mm512_loadu_si512( src + x + 1 );
+        _mm512_storeu_si512( dst + x, SHRV_AVX512(A, B, b) );
+    }
+    if( x < nWords )
+    {
+        const __mmask8 M = (__mmask8)((1U << (nWords - x)) - 1);
+        const __m512i  A = _mm512_maskz_loadu_epi64( M, src + x     );
+        const __m512i  B = _mm512_maskz_loadu_epi64( M, src + x + 1 );
+        _mm512_mask_storeu_epi64( dst + x, M, SHRV_AVX512(A, B, b) );
+    }
+}
+
+//
+// Non-temporal variant of funnel_avx512: regular stores up to the first
+// cache line boundary of dst and for the last 1 to 7 words, vmovntdq for
+// the full lines. The caller issues the sfence.
+//
+RSHIFT_TARGET_AVX512 inline void funnel_avx512_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    if( ((uintptr_t)dst % 8 != 0) || (nWords < 16) )
+    {
+        funnel_avx512(dst, src, nWords, b);
+        return;
+    }
+    const int32_t head = ((64 - (uintptr_t)dst % 64) % 64) / 8;
+    funnel_avx512(dst, src, head, b);
+
+    int32_t x = head;
+    for(; x + 8 <= nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x     );
+        const __m512i B = _mm512_loadu_si512( src + x + 1 );
+        _mm512_stream_si512( (__m512i*)(dst + x), SHRV_AVX512(A, B, b) );
+    }
+    funnel_avx512(dst + x, src + x, nWords - x, b);
+}
+
+//
+// Funnel copy to a cache line aligned dst that may be written up to the end
+// of the line (padded arrays): aligned stores and no masked tail.
+//
+RSHIFT_TARGET_AVX512 inline void funnel_avx512_padded(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    for(int32_t x = 0; x < nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x     );
+        const __m512i B = _mm512_loadu_si512( src + x + 1 );
+        _mm512_store_si512( dst + x, SHRV_AVX512(A, B, b) );
+    }
+}
+
+#ifdef RSHIFT_HAS_AVX512_VBMI2
+//
+// funnel_avx512 and funnel_avx512_stream with vpshrdvq whatever the -m
+// flags, for the CPUs that have VBMI2 (see funnel_avx512_select).
+//
+RSHIFT_TARGET_AVX512_VBMI2 inline void funnel_avx512_vbmi2(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    const __m512i C = _mm512_set1_epi64( b );
+    int32_t x = 0;
+    for(; x + 8 <= nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x     );
+        const __m512i B = _mm512_loadu_si512( src + x + 1 );
+        _mm512_storeu_si512( dst + x, _mm512_shrdv_epi64(A, B, C) );
+    }
+    if( x < nWords )
+    {
+        const __mmask8 M = (__mmask8)((1U << (nWords - x)) - 1);
+        const __m512i  A = _mm512_maskz_loadu_epi64( M, src + x     );
+        const __m512i  B = _mm512_maskz_loadu_epi64( M, src + x + 1 );
+        _mm512_mask_storeu_epi64( dst + x, M, _mm512_shrdv_epi64(A, B, C) );
+    }
+}
+
+RSHIFT_TARGET_AVX512_VBMI2 inline void funnel_avx512_vbmi2_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    if( ((uintptr_t)dst % 8 != 0) || (nWords < 16) )
+    {
+        funnel_avx512_vbmi2(dst, src, nWords, b);
+        return;
+    }
+    const int32_t head = ((64 - (uintptr_t)dst % 64) % 64) / 8;
+    funnel_avx512_vbmi2(dst, src, head, b);
+
+    const __m512i C = _mm512_set1_epi64( b );
+    int32_t x = head;
+    for(; x + 8 <= nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x     );
+        const __m512i B = _mm512_loadu_si512( src + x + 1 );
+        _mm512_stream_si512( (__m512i*)(dst + x), _mm512_shrdv_epi64(A, B, C) );
+    }
+    funnel_avx512_vbmi2(dst + x, src + x, nWords - x, b);
+}
+#endif
+
+//
+// True when the *_vbmi2 kernels may run: checked once on the CPU in the
+// dispatch build, known at compile time otherwise.
+//
+inline bool rshift_has_avx512_vbmi2()
+{
+#if defined(RSHIFT_HAS_AVX512_VBMI2) && defined(RSHIFT_X86_DISPATCH) && !defined(__AVX512VBMI2__)
+    static const bool vbmi2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx512vbmi2"));
+    return vbmi2;
+#elif defined(RSHIFT_HAS_AVX512_VBMI2)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//
+// Funnel of the AVX-512 kernels: the VBMI2 one when the CPU has it,
+// funnel_avx512 otherwise. Builds for a VBMI2 target already have vpshrdvq
+// in funnel_avx512.
+//
+inline rshift_funnel_t funnel_avx512_select(const bool stream = false)
+{
+#if defined(RSHIFT_HAS_AVX512_VBMI2) && defined(RSHIFT_X86_DISPATCH) && !defined(__AVX512VBMI2__)
+    if( rshift_has_avx512_vbmi2() )
+        return stream ? funnel_avx512_vbmi2_stream : funnel_avx512_vbmi2;
+#endif
+    return stream ? funnel_avx512_stream : funnel_avx512;
+}
+
+//
+// Lane permutation that rotates every group of W 64-bit words of a zmm by
+// q words (lane j receives lane (j - q) mod W of its group). With W = 1, 2,
+// 4 or 8 a register holds 8 / W frames of 64, 128, 256 or 512 bits.
+//
+RSHIFT_TARGET_AVX512 inline __m512i lane_index_avx512(const int32_t W, const int32_t q)
+{
+    const __m512i lane = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m512i mask = _mm512_set1_epi64(W - 1);
+    const __m512i base = _mm512_andnot_si512(mask, lane);
+    const __m512i pos  = _mm512_and_si512(_mm512_sub_epi64(_mm512_add_epi64(lane, _mm512_set1_epi64(W)), _mm512_set1_epi64(q)), mask);
+    return _mm512_or_si512(base, pos);
+}
+
+//
+// Compile-time sized kernels. 64- to 512-bit sizes live in a single masked
+// zmm, multiples of 512 bits in NBits / 512 zmm chained through vpermt2q,
+// the other sizes are forwarded to the AVX2 templates.
+//
+template<int32_t NBits>
+RSHIFT_TARGET_AVX512 inline void permutation_avx512(void* ptr_bit_array)
+{
+    if constexpr ( (NBits == 64) || (NBits == 128) || (NBits == 256) || (NBits == 512) )
+    {
+        constexpr __mmask8 M = (__mmask8)((1U << (NBits / 64)) - 1);
+        const __m512i A = _mm512_maskz_loadu_epi64( M, ptr_bit_array );
+        const __m512i P = _mm512_permutexvar_epi64( lane_index_avx512(NBits / 64, 1), A );
+        _mm512_mask_storeu_epi64( ptr_bit_array, M, SHL1_AVX512(A, P) );
+    }
+    else if constexpr ( NBits % 512 == 0 )
+    {
+        constexpr int32_t regs = NBits / 512;
+        const __m512i idx = _mm512_setr_epi64(15, 0, 1, 2, 3, 4, 5, 6);
+        __m512i A[regs];
+
+        #pragma GCC unroll 16
+        for(int32_t x = 0; x < regs; x += 1)
+            A[x] = _mm512_loadu_si512( ((uint64_t*)ptr_bit_array) + 8 * x );
+
+        #pragma GCC unroll 16
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            const __m512i P = _mm512_permutex2var_epi64( A[x], idx, A[(x + regs - 1) % regs] );
+            _mm512_storeu_si512( ((uint64_t*)ptr_bit_array) + 8 * x, SHL1_AVX512(A[x], P) );
+        }
+    }
+    else
+    {
+        permutation_avx2<NBits>(ptr_bit_array);
+    }
+}
+
+template<int32_t NBits>
+RSHIFT_TARGET_AVX512 inline void rotate_avx512(void* ptr_bit_array, const int32_t k)
+{
+    if constexpr ( (NBits == 64) || (NBits == 128) || (NBits == 256) || (NBits == 512) )
+    {
+        const int32_t shift = ((k % NBits) + NBits) % NBits;
+        if( shift == 0 )
+            return;
+
+        constexpr __mmask8 M = (__mmask8)((1U << (NBits / 64)) - 1);
+        const __m512i A = _mm512_maskz_loadu_epi64( M, ptr_bit_array );
+        const __m512i P = _mm512_permutexvar_epi64( lane_index_avx512(NBits / 64, shift / 64    ), A );
+        const __m512i Q = _mm512_permutexvar_epi64( lane_index_avx512(NBits / 64, shift / 64 + 1), A );
+        _mm512_mask_storeu_epi64( ptr_bit_array, M, SHLV_AVX512(P, Q, shift % 64) );
+    }
+    else if constexpr ( NBits % 512 == 0 )
+    {
+        const int32_t shift = ((k % NBits) + NBits) % NBits;
+        if( shift == 0 )
+            return;
+
+        constexpr int32_t words = NBits / 64;
+        uint64_t tmp[2 * words + 8];
+
+        #pragma GCC unroll 16
+        for(int32_t x = 0; x < words; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( ((uint64_t*)ptr_bit_array) + x );
+            _mm512_storeu_si512( tmp + x,         A );
+            _mm512_storeu_si512( tmp + x + words, A );
+        }
+        _mm512_storeu_si512( tmp + 2 * words, _mm512_setzero_si512() );
+
+        const uint64_t* src = tmp + (NBits - shift) / 64;
+        const int32_t   b   = (NBits - shift) % 64;
+
+        #pragma GCC unroll 16
+        for(int32_t x = 0; x < words; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( src + x     );
+            const __m512i B = _mm512_loadu_si512( src + x + 1 );
+            _mm512_storeu_si512( ((uint64_t*)ptr_bit_array) + x, SHRV_AVX512(A, B, b) );
+        }
+    }
+    else
+    {
+        rotate_avx2<NBits>(ptr_bit_array, k);
+    }
+}
+
+RSHIFT_SIZED_TABLES(avx512)
+
+//
+// Frames of nBits % 64 != 0 bits up to RSHIFT_SIZED_BITS (see rotate_odd_avx2).
+// Output word x is word x of (frame << shift) | (frame >> (nBits - shift)):
+// below 512 bits both are vpermq of the frame register with zeroing masks,
+// above they are windows of eight words read from the frame registers set
+// between zero ones (one vpermt2q each, the neighbouring words coming from
+// valignq). Byte masks cover the partial last word, whose bits past nBits
+// are merged back from dst with vpternlogq.
+//
+// odd_window_avx512 returns the words first .. first + 7 of a frame held in
+// X[4 + i] = words 8 i .. 8 i + 7 (-32 <= first), odd_store_avx512 stores
+// the register of dst that starts n bytes before the end of the frame.
+//
+RSHIFT_TARGET_AVX512 inline __m512i odd_window_avx512(const __m512i* X, const int32_t first)
+{
+    const uint32_t pos = (uint32_t)(first + 32);
+    const __m512i  idx = _mm512_add_epi64( _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7), _mm512_set1_epi64(pos % 8) );
+    return _mm512_permutex2var_epi64( X[pos / 8], idx, X[pos / 8 + 1] );
+}
+
+inline __mmask64 odd_bytes_avx512(const int32_t n)
+{
+    return (n >= 64) ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+}
+
+RSHIFT_TARGET_AVX512 inline void odd_store_avx512(uint8_t* dst, const int32_t n, const __m512i D, const int32_t nBits)
+{
+    const __mmask64 K = odd_bytes_avx512(n);
+    if( (n <= 64) && (nBits % 8 != 0) )
+    {
+        // keep ? D : dst, keep being 0 on the bits past nBits
+        const __m512i tm   = _mm512_set1_epi64( (int64_t)((1ULL << (nBits % 64)) - 1) );
+        const __m512i keep = _mm512_mask_mov_epi64( _mm512_set1_epi64(-1), (__mmask8)(1U << (nBits / 64 % 8)), tm );
+        const __m512i O    = _mm512_maskz_loadu_epi8( K & ~(K >> 1), dst );
+        _mm512_mask_storeu_epi8( dst, K, _mm512_ternarylogic_epi64(keep, D, O, 0xCA) );
+    }
+    else
+    {
+        _mm512_mask_storeu_epi8( dst, K, D );
+    }
+}
+
+RSHIFT_TARGET_AVX512 inline void rotate_odd_avx512(uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t shift)
+{
+    const int32_t full   = nBits / 64;
+    const int32_t nBytes = (nBits + 7) / 8;
+    const int32_t q1     = shift / 64;
+    const int32_t q2     = (nBits - shift) / 64;
+    const int32_t r1     = shift % 64;
+    const int32_t r2     = (nBits - shift) % 64;
+    const __m512i tm     = _mm512_set1_epi64( (int64_t)((1ULL << (nBits % 64)) - 1) );
+    const __m512i lane   = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+
+    if( full < 8 )
+    {
+        __m512i X = _mm512_maskz_loadu_epi8( odd_bytes_avx512(nBytes), src );
+        X = _mm512_mask_and_epi64( X, (__mmask8)(1U << full), X, tm );
+        const __m512i P = _mm512_maskz_permutexvar_epi64( (__mmask8)(0xFF << q1      ), _mm512_sub_epi64(lane, _mm512_set1_epi64(q1    )), X );
+        const __m512i Q = _mm512_maskz_permutexvar_epi64( (__mmask8)(0xFF << (q1 + 1)), _mm512_sub_epi64(lane, _mm512_set1_epi64(q1 + 1)), X );
+        const __m512i U = _mm512_maskz_permutexvar_epi64( (__mmask8)(0xFF >> q2      ), _mm512_add_epi64(lane, _mm512_set1_epi64(q2    )), X );
+        const __m512i V = _mm512_maskz_permutexvar_epi64( (__mmask8)(0xFF >> (q2 + 1)), _mm512_add_epi64(lane, _mm512_set1_epi64(q2 + 1)), X );
+        odd_store_avx512( dst, nBytes, _mm512_or_si512(SHLV_AVX512(P, Q, r1), SHRV_AVX512(U, V, r2)), nBits );
+        return;
+    }
+
+    // the frame, its bits past nBits cleared, between zero registers
+    const int32_t regs = full / 8 + 1;
+    __m512i X[4 + 2 * (RSHIFT_SIZED_BITS / 512) + 1];
+    for(int32_t c = 0; c < regs; c += 1)
+    {
+        const __m512i A = _mm512_maskz_loadu_epi8( odd_bytes_avx512(nBytes - 64 * c), src + 64 * c );
+        X[3 - c]        = _mm512_setzero_si512();
+        X[4 + c]        = _mm512_mask_and_epi64( A, (c == regs - 1) ? (__mmask8)(1U << (full % 8)) : 0, A, tm );
+        X[4 + regs + c] = _mm512_setzero_si512();
+    }
+    X[4 + 2 * regs] = _mm512_setzero_si512();
+
+    __m512i P = _mm512_setzero_si512();
+    __m512i U = odd_window_avx512(X, q2);
+    for(int32_t c = 0; c < regs; c += 1)
+    {
+        const __m512i Pn = odd_window_avx512(X, 8 * c - q1    );
+        const __m512i Un = odd_window_avx512(X, 8 * c + q2 + 8);
+        const __m512i L  = SHLV_AVX512( Pn, _mm512_alignr_epi64(Pn, P, 7), r1 );
+        const __m512i R  = SHRV_AVX512( U,  _mm512_alignr_epi64(Un, U, 1), r2 );
+        odd_store_avx512( dst + 64 * c, nBytes - 64 * c, _mm512_or_si512(L, R), nBits );
+        P = Pn;
+        U = Un;
+    }
+}
+
+//
+// One-bit cyclic rotation of nFrames contiguous frames of nBits each (frames
+// are (nBits + 7) / 8 bytes apart). Frames of 64 to 512 bits share a single
+// code path: one load, one vpermq, one funnel shift and one store per zmm,
+// the size being handled by the permutation index and a __mmask8. Larger
+// multiples of 512 bits are chained through vpermt2q, 2048 bits living in
+// four zmm registers.
+//
+RSHIFT_TARGET_AVX512 inline void permutation_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        int32_t f = 0;
+        for(; f + 16 <= nFrames; f += 16)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + f );
+            _mm512_storeu_si512( bit_array + f, _mm512_rol_epi32(A, 1) );
+        }
+        if( f < nFrames )
+        {
+            const __mmask16 M = (__mmask16)((1U << (nFrames - f)) - 1);
+            const __m512i   A = _mm512_maskz_loadu_epi32( M, bit_array + f );
+            _mm512_mask_storeu_epi32( bit_array + f, M, _mm512_rol_epi32(A, 1) );
+        }
+    }
+    else if( (nBits == 64) || (nBits == 128) || (nBits == 256) || (nBits == 512) )
+    {
+        const int32_t   W         = nBits / 64;
+        const int32_t   total     = W * nFrames;
+        const __m512i   idx       = lane_index_avx512(W, 1);
+        uint64_t*       bit_array = (uint64_t*)ptr_bit_array;
+        int32_t x = 0;
+        for(; x + 8 <= total; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + x );
+            const __m512i P = _mm512_permutexvar_epi64( idx, A );
+            _mm512_storeu_si512( bit_array + x, SHL1_AVX512(A, P) );
+        }
+        if( x < total )
+        {
+            const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+            const __m512i  A = _mm512_maskz_loadu_epi64( M, bit_array + x );
+            const __m512i  P = _mm512_permutexvar_epi64( idx, A );
+            _mm512_mask_storeu_epi64( bit_array + x, M, SHL1_AVX512(A, P) );
+        }
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_permutation_t kernel = permutation_avx512_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64) );
+    }
+    else if( nBits % 512 == 0 )
+    {
+        // each register takes the top word of the previous one as carry
+        const int32_t regs = nBits / 512;
+        const __m512i idx  = _mm512_setr_epi64(15, 0, 1, 2, 3, 4, 5, 6);
+        for(int32_t f = 0; f < nFrames; f += 1)
+        {
+            uint64_t* bit_array = ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64);
+            __m512i prev = _mm512_loadu_si512( bit_array + 8 * (regs - 1) );
+            for(int32_t r = 0; r < regs; r += 1)
+            {
+                const __m512i A = _mm512_loadu_si512( bit_array + 8 * r );
+                const __m512i P = _mm512_permutex2var_epi64( A, idx, prev );
+                _mm512_storeu_si512( bit_array + 8 * r, SHL1_AVX512(A, P) );
+                prev = A;
+            }
+        }
+    }
+    else if( (nBits % 64 != 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_odd_avx512(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, ((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1);
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        const rshift_funnel_t funnel = funnel_avx512_select();
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1, funnel);
+    }
+}
+
+//
+// Cyclic rotation by k positions in a single pass (see rotate_x86). Frames
+// of 64 to 512 bits are rotated with one vpermq (word move) and one funnel
+// shift (k % 64), other multiples of 64 bits up to RSHIFT_SIZED_BITS through
+// the sized kernels, the other frames up to that size through
+// rotate_odd_avx512 and the larger ones through rotate_generic.
+//
+RSHIFT_TARGET_AVX512 inline void rotate_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        const __m512i count = _mm512_set1_epi32(shift);
+        int32_t f = 0;
+        for(; f + 16 <= nFrames; f += 16)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + f );
+            _mm512_storeu_si512( bit_array + f, _mm512_rolv_epi32(A, count) );
+        }
+        if( f < nFrames )
+        {
+            const __mmask16 M = (__mmask16)((1U << (nFrames - f)) - 1);
+            const __m512i   A = _mm512_maskz_loadu_epi32( M, bit_array + f );
+            _mm512_mask_storeu_epi32( bit_array + f, M, _mm512_rolv_epi32(A, count) );
+        }
+    }
+    else if( (nBits == 64) || (nBits == 128) || (nBits == 256) || (nBits == 512) )
+    {
+        const int32_t   W         = nBits / 64;
+        const int32_t   total     = W * nFrames;
+        const int32_t   r         = shift % 64;
+        const __m512i   idxA      = lane_index_avx512(W, shift / 64    );
+        const __m512i   idxB      = lane_index_avx512(W, shift / 64 + 1);
+        uint64_t*       bit_array = (uint64_t*)ptr_bit_array;
+        int32_t x = 0;
+        for(; x + 8 <= total; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + x );
+            const __m512i P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i Q = _mm512_permutexvar_epi64( idxB, A );
+            _mm512_storeu_si512( bit_array + x, SHLV_AVX512(P, Q, r) );
+        }
+        if( x < total )
+        {
+            const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+            const __m512i  A = _mm512_maskz_loadu_epi64( M, bit_array + x );
+            const __m512i  P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i  Q = _mm512_permutexvar_epi64( idxB, A );
+            _mm512_mask_storeu_epi64( bit_array + x, M, SHLV_AVX512(P, Q, r) );
+        }
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_rotate_t kernel = rotate_avx512_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
+    }
+    else if( (nBits % 64 != 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_odd_avx512(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, ((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift);
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        const rshift_funnel_t funnel = funnel_avx512_select();
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift, funnel);
+    }
+}
+
+//
+// Out-of-place variants (see rotate_x86 for the contract). Frames of 32 to
+// 512 bits use the packed in-register paths, streamed when dst is 64-byte
+// aligned; the other sizes go through rotate_copy.
+//
+RSHIFT_TARGET_AVX512 inline void rotate_avx512(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    const bool    nt    = stream && ((uintptr_t)ptr_dst % 64 == 0);
+
+    if( nBits == 32 )
+    {
+        const uint32_t* src   = (const uint32_t*)ptr_src;
+        uint32_t*       dst   = (uint32_t*)ptr_dst;
+        const __m512i   count = _mm512_set1_epi32(shift);
+        int32_t f = 0;
+        for(; f + 16 <= nFrames; f += 16)
+        {
+            const __m512i D = _mm512_rolv_epi32( _mm512_loadu_si512( src + f ), count );
+            if( nt ) _mm512_stream_si512( (__m512i*)(dst + f), D );
+            else     _mm512_storeu_si512( dst + f, D );
+        }
+        if( f < nFrames )
+        {
+            const __mmask16 M = (__mmask16)((1U << (nFrames - f)) - 1);
+            const __m512i   A = _mm512_maskz_loadu_epi32( M, src + f );
+            _mm512_mask_storeu_epi32( dst + f, M, _mm512_rolv_epi32(A, count) );
+        }
+    }
+    else if( (nBits == 64) || (nBits == 128) || (nBits == 256) || (nBits == 512) )
+    {
+        const uint64_t* src   = (const uint64_t*)ptr_src;
+        uint64_t*       dst   = (uint64_t*)ptr_dst;
+        const int32_t   W     = nBits / 64;
+        const int32_t   total = W * nFrames;
+        const int32_t   r     = shift % 64;
+        const __m512i   idxA  = lane_index_avx512(W, shift / 64    );
+        const __m512i   idxB  = lane_index_avx512(W, shift / 64 + 1);
+        int32_t x = 0;
+        for(; x + 8 <= total; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( src + x );
+            const __m512i P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i Q = _mm512_permutexvar_epi64( idxB, A );
+            if( nt ) _mm512_stream_si512( (__m512i*)(dst + x), SHLV_AVX512(P, Q, r) );
+            else     _mm512_storeu_si512( dst + x, SHLV_AVX512(P, Q, r) );
+        }
+        if( x < total )
+        {
+            const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+            const __m512i  A = _mm512_maskz_loadu_epi64( M, src + x );
+            const __m512i  P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i  Q = _mm512_permutexvar_epi64( idxB, A );
+            _mm512_mask_storeu_epi64( dst + x, M, SHLV_AVX512(P, Q, r) );
+        }
+    }
+    else
+    {
+        rotate_copy(ptr_dst, ptr_src, nBits, shift, nFrames, funnel_avx512_select(), stream ? funnel_avx512_select(true) : nullptr, rotate_odd_avx512);
+    }
+
+    if( stream )
+        _mm_sfence();
+}
+
+RSHIFT_TARGET_AVX512 inline void permutation_avx512(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_avx512(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+
+#ifdef RSHIFT_HAS_AVX512_VBMI2
+//
+// permutation_avx512 and rotate_avx512 with vpshldq / vpshldvq whatever the
+// -m flags, bound by rshift.cpp on the CPUs that have VBMI2. They cover the
+// register-resident sizes: 64 to 512 bits packed in zmm as in the AVX-512
+// kernels, and multiples of 512 bits (1024 to 2048 bits for
+// rotate_avx512_vbmi2, see rotate_regs_avx512_vbmi2). The other sizes are
+// forwarded to the AVX-512 kernels.
+//
+RSHIFT_TARGET_AVX512_VBMI2 inline void permutation_avx512_vbmi2(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    if( (nBits == 64) || (nBits == 128) || (nBits == 256) || (nBits == 512) )
+    {
+        const int32_t W         = nBits / 64;
+        const int32_t total     = W * nFrames;
+        const __m512i idx       = lane_index_avx512(W, 1);
+        uint64_t*     bit_array = (uint64_t*)ptr_bit_array;
+        int32_t x = 0;
+        for(; x + 8 <= total; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + x );
+            const __m512i P = _mm512_permutexvar_epi64( idx, A );
+            _mm512_storeu_si512( bit_array + x, _mm512_shldi_epi64(A, P, 1) );
+        }
+        if( x < total )
+        {
+            const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+            const __m512i  A = _mm512_maskz_loadu_epi64( M, bit_array + x );
+            const __m512i  P = _mm512_permutexvar_epi64( idx, A );
+            _mm512_mask_storeu_epi64( bit_array + x, M, _mm512_shldi_epi64(A, P, 1) );
+        }
+    }
+    else if( nBits % 512 == 0 )
+    {
+        // each register takes the top word of the previous one as carry
+        const int32_t regs = nBits / 512;
+        const __m512i idx  = _mm512_setr_epi64(15, 0, 1, 2, 3, 4, 5, 6);
+        for(int32_t f = 0; f < nFrames; f += 1)
+        {
+            uint64_t* bit_array = ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64);
+            __m512i prev = _mm512_loadu_si512( bit_array + 8 * (regs - 1) );
+            for(int32_t r = 0; r < regs; r += 1)
+            {
+                const __m512i A = _mm512_loadu_si512( bit_array + 8 * r );
+                const __m512i P = _mm512_permutex2var_epi64( A, idx, prev );
+                _mm512_storeu_si512( bit_array + 8 * r, _mm512_shldi_epi64(A, P, 1) );
+                prev = A;
+            }
+        }
+    }
+    else
+    {
+        permutation_avx512(ptr_bit_array, nBits, nFrames);
+    }
+}
+
+//
+// Frame of Regs zmm rotated by 0 < shift < 512 Regs. Word j of output
+// register c is word 8 c + j - q of the frame (q = shift / 64): with R[c]
+// the frame register c - q / 8 (modulo Regs), it is lane j - q % 8 + 8 of
+// the pair R[c - 1], R[c] for one vpermt2q, the carry word being the lane
+// before. Every register is loaded before the first store.
+//
+template<int32_t Regs>
+RSHIFT_TARGET_AVX512_VBMI2 inline void rotate_regs_avx512_vbmi2(uint64_t* bit_array, const int32_t shift)
+{
+    const int32_t q    = shift / 64;
+    const __m512i C    = _mm512_set1_epi64( shift % 64 );
+    const __m512i idxP = _mm512_sub_epi64( _mm512_setr_epi64(8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi64(q % 8) );
+    const __m512i idxQ = _mm512_sub_epi64( idxP, _mm512_set1_epi64(1) );
+    __m512i R[Regs];
+
+    #pragma GCC unroll 4
+    for(int32_t c = 0; c < Regs; c += 1)
+        R[c] = _mm512_loadu_si512( bit_array + 8 * ((c - q / 8 < 0) ? c - q / 8 + Regs : c - q / 8) );
+
+    #pragma GCC unroll 4
+    for(int32_t c = 0; c < Regs; c += 1)
+    {
+        const __m512i P = _mm512_permutex2var_epi64( R[(c + Regs - 1) % Regs], idxP, R[c] );
+        const __m512i Q = _mm512_permutex2var_epi64( R[(c + Regs - 1) % Regs], idxQ, R[c] );
+        _mm512_storeu_si512( bit_array + 8 * c, _mm512_shldv_epi64(P, Q, C) );
+    }
+}
+
+RSHIFT_TARGET_AVX512_VBMI2 inline void rotate_avx512_vbmi2(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
+    if( (nBits == 64) || (nBits == 128) || (nBits == 256) || (nBits == 512) )
+    {
+        const int32_t W         = nBits / 64;
+        const int32_t total     = W * nFrames;
+        const __m512i C         = _mm512_set1_epi64( shift % 64 );
+        const __m512i idxA      = lane_index_avx512(W, shift / 64    );
+        const __m512i idxB      = lane_index_avx512(W, shift / 64 + 1);
+        uint64_t*     bit_array = (uint64_t*)ptr_bit_array;
+        int32_t x = 0;
+        for(; x + 8 <= total; x += 8)
+        {
+            const __m512i A = _mm512_loadu_si512( bit_array + x );
+            const __m512i P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i Q = _mm512_permutexvar_epi64( idxB, A );
+            _mm512_storeu_si512( bit_array + x, _mm512_shldv_epi64(P, Q, C) );
+        }
+        if( x < total )
+        {
+            const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+            const __m512i  A = _mm512_maskz_loadu_epi64( M, bit_array + x );
+            const __m512i  P = _mm512_permutexvar_epi64( idxA, A );
+            const __m512i  Q = _mm512_permutexvar_epi64( idxB, A );
+            _mm512_mask_storeu_epi64( bit_array + x, M, _mm512_shldv_epi64(P, Q, C) );
+        }
+    }
+    else if( (nBits == 1024) || (nBits == 1536) || (nBits == 2048) )
+    {
+        void (*kernel)(uint64_t*, const int32_t) = (nBits == 1024) ? rotate_regs_avx512_vbmi2<2>
+                                                 : (nBits == 1536) ? rotate_regs_avx512_vbmi2<3>
+                                                 :                   rotate_regs_avx512_vbmi2<4>;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
+    }
+    else
+    {
+        rotate_avx512(ptr_bit_array, nBits, shift, nFrames);
+    }
+}
+
+//
+// Out-of-place variants: the packed 64- to 512-bit frames, the other sizes
+// going to rotate_avx512 (whose funnel is already the VBMI2 one).
+//
+RSHIFT_TARGET_AVX512_VBMI2 inline void rotate_avx512_vbmi2(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( ((nBits != 64) && (nBits != 128) && (nBits != 256) && (nBits != 512)) || (shift == 0) )
+    {
+        rotate_avx512(ptr_dst, ptr_src, nBits, shift, nFrames, stream);
+        return;
+    }
+
+    const bool      nt    = stream && ((uintptr_t)ptr_dst % 64 == 0);
+    const uint64_t* src   = (const uint64_t*)ptr_src;
+    uint64_t*       dst   = (uint64_t*)ptr_dst;
+    const int32_t   W     = nBits / 64;
+    const int32_t   total = W * nFrames;
+    const __m512i   C     = _mm512_set1_epi64( shift % 64 );
+    const __m512i   idxA  = lane_index_avx512(W, shift / 64    );
+    const __m512i   idxB  = lane_index_avx512(W, shift / 64 + 1);
+    int32_t x = 0;
+    for(; x + 8 <= total; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( src + x );
+        const __m512i P = _mm512_permutexvar_epi64( idxA, A );
+        const __m512i Q = _mm512_permutexvar_epi64( idxB, A );
+        if( nt ) _mm512_stream_si512( (__m512i*)(dst + x), _mm512_shldv_epi64(P, Q, C) );
+        else     _mm512_storeu_si512( dst + x, _mm512_shldv_epi64(P, Q, C) );
+    }
+    if( x < total )
+    {
+        const __mmask8 M = (__mmask8)((1U << (total - x)) - 1);
+        const __m512i  A = _mm512_maskz_loadu_epi64( M, src + x );
+        const __m512i  P = _mm512_permutexvar_epi64( idxA, A );
+        const __m512i  Q = _mm512_permutexvar_epi64( idxB, A );
+        _mm512_mask_storeu_epi64( dst + x, M, _mm512_shldv_epi64(P, Q, C) );
+    }
+    if( stream )
+        _mm_sfence();
+}
+
+RSHIFT_TARGET_AVX512_VBMI2 inline void permutation_avx512_vbmi2(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_avx512_vbmi2(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+#endif
+
+//
+// Rotations toward the low bits, the inverse of permutation_avx512 /
+// rotate_avx512.
+//
+RSHIFT_TARGET_AVX512 inline void rotate_right_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    rotate_avx512(ptr_bit_array, nBits, -(k % nBits), nFrames);
+}
+
+RSHIFT_TARGET_AVX512 inline void permutation_right_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    rotate_avx512(ptr_bit_array, nBits, nBits - 1, nFrames);
+}
+
+//
+// Word kernels of the non-cyclic shifts, eight words per register (see
+// shl_words_sse4 for the in-place ordering).
+//
+RSHIFT_TARGET_AVX512 inline void shl_words_avx512(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    int32_t x = nWords - 8;
+    for(; x >= 1; x -= 8)
+    {
+        const __m512i A = _mm512_loadu_si512( w + x     );
+        const __m512i B = _mm512_loadu_si512( w + x - 1 );
+        _mm512_storeu_si512( w + x, _mm512_or_si512( _mm512_sll_epi64(A, _mm_cvtsi32_si128(k)), _mm512_srl_epi64(B, _mm_cvtsi32_si128(64 - k)) ) );
+    }
+    for(x = x + 7; x >= 1; x -= 1)
+        w[x] = funnel_left(w[x], w[x - 1], k);
+}
+
+RSHIFT_TARGET_AVX512 inline void shr_words_avx512(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    int32_t x = 0;
+    for(; x + 8 < nWords; x += 8)
+    {
+        const __m512i A = _mm512_loadu_si512( w + x     );
+        const __m512i B = _mm512_loadu_si512( w + x + 1 );
+        _mm512_storeu_si512( w + x, _mm512_or_si512( _mm512_srl_epi64(A, _mm_cvtsi32_si128(k)), _mm512_sll_epi64(B, _mm_cvtsi32_si128(64 - k)) ) );
+    }
+    for(; x < nWords - 1; x += 1)
+        w[x] = funnel_right(w[x], w[x + 1], k);
+}
+
+RSHIFT_TARGET_AVX512 inline uint64_t shift_left_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_left_generic(ptr_bit_array, nBits, k, carry_in, shl_words_avx512);
+}
+
+RSHIFT_TARGET_AVX512 inline uint64_t shift_right_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_right_generic(ptr_bit_array, nBits, k, carry_in, shr_words_avx512);
+}
+
+RSHIFT_TARGET_AVX512 inline void rotate_padded_avx512(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( (nBits % 64 == 0) || (nBits == 32) )
+        rotate_avx512(ptr_bit_array, nBits, shift);
+    else if( shift != 0 )
+        rotate_padded_generic(ptr_bit_array, nBits, shift, funnel_avx512_select(), funnel_avx512_padded);
+}
+
+//
+// Circulant kernel (see rshift_circulant_t) on chunks of up to 4 zmm
+// accumulators (32 words), the last chunk of a block using only the V
+// registers it needs: a 5G NR block (Z <= 384) is a single register, the
+// parity block staying in it until its last term. The last register is
+// loaded and stored with a byte mask, its partial byte being merged with
+// the bits already in memory, so no partial chunk goes through the stack.
+//
+template<int32_t V>
+RSHIFT_TARGET_AVX512 inline void circulant_chunk_avx512(uint8_t* dst, const uint64_t* doubled, const int32_t j, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    const int32_t  rest  = (nBits < 512 * V) ? nBits - 512 * (V - 1) : 512;    // bits of the last register
+    const int32_t  bytes = (rest + 7) / 8;
+    const __mmask64 M    = (bytes == 64) ? ~0ULL : (1ULL << bytes) - 1;
+    uint64_t*      out   = (uint64_t*)dst;
+
+    __m512i a[V];
+    for(int32_t v = 0; v < V; v += 1)
+        a[v] = _mm512_setzero_si512();
+    if( accumulate )
+    {
+        for(int32_t v = 0; v < V - 1; v += 1)
+            a[v] = _mm512_loadu_si512( out + 8 * v );
+        a[V - 1] = _mm512_maskz_loadu_epi8( M, out + 8 * (V - 1) );
+    }
+    for(int32_t t = 0; t < nTerms; t += 1)
+    {
+        const uint64_t* s = doubled + terms[t].word + j;
+        const int32_t   b = terms[t].b;
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = _mm512_xor_si512(a[v], SHRV_AVX512(_mm512_loadu_si512( s + 8 * v ), _mm512_loadu_si512( s + 8 * v + 1 ), b));
+    }
+
+    for(int32_t v = 0; v < V - 1; v += 1)
+        _mm512_storeu_si512( out + 8 * v, a[v] );
+    if( rest % 8 != 0 )
+    {
+        const __m512i keep = _mm512_maskz_set1_epi8( 1ULL << (bytes - 1), (char)(0xFF << (rest % 8)) );
+        const __m512i old  = _mm512_maskz_loadu_epi8( M, out + 8 * (V - 1) );
+        a[V - 1] = _mm512_or_si512( _mm512_andnot_si512(keep, a[V - 1]), _mm512_and_si512(keep, old) );
+    }
+    _mm512_mask_storeu_epi8( out + 8 * (V - 1), M, a[V - 1] );
+}
+
+RSHIFT_TARGET_AVX512 inline void circulant_row_avx512(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    for(int32_t j = 0; 64 * j < nBits; j += 4 * 8)
+    {
+        const int32_t rest = nBits - 64 * j;
+        switch( (rest + 64 * 8 - 1) / (64 * 8) )
+        {
+            case  1 : circulant_chunk_avx512<1>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  2 : circulant_chunk_avx512<2>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  3 : circulant_chunk_avx512<3>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            default : circulant_chunk_avx512<4>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+        }
+    }
+}
+
+RSHIFT_TARGET_AVX512 inline void rotate_xor_avx512(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    rotate_xor_generic(ptr_dst, ptr_src, nBits, shift, funnel_avx512_select(), circulant_row_avx512);
+}
+
+//
+// Popcount of the 8 lanes without vpopcntq: nibble lookup then vpsadbw.
+//
+RSHIFT_TARGET_AVX512 inline __m512i popcount_avx512(const __m512i v)
+{
+    const __m512i lut = _mm512_set4_epi32(0x04030302, 0x03020201, 0x03020201, 0x02010100);
+    const __m512i low = _mm512_set1_epi8( 0x0F );
+    const __m512i lo  = _mm512_shuffle_epi8( lut, _mm512_and_si512( v, low ) );
+    const __m512i hi  = _mm512_shuffle_epi8( lut, _mm512_and_si512( _mm512_srli_epi16(v, 4), low ) );
+    return _mm512_sad_epu8( _mm512_add_epi8(lo, hi), _mm512_setzero_si512() );
+}
+
+//
+// Cyclic correlation kernel (see rshift_correlate_t) for CPUs without
+// vpopcntq: Harley-Seal carry-save tree on groups of 4 vectors as in
+// correlate_avx2, a single vpternlogq per adder output.
+//
+RSHIFT_TARGET_AVX512 inline void correlate_avx512(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = rshift_padded_words(nBits);
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o = (nBits - k) % nBits;
+        const uint64_t* s = doubled + o / 64;
+        const int32_t   b = o % 64;
+
+        __m512i v[4];
+        __m512i ones  = _mm512_setzero_si512();
+        __m512i twos  = _mm512_setzero_si512();
+        __m512i fours = _mm512_setzero_si512();
+        __m512i total = _mm512_setzero_si512();
+        int32_t x = 0;
+        for(; x + 32 <= words; x += 32)
+        {
+            for(int32_t i = 0; i < 4; i += 1)
+                v[i] = _mm512_and_si512( _mm512_load_si512( a + x + 8 * i ), SHRV_AVX512(_mm512_loadu_si512( s + x + 8 * i ), _mm512_loadu_si512( s + x + 8 * i + 1 ), b) );
+
+            // majority (0xE8) and parity (0x96) of three inputs
+            const __m512i twos_a = _mm512_ternarylogic_epi64( ones, v[0], v[1], 0xE8 );
+            ones                 = _mm512_ternarylogic_epi64( ones, v[0], v[1], 0x96 );
+            const __m512i twos_b = _mm512_ternarylogic_epi64( ones, v[2], v[3], 0xE8 );
+            ones                 = _mm512_ternarylogic_epi64( ones, v[2], v[3], 0x96 );
+            fours                = _mm512_ternarylogic_epi64( twos, twos_a, twos_b, 0xE8 );
+            twos                 = _mm512_ternarylogic_epi64( twos, twos_a, twos_b, 0x96 );
+            total = _mm512_add_epi64( total, popcount_avx512(fours) );
+        }
+        total = _mm512_slli_epi64( total, 2 );
+        total = _mm512_add_epi64( total, _mm512_slli_epi64( popcount_avx512(twos), 1 ) );
+        total = _mm512_add_epi64( total, popcount_avx512(ones) );
+        for(; x < words; x += 8)
+        {
+            const __m512i w = SHRV_AVX512(_mm512_loadu_si512( s + x ), _mm512_loadu_si512( s + x + 1 ), b);
+            total = _mm512_add_epi64( total, popcount_avx512( _mm512_and_si512( _mm512_load_si512( a + x ), w ) ) );
+        }
+        out[k - k0] = (int32_t)_mm512_reduce_add_epi64( total );
+    }
+}
+
+//
+// Same with vpopcntq: one popcount per vector, in 4 independent
+// accumulators.
+//
+RSHIFT_TARGET_AVX512_POPCNT inline void correlate_avx512_popcnt(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = rshift_padded_words(nBits);
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o = (nBits - k) % nBits;
+        const uint64_t* s = doubled + o / 64;
+        const int32_t   b = o % 64;
+
+        __m512i c[4] = { _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512() };
+        int32_t x = 0;
+        for(; x + 32 <= words; x += 32)
+        {
+            for(int32_t i = 0; i < 4; i += 1)
+            {
+                const __m512i w = SHRV_AVX512(_mm512_loadu_si512( s + x + 8 * i ), _mm512_loadu_si512( s + x + 8 * i + 1 ), b);
+                c[i] = _mm512_add_epi64( c[i], _mm512_popcnt_epi64( _mm512_and_si512( _mm512_load_si512( a + x + 8 * i ), w ) ) );
+            }
+        }
+        for(int32_t i = 0; x < words; x += 8, i += 1)
+        {
+            const __m512i w = SHRV_AVX512(_mm512_loadu_si512( s + x ), _mm512_loadu_si512( s + x + 1 ), b);
+            c[i] = _mm512_add_epi64( c[i], _mm512_popcnt_epi64( _mm512_and_si512( _mm512_load_si512( a + x ), w ) ) );
+        }
+        const __m512i sum = _mm512_add_epi64( _mm512_add_epi64(c[0], c[1]), _mm512_add_epi64(c[2], c[3]) );
+        out[k - k0] = (int32_t)_mm512_reduce_add_epi64( sum );
+    }
+}
+
+//
+// Small frames (see rshift_small_t) of 1, 2, 4 or 8 bytes: 32 frames of up
+// to 16 bits (vpsllvw / vpsrlvw), 16 of up to 32 bits or 8 of up to 64 bits
+// per register, loaded and stored with byte masks (frames of a single byte
+// are widened to 16-bit lanes and narrowed back by vpmovwb). The other
+// frame sizes go through the AVX2 kernel.
+//
+template<int32_t W, int32_t B>    // bytes per lane, bytes per frame
+RSHIFT_TARGET_AVX512 inline void rotate_small_lanes_avx512(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    constexpr int32_t lanes = 64 / W;
+    const uint64_t    m     = (nBits == 64) ? ~0ULL : ((1ULL << nBits) - 1);
+    const __m512i     mask  = (W == 2) ? _mm512_set1_epi16( (int16_t)m ) : (W == 4) ? _mm512_set1_epi32( (int32_t)m ) : _mm512_set1_epi64( (long long)m );
+    const __m512i     top   = (W == 2) ? _mm512_set1_epi16( nBits - 1 ) : (W == 4) ? _mm512_set1_epi32( nBits - 1 ) : _mm512_set1_epi64( nBits - 1 );
+
+    int32_t              j = (int32_t)(first % nShifts);
+    alignas(64) uint16_t k16[32] = { 0 };
+    alignas(64) uint32_t k32[16] = { 0 };
+    alignas(64) uint64_t k64[ 8] = { 0 };
+    const int32_t        k0 = small_shift(shifts[0], nBits);
+    __m512i              c  = (W == 2) ? _mm512_set1_epi16( (int16_t)k0 ) : (W == 4) ? _mm512_set1_epi32( k0 ) : _mm512_set1_epi64( k0 );
+
+    for(int64_t f = 0; f < nFrames; f += lanes)
+    {
+        const int32_t   count = (nFrames - f < lanes) ? (int32_t)(nFrames - f) : lanes;
+        const __mmask64 bytes = (count * B == 64) ? ~0ULL : ((1ULL << (count * B)) - 1);
+        uint8_t*        p     = ptr + f * B;
+        const __m512i   raw   = _mm512_maskz_loadu_epi8( bytes, p );
+        const __m512i   v     = (B == 1) ? _mm512_cvtepu8_epi16( _mm512_castsi512_si256(raw) ) : raw;
+
+        if( nShifts != 1 )
+        {
+            for(int32_t l = 0; l < count; l += 1)
+            {
+                const int32_t k = small_shift(shifts[j], nBits);
+                if( W == 2 )      k16[l] = (uint16_t)k;
+                else if( W == 4 ) k32[l] = (uint32_t)k;
+                else              k64[l] = (uint64_t)k;
+                j = (j + 1 == nShifts) ? 0 : (j + 1);
+            }
+            c = _mm512_load_si512( (W == 2) ? (const void*)k16 : (W == 4) ? (const void*)k32 : (const void*)k64 );
+        }
+
+        const __m512i bits = _mm512_and_si512( v, mask );
+        __m512i       r;
+        if( W == 2 )
+            r = _mm512_or_si512( _mm512_sllv_epi16(bits, c), _mm512_srlv_epi16(_mm512_srli_epi16(bits, 1), _mm512_sub_epi16(top, c)) );
+        else if( W == 4 )
+            r = _mm512_or_si512( _mm512_sllv_epi32(bits, c), _mm512_srlv_epi32(_mm512_srli_epi32(bits, 1), _mm512_sub_epi32(top, c)) );
+        else
+            r = _mm512_or_si512( _mm512_sllv_epi64(bits, c), _mm512_srlv_epi64(_mm512_srli_epi64(bits, 1), _mm512_sub_epi64(top, c)) );
+        r = _mm512_ternarylogic_epi64( r, mask, _mm512_xor_si512(v, bits), 0xEA );    // (r & mask) | pad
+
+        if( B == 1 )
+            _mm512_mask_cvtepi16_storeu_epi8( p, (__mmask32)bytes, r );
+        else
+            _mm512_mask_storeu_epi8( p, bytes, r );
+    }
+}
+
+RSHIFT_TARGET_AVX512 inline void rotate_small_avx512(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    switch( (nBits + 7) / 8 )
+    {
+        case 1  : rotate_small_lanes_avx512<2, 1>(ptr, nBits, nFrames, shifts, nShifts, first); break;
+        case 2  : rotate_small_lanes_avx512<2, 2>(ptr, nBits, nFrames, shifts, nShifts, first); break;
+        case 4  : rotate_small_lanes_avx512<4, 4>(ptr, nBits, nFrames, shifts, nShifts, first); break;
+        case 8  : rotate_small_lanes_avx512<8, 8>(ptr, nBits, nFrames, shifts, nShifts, first); break;
+        default : rotate_small_avx2(ptr, nBits, nFrames, shifts, nShifts, first);               break;
+    }
+}
+
+#ifdef RSHIFT_HAS_AVX512_VBMI
+//
+// Byte permutation of a frame of at most 64 bytes (rshift_permute): one
+// vpermb gathers the bytes, then one gf2p8affineqb permutes the bits inside
+// every byte, matrix byte 7 - i selecting the source bit of output bit i.
+//
+RSHIFT_TARGET_AVX512_VBMI inline void permute_bytes_avx512(uint8_t* dst, const uint8_t* src, const uint8_t* index, const int32_t nIn, const int32_t nOut, const uint64_t matrix)
+{
+    const __mmask64 in  = (nIn  == 64) ? ~0ULL : ((1ULL << nIn ) - 1);
+    const __mmask64 out = (nOut == 64) ? ~0ULL : ((1ULL << nOut) - 1);
+    const __m512i   v   = _mm512_permutexvar_epi8( _mm512_maskz_loadu_epi8( out, index ), _mm512_maskz_loadu_epi8( in, src ) );
+    _mm512_mask_storeu_epi8( dst, out, _mm512_gf2p8affine_epi64_epi8( v, _mm512_set1_epi64( (int64_t)matrix ), 0 ) );
+}
+#endif
+
+#endif
+#endif
@@ -0,0 +1,448 @@
+/*
+ *	Multi-threaded batch rotation of bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_batch.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+//
+// A batch is cut into chunks of about chunk_bytes, and only batches of more
+// than thread_bytes per thread are spread over several threads (below that,
+// waking the workers costs more than the rotations).
+//
+static const int64_t chunk_bytes  = 16 * 1024;
+static const int64_t thread_bytes = 64 * 1024;
+
+struct batch_job
+{
+    uint8_t*       dst;
+    const uint8_t* src;         // nullptr: in place
+    int32_t        nBits;
+    int32_t        nBytes;      // size of a frame
+    const int32_t* shifts;      // nullptr: permutation
+    int32_t        nShifts;
+    bool           stream;
+};
+
+static rshift_small_t select_rotate_small()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return rotate_small_avx512;
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return rotate_small_avx2;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return rotate_small_vec;
+#else
+    return rotate_small_x86;
+#endif
+}
+
+static void run_frames(const void* ctx, const int64_t first, const int64_t count)
+{
+    const batch_job& job = *(const batch_job*)ctx;
+    uint8_t*       dst = job.dst + (size_t)first * job.nBytes;
+    const uint8_t* src = (job.src != nullptr) ? job.src + (size_t)first * job.nBytes : nullptr;
+
+    // in place frames of up to 64 bits: many frames per register
+    if( (job.shifts != nullptr) && (src == nullptr) && (job.nBits <= 64) )
+    {
+        static const rshift_small_t kernel = select_rotate_small();
+        kernel(dst, job.nBits, count, job.shifts, job.nShifts, first);
+        return;
+    }
+
+    if( job.shifts == nullptr )
+    {
+        if( src == nullptr ) permutation(dst,      job.nBits, (int32_t)count);
+        else                 permutation(dst, src, job.nBits, (int32_t)count, job.stream);
+        return;
+    }
+
+    // consecutive frames rotated by the same amount go through a single call
+    for(int64_t f = 0; f < count; )
+    {
+        const int32_t k = job.shifts[(first + f) % job.nShifts];
+        int32_t       n = 1;
+        while( (f + n < count) && (job.shifts[(first + f + n) % job.nShifts] == k) )
+            n += 1;
+        if( src == nullptr ) rotate(dst + (size_t)f * job.nBytes,                                    job.nBits, k, n);
+        else                 rotate(dst + (size_t)f * job.nBytes, src + (size_t)f * job.nBytes, job.nBits, k, n, job.stream);
+        f += n;
+    }
+}
+
+//
+// CPUs the process may run on, those of NUMA node 0 first, then node 1...
+//
+#if defined(__linux__)
+static void parse_cpulist(const char* list, std::vector<bool>& on_node)
+{
+    const char* p = list;
+    while( (*p >= '0') && (*p <= '9') )
+    {
+        char* end;
+        const int32_t first = (int32_t)strtol(p, &end, 10);
+        int32_t       last  = first;
+        if( *end == '-' )
+            last = (int32_t)strtol(end + 1, &end, 10);
+        for(int32_t c = first; (c <= last) && (c < (int32_t)on_node.size()); c += 1)
+            on_node[c] = true;
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+#endif
+
+static std::vector<int32_t> numa_ordered_cpus()
+{
+    std::vector<int32_t> cpus;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if( sched_getaffinity(0, sizeof(allowed), &allowed) == 0 )
+    {
+        std::vector<bool> placed( CPU_SETSIZE, false );
+        for(int32_t node = 0; node < 256; node += 1)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE* f = fopen(path, "r");
+            if( f == nullptr )
+                continue;
+            char list[4096] = { 0 };
+            const bool ok = (fgets(list, sizeof(list), f) != nullptr);
+            fclose( f );
+            if( ok == false )
+                continue;
+
+            std::vector<bool> on_node( CPU_SETSIZE, false );
+            parse_cpulist(list, on_node);
+            for(int32_t c = 0; c < CPU_SETSIZE; c += 1)
+            {
+                if( on_node[c] && CPU_ISSET(c, &allowed) && (placed[c] == false) )
+                {
+                    cpus.push_back( c );
+                    placed[c] = true;
+                }
+            }
+        }
+        // kernels without NUMA support
+        for(int32_t c = 0; c < CPU_SETSIZE; c += 1)
+            if( CPU_ISSET(c, &allowed) && (placed[c] == false) )
+                cpus.push_back( c );
+    }
+#endif
+    if( cpus.empty() )
+    {
+        const int32_t n = std::max(1, (int32_t)std::thread::hardware_concurrency());
+        for(int32_t c = 0; c < n; c += 1)
+            cpus.push_back( -1 );       // not pinned
+    }
+    return cpus;
+}
+
+static void pin_thread(const int32_t cpu)
+{
+#if defined(__linux__)
+    if( cpu < 0 )
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+//
+// Set on the workers and, for the duration of a batch, on the thread that
+// submitted it: a batch function called from a range callback runs inline
+// on that thread instead of waiting for the pool it is part of.
+//
+static thread_local bool in_batch = false;
+
+struct batch_scope
+{
+    batch_scope()  { in_batch = true;  }
+    ~batch_scope() { in_batch = false; }
+};
+
+struct alignas(64) batch_range
+{
+    std::atomic<int64_t> next;
+    int64_t              end;
+};
+
+//
+// Thread 0 is the calling thread, threads 1 to nThreads - 1 are the workers,
+// started at the first batch and waiting for the next one on a condition
+// variable in between.
+//
+struct batch_pool
+{
+    std::mutex                     submit;      // one batch at a time
+    std::mutex                     m;
+    std::condition_variable        wake;
+    std::condition_variable        done;
+    std::vector<std::thread>       workers;
+    std::vector<int32_t>           cpus;
+    std::unique_ptr<batch_range[]> ranges;
+    rshift_range_t                 fn         = nullptr;
+    const void*                    ctx        = nullptr;
+    int64_t                        chunk      = 1;
+    int32_t                        nThreads   = 0;      // 0: not started
+    int32_t                        active     = 0;      // threads working on the current batch
+    int32_t                        pending    = 0;      // workers not done with it yet
+    uint64_t                       generation = 0;
+    bool                           quit       = false;
+
+    ~batch_pool()
+    {
+        stop();
+    }
+
+    int32_t default_threads()
+    {
+        const char* forced = getenv("RSHIFT_THREADS");
+        if( (forced != nullptr) && (atoi(forced) > 0) )
+            return atoi(forced);
+        return (int32_t)numa_ordered_cpus().size();
+    }
+
+    void start(const int32_t n)
+    {
+        cpus     = numa_ordered_cpus();
+        nThreads = (n > 0) ? n : default_threads();
+        ranges.reset( new batch_range[nThreads] );
+        for(int32_t id = 1; id < nThreads; id += 1)
+            workers.emplace_back(&batch_pool::worker, this, id, generation);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            quit = true;
+        }
+        wake.notify_all();
+        for(std::thread& t : workers)
+            t.join();
+        workers.clear();
+        quit     = false;
+        nThreads = 0;
+    }
+
+    // own range first, then the ranges of the next threads
+    void work(const int32_t id)
+    {
+        for(int32_t i = 0; i < active; i += 1)
+        {
+            batch_range& r = ranges[(id + i) % active];
+            for(;;)
+            {
+                const int64_t first = r.next.fetch_add(chunk, std::memory_order_relaxed);
+                if( first >= r.end )
+                    break;
+                fn(ctx, first, std::min(chunk, r.end - first));
+            }
+        }
+    }
+
+    void worker(const int32_t id, uint64_t seen)
+    {
+        in_batch = true;
+        pin_thread( cpus[id % cpus.size()] );
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock, [&]{ return quit || (generation != seen); });
+                if( quit )
+                    return;
+                seen = generation;
+            }
+            if( id < active )
+                work( id );
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if( --pending == 0 )
+                    done.notify_one();
+            }
+        }
+    }
+
+    static void serial(rshift_range_t f, const void* c_ctx, const int64_t nItems, const int64_t c)
+    {
+        for(int64_t first = 0; first < nItems; first += c)
+            f(c_ctx, first, std::min(c, nItems - first));
+    }
+
+    void run(rshift_range_t f, const void* c_ctx, const int64_t nItems, const int64_t itemBytes)
+    {
+        const int64_t c = std::min((int64_t)INT32_MAX, std::max((int64_t)1, chunk_bytes / itemBytes));
+        if( in_batch )
+        {
+            serial(f, c_ctx, nItems, c);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(submit);
+        batch_scope scope;
+        if( nThreads == 0 )
+            start( 0 );
+
+        const int64_t bytes = nItems * itemBytes;
+        const int32_t n     = (int32_t)std::max((int64_t)1, std::min((int64_t)nThreads, bytes / thread_bytes));
+
+        if( n == 1 )
+        {
+            serial(f, c_ctx, nItems, c);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(m);
+            for(int32_t t = 0; t < n; t += 1)
+            {
+                ranges[t].next.store(nItems * t / n, std::memory_order_relaxed);
+                ranges[t].end = nItems * (t + 1) / n;
+            }
+            fn         = f;
+            ctx        = c_ctx;
+            chunk      = c;
+            active     = n;
+            pending    = nThreads - 1;
+            generation += 1;
+        }
+        wake.notify_all();
+
+        work( 0 );
+
+        std::unique_lock<std::mutex> wait(m);
+        done.wait(wait, [&]{ return pending == 0; });
+    }
+
+    void resize(const int32_t n)
+    {
+        if( in_batch )
+        {
+            printf("(EE) rshift_set_threads cannot be called from a batch callback\n");
+            exit( EXIT_FAILURE );
+        }
+        std::lock_guard<std::mutex> lock(submit);
+        stop();
+        start( n );
+    }
+
+    int32_t size()
+    {
+        if( in_batch )
+            return nThreads;    // started, and not resized before the batch ends
+        std::lock_guard<std::mutex> lock(submit);
+        return (nThreads == 0) ? default_threads() : nThreads;
+    }
+};
+
+static batch_pool pool;
+
+static void run_batch(void* dst, const void* src, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const bool stream)
+{
+    if( (nBits <= 0) || (nShifts <= 0) )
+    {
+        printf("(EE) Invalid batch parameters (nBits = %d, nShifts = %d)\n", nBits, nShifts);
+        exit( EXIT_FAILURE );
+    }
+    if( nFrames <= 0 )
+        return;
+
+    batch_job job;
+    job.dst     = (uint8_t*)dst;
+    job.src     = (const uint8_t*)src;
+    job.nBits   = nBits;
+    job.nBytes  = (nBits + 7) / 8;
+    job.shifts  = shifts;
+    job.nShifts = nShifts;
+    job.stream  = stream;
+    pool.run(run_frames, &job, nFrames, job.nBytes);
+}
+
+void permutation_batch(void* ptr_frames, const int32_t nBits, const int64_t nFrames)
+{
+    run_batch(ptr_frames, nullptr, nBits, nFrames, nullptr, 1, false);
+}
+
+void rotate_batch(void* ptr_frames, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts)
+{
+    run_batch(ptr_frames, nullptr, nBits, nFrames, shifts, nShifts, false);
+}
+
+void permutation_batch(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int64_t nFrames, const bool stream)
+{
+    run_batch(ptr_dst, ptr_src, nBits, nFrames, nullptr, 1, stream);
+}
+
+void rotate_batch(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const bool stream)
+{
+    run_batch(ptr_dst, ptr_src, nBits, nFrames, shifts, nShifts, stream);
+}
+
+void rshift_parallel_for(const int64_t nItems, const int64_t itemBytes, rshift_range_t fn, const void* ctx)
+{
+    if( nItems > 0 )
+        pool.run(fn, ctx, nItems, std::max((int64_t)1, itemBytes));
+}
+
+void rshift_set_threads(const int32_t nThreads)
+{
+    pool.resize( nThreads );
+}
+
+int32_t rshift_threads()
+{
+    return pool.size();
+}
@@ -0,0 +1,80 @@
+/*
+ *	Multi-threaded batch rotation of bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_batch_
+#define _rshift_batch_
+
+#include <cstdint>
+
+//
+// Batch entry points for large numbers of independent frames. The nFrames
+// frames of nBits bits are stored back to back as for rotate() and are
+// spread over a persistent pool of worker threads calling the dispatched
+// kernels. Frame f is rotated by shifts[f % nShifts], so nShifts == 1
+// applies the same amount to the whole batch.
+//
+// The frames are split into one contiguous range per thread (the workers
+// are pinned and ordered by NUMA node, so a thread keeps on touching the
+// pages it first touched), processed by chunks of about 16 KiB. A thread
+// that is done with its range steals chunks from the ranges of the other
+// threads, starting with its neighbours. Small batches run on the calling
+// thread only.
+//
+// In place, frames of up to 64 bits (the small lifting sizes of QC-LDPC
+// codes) are not rotated one call at a time: many of them are held in the
+// lanes of one vector register, each lane being rotated within its own
+// nBits by its own amount (8 frames of up to 32 bits per AVX2 register, 32
+// frames of up to 16 bits per AVX-512 register).
+//
+extern void permutation_batch(void* ptr_frames, const int32_t nBits, const int64_t nFrames);
+extern void rotate_batch     (void* ptr_frames, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts = 1);
+
+extern void permutation_batch(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int64_t nFrames, const bool stream = false);
+extern void rotate_batch     (void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts = 1, const bool stream = false);
+
+//
+// Runs fn(ctx, first, count) on consecutive ranges covering [0, nItems) with
+// the pool and the scheduling of the batch functions, itemBytes being the
+// memory footprint of an item (ranges of about 16 KiB). Returns once every
+// range is processed. Used by the kernels working on single huge arrays.
+//
+// fn may itself call the batch functions, rshift_parallel_for or the kernels
+// built on it (rotate_large, correlate...): such nested calls run serially on
+// the thread of the callback, the pool being busy with the outer batch.
+//
+typedef void (*rshift_range_t)(const void* ctx, const int64_t first, const int64_t count);
+
+extern void rshift_parallel_for(const int64_t nItems, const int64_t itemBytes, rshift_range_t fn, const void* ctx);
+
+//
+// Number of threads of the pool, the calling thread included. It defaults
+// to the number of CPUs the process may run on, or to the value of the
+// RSHIFT_THREADS environment variable. Changing it restarts the pool, which
+// is an error from within a range callback.
+//
+extern void    rshift_set_threads(const int32_t nThreads);
+extern int32_t rshift_threads    ();
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ *	Aligned bit arrays and their allocator - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_bitset.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef void (*rotate_padded_t)(void*, const int32_t, const int32_t);
+
+static rotate_padded_t select_rotate_padded()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return rotate_padded_avx512;
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return rotate_padded_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return rotate_padded_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return rotate_padded_vec;
+#else
+    return rotate_padded_x86;
+#endif
+}
+
+void rotate_padded(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    static const rotate_padded_t kernel = select_rotate_padded();
+    kernel(ptr_bit_array, nBits, k);
+}
+
+rshift_arena::rshift_arena(const bool shared)
+    : shared( shared ), cursor( nullptr ), remaining( 0 )
+{
+    for(size_t i = 0; i < max_lines; i += 1)
+        free_list[i] = nullptr;
+}
+
+rshift_arena::~rshift_arena()
+{
+    for(void* slab : slabs)
+        free( slab );
+}
+
+rshift_arena& rshift_arena::global()
+{
+    static rshift_arena arena( true );
+    return arena;
+}
+
+//
+// The free blocks are chained through their first word.
+//
+void* rshift_arena::allocate_lines(const size_t lines)
+{
+    void* block = free_list[lines - 1];
+    if( block != nullptr )
+    {
+        free_list[lines - 1] = *(void**)block;
+        return block;
+    }
+
+    const size_t nBytes = lines * line_bytes;
+    if( remaining < nBytes )
+    {
+        cursor = (uint8_t*)aligned_alloc(line_bytes, slab_bytes);
+        if( cursor == nullptr )
+        {
+            printf("(EE) rshift_arena: out of memory (%zu bytes)\n", slab_bytes);
+            exit( EXIT_FAILURE );
+        }
+        slabs.push_back( cursor );
+        remaining = slab_bytes;
+    }
+    block      = cursor;
+    cursor    += nBytes;
+    remaining -= nBytes;
+    return block;
+}
+
+void* rshift_arena::allocate(const size_t nBytes)
+{
+    const size_t lines = (nBytes + line_bytes - 1) / line_bytes;
+    if( lines > max_lines )
+    {
+        void* block = aligned_alloc(line_bytes, lines * line_bytes);
+        if( block == nullptr )
+        {
+            printf("(EE) rshift_arena: out of memory (%zu bytes)\n", lines * line_bytes);
+            exit( EXIT_FAILURE );
+        }
+        return block;
+    }
+
+    if( shared == false )
+        return allocate_lines( lines == 0 ? 1 : lines );
+    std::lock_guard<std::mutex> guard( lock );
+    return allocate_lines( lines == 0 ? 1 : lines );
+}
+
+void rshift_arena::release(void* ptr, const size_t nBytes)
+{
+    if( ptr == nullptr )
+        return;
+
+    const size_t lines = (nBytes + line_bytes - 1) / line_bytes;
+    if( lines > max_lines )
+    {
+        free( ptr );
+        return;
+    }
+
+    const size_t index = (lines == 0 ? 1 : lines) - 1;
+    if( shared == false )
+    {
+        *(void**)ptr     = free_list[index];
+        free_list[index] = ptr;
+        return;
+    }
+    std::lock_guard<std::mutex> guard( lock );
+    *(void**)ptr     = free_list[index];
+    free_list[index] = ptr;
+}
@@ -0,0 +1,204 @@
+/*
+ *	Aligned bit arrays and their allocator - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_bitset_
+#define _rshift_bitset_
+
+#include "rshift_common.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//
+// In-place rotation (bit i moves to bit (i + k) % nBits) of a padded array:
+// 64-byte aligned, rshift_padded_words(nBits) words long and with the bits
+// past nBits at 0. The kernel is chosen once from rshift_isa_level(); it
+// stores whole aligned vectors and has no partial word to merge.
+//
+extern void rotate_padded(void* ptr_bit_array, const int32_t nBits, const int32_t k);
+
+//
+// Allocator of 64-byte aligned blocks for the bit arrays created and
+// destroyed on every frame. Requests are rounded up to cache lines; up to
+// 16 KiB a block comes from the free list of its size, or else is cut from
+// a 256 KiB slab, and goes back to that list when released. The slabs are
+// only returned to the system by the destructor. Larger blocks are plain
+// aligned_alloc/free.
+//
+// The global() arena is shared by the threads (one mutex); an arena built
+// with shared = false has no locking and must stay on a single thread.
+//
+class rshift_arena
+{
+public:
+    explicit rshift_arena(const bool shared = true);
+    ~rshift_arena();
+
+    rshift_arena(const rshift_arena&)            = delete;
+    rshift_arena& operator=(const rshift_arena&) = delete;
+
+    void* allocate(const size_t nBytes);
+    void  release (void* ptr, const size_t nBytes);
+
+    static rshift_arena& global();
+
+private:
+    static const size_t line_bytes = 64;
+    static const size_t max_lines  = 256;              // 16 KiB
+    static const size_t slab_bytes = 256 * 1024;
+
+    void* allocate_lines(const size_t lines);
+
+    std::mutex          lock;
+    const bool          shared;
+    void*               free_list[max_lines];
+    std::vector<void*>  slabs;
+    uint8_t*            cursor;
+    size_t              remaining;
+};
+
+//
+// Bit array of N bits stored in the object itself: 64-byte aligned, padded
+// to whole cache lines (the widest vector) and with the padding kept at 0.
+//
+template<int32_t N> class rshift_bitset
+{
+public:
+    static constexpr int32_t words = rshift_padded_words(N);
+
+    rshift_bitset() { clear(); }
+
+    static constexpr int32_t nBits() { return N; }
+
+    bool test (const int32_t i) const { return (w[i / 64] >> (i % 64)) & 1; }
+    void set  (const int32_t i)       { w[i / 64] |=  (1ULL << (i % 64)); }
+    void reset(const int32_t i)       { w[i / 64] &= ~(1ULL << (i % 64)); }
+    void clear()                      { memset(w, 0, sizeof(w)); }
+
+    uint64_t*       data()       { return w; }
+    const uint64_t* data() const { return w; }
+
+    void rotate      (const int32_t k) { rotate_padded(w, N, k);         }
+    void rotate_right(const int32_t k) { rotate_padded(w, N, -(k % N));  }
+    void permutation ()                { rotate_padded(w, N, 1);         }
+
+    bool operator==(const rshift_bitset& o) const { return memcmp(w, o.w, sizeof(w)) == 0; }
+    bool operator!=(const rshift_bitset& o) const { return !(*this == o); }
+
+private:
+    alignas(64) uint64_t w[words];
+};
+
+//
+// Same as rshift_bitset with the size chosen at runtime and the storage
+// taken from an arena (the global one by default).
+//
+class rshift_dynamic_bitset
+{
+public:
+    explicit rshift_dynamic_bitset(const int32_t nBits, rshift_arena& arena = rshift_arena::global())
+        : size( nBits ), words( rshift_padded_words(nBits) ), pool( &arena )
+    {
+        w = (uint64_t*)pool->allocate( bytes() );
+        clear();
+    }
+
+    rshift_dynamic_bitset(const rshift_dynamic_bitset& o)
+        : size( o.size ), words( o.words ), pool( o.pool )
+    {
+        w = (uint64_t*)pool->allocate( bytes() );
+        memcpy(w, o.w, bytes());
+    }
+
+    rshift_dynamic_bitset(rshift_dynamic_bitset&& o) noexcept
+        : size( o.size ), words( o.words ), pool( o.pool ), w( o.w )
+    {
+        o.w = nullptr;
+    }
+
+    rshift_dynamic_bitset& operator=(const rshift_dynamic_bitset& o)
+    {
+        if( this != &o )
+        {
+            rshift_dynamic_bitset tmp( o );
+            swap( tmp );
+        }
+        return *this;
+    }
+
+    rshift_dynamic_bitset& operator=(rshift_dynamic_bitset&& o) noexcept
+    {
+        swap( o );
+        return *this;
+    }
+
+    ~rshift_dynamic_bitset()
+    {
+        if( w != nullptr )
+            pool->release(w, bytes());
+    }
+
+    void swap(rshift_dynamic_bitset& o) noexcept
+    {
+        std::swap(size,  o.size );
+        std::swap(words, o.words);
+        std::swap(pool,  o.pool );
+        std::swap(w,     o.w    );
+    }
+
+    int32_t nBits() const { return size; }
+
+    bool test (const int32_t i) const { return (w[i / 64] >> (i % 64)) & 1; }
+    void set  (const int32_t i)       { w[i / 64] |=  (1ULL << (i % 64)); }
+    void reset(const int32_t i)       { w[i / 64] &= ~(1ULL << (i % 64)); }
+    void clear()                      { memset(w, 0, bytes()); }
+
+    uint64_t*       data()       { return w; }
+    const uint64_t* data() const { return w; }
+
+    void rotate      (const int32_t k) { rotate_padded(w, size, k);            }
+    void rotate_right(const int32_t k) { rotate_padded(w, size, -(k % size));  }
+    void permutation ()                { rotate_padded(w, size, 1);            }
+
+    bool operator==(const rshift_dynamic_bitset& o) const
+    {
+        return (size == o.size) && (memcmp(w, o.w, bytes()) == 0);
+    }
+    bool operator!=(const rshift_dynamic_bitset& o) const { return !(*this == o); }
+
+private:
+    size_t bytes() const { return (size_t)words * sizeof(uint64_t); }
+
+    int32_t       size;
+    int32_t       words;
+    rshift_arena* pool;
+    uint64_t*     w;
+};
+
+#endif
@@ -0,0 +1,739 @@
+/*
+ *	Optimized bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_common_
+#define _rshift_common_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+//
+// With GCC/clang on x86 every SIMD kernel is compiled whatever the -m flags,
+// each one under its own target attribute, so that a single binary carries
+// all of them and rshift.cpp selects the best one at runtime. Otherwise a
+// kernel only exists when the matching ISA is enabled at compile time. The
+// AVX-512 level is AVX512F + AVX512BW (byte masks of the bit_pack kernels).
+//
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define RSHIFT_X86_DISPATCH
+    #define RSHIFT_TARGET_SSE4   __attribute__((target("sse4.2")))
+    #define RSHIFT_TARGET_AVX2   __attribute__((target("avx2")))
+    #define RSHIFT_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+    #define RSHIFT_TARGET_POPCNT __attribute__((target("sse4.2,popcnt")))
+    #define RSHIFT_TARGET_AVX512_POPCNT __attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+    #define RSHIFT_TARGET_AVX512_VBMI   __attribute__((target("avx512f,avx512bw,avx512vbmi,gfni")))
+    #define RSHIFT_TARGET_AVX512_VBMI2  __attribute__((target("avx512f,avx512bw,avx512vbmi2")))
+    #define RSHIFT_TARGET_BMI2          __attribute__((target("bmi2")))
+#else
+    #define RSHIFT_TARGET_SSE4
+    #define RSHIFT_TARGET_AVX2
+    #define RSHIFT_TARGET_AVX512
+    #define RSHIFT_TARGET_POPCNT
+    #define RSHIFT_TARGET_AVX512_POPCNT
+    #define RSHIFT_TARGET_AVX512_VBMI
+    #define RSHIFT_TARGET_AVX512_VBMI2
+    #define RSHIFT_TARGET_BMI2
+#endif
+
+//
+// The AVX-512 intrinsics pass an intentionally undefined vector (__Y = __Y)
+// as the merge operand, which GCC reports as uninitialized once they are
+// inlined into a target function. The header is included here first, with
+// those two warnings silenced for its own lines only.
+//
+#if defined(RSHIFT_X86_DISPATCH) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    #include <immintrin.h>
+    #pragma GCC diagnostic pop
+#endif
+
+#if defined(RSHIFT_X86_DISPATCH) || defined(__SSE4_2__)
+    #define RSHIFT_HAS_SSE4
+#endif
+#if defined(RSHIFT_X86_DISPATCH) || defined(__AVX2__)
+    #define RSHIFT_HAS_AVX2
+#endif
+#if defined(RSHIFT_X86_DISPATCH) || (defined(__AVX512F__) && defined(__AVX512BW__))
+    #define RSHIFT_HAS_AVX512
+#endif
+// vpopcntq, not part of the AVX-512 level (Ice Lake and later, Zen 4)
+#if defined(RSHIFT_X86_DISPATCH) || (defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VPOPCNTDQ__))
+    #define RSHIFT_HAS_AVX512_POPCNT
+#endif
+// vpermb + gf2p8affineqb (Ice Lake and later, Zen 4)
+#if defined(RSHIFT_X86_DISPATCH) || (defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VBMI__) && defined(__GFNI__))
+    #define RSHIFT_HAS_AVX512_VBMI
+#endif
+// vpshldq / vpshrdvq funnel shifts (Ice Lake and later, Zen 4)
+#if defined(RSHIFT_X86_DISPATCH) || (defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VBMI2__))
+    #define RSHIFT_HAS_AVX512_VBMI2
+#endif
+// pext / pdep (Haswell and later; microcoded, thus slow, before Zen 3)
+#if defined(RSHIFT_X86_DISPATCH) || defined(__BMI2__)
+    #define RSHIFT_HAS_BMI2
+#endif
+
+//
+// Funnel copy used by the rotation kernels of every backend:
+//
+//     dst[x] = (src[x] >> b) | (src[x + 1] << (64 - b))     0 <= b < 64
+//
+// i.e. nWords words read from src starting at bit offset b. src[nWords] may
+// be read even when b == 0, callers keep one readable word after the range.
+//
+typedef void (*rshift_funnel_t)(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b);
+
+//
+// Writes to tmp (2 * words words) the nBits bits of src twice in a row, the
+// second copy starting exactly at bit nBits, the bits past 2 * nBits being
+// 0. Only the (nBits + 7) / 8 bytes of src are read.
+//
+inline void double_bits(uint64_t* tmp, const void* ptr_src, const int32_t nBits, rshift_funnel_t funnel)
+{
+    const int32_t words  = (nBits + 63) / 64;
+    const int32_t tail   = nBits % 64;
+
+    tmp[words - 1] = 0;
+    memcpy(tmp, ptr_src, (nBits + 7) / 8);
+
+    if( tail == 0 )
+    {
+        memcpy(tmp + words, tmp, words * sizeof(uint64_t));
+    }
+    else
+    {
+        tmp[words - 1] &= (1ULL << tail) - 1;
+        const uint64_t last = tmp[words - 1];
+        funnel(tmp + words, tmp, words - 1, 64 - tail);
+        tmp[2 * words - 1] = last >> (64 - tail);
+        tmp[words - 1]     = last | (tmp[0] << tail);
+    }
+}
+
+//
+// Scratch words of the calling thread, for the frames too large for the
+// stack buffers of the kernels: grown on demand, 64-byte aligned, released
+// when the thread exits. A kernel holding it must not call another one that
+// uses it.
+//
+inline uint64_t* rshift_scratch(const size_t nWords)
+{
+    thread_local std::vector<uint64_t> buffer;
+    if( buffer.size() < nWords + 8 )
+        buffer.resize( nWords + 8 );
+    return (uint64_t*)(((uintptr_t)buffer.data() + 63) & ~(uintptr_t)63);
+}
+
+//
+// Loads and stores of 1 <= n <= 8 bytes as a little-endian word, through
+// two overlapping 4-byte accesses or three single bytes (no loop).
+//
+inline uint64_t load_bytes(const uint8_t* src, const int32_t n)
+{
+    if( n >= 4 )
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, src,         4);
+        memcpy(&hi, src + n - 4, 4);
+        return lo | ((uint64_t)hi << (8 * (n - 4)));
+    }
+    return (uint64_t)src[0] | ((uint64_t)src[n / 2] << (8 * (n / 2))) | ((uint64_t)src[n - 1] << (8 * (n - 1)));
+}
+
+inline void store_bytes(uint8_t* dst, const int32_t n, const uint64_t value)
+{
+    if( n >= 4 )
+    {
+        const uint32_t lo = (uint32_t)value;
+        const uint32_t hi = (uint32_t)(value >> (8 * (n - 4)));
+        memcpy(dst + n - 4, &hi, 4);
+        memcpy(dst,         &lo, 4);
+        return;
+    }
+    dst[n - 1] = (uint8_t)(value >> (8 * (n - 1)));
+    dst[n / 2] = (uint8_t)(value >> (8 * (n / 2)));
+    dst[0]     = (uint8_t)value;
+}
+
+//
+// The nBits % 64 != 0 bits of the last, partial word of a frame (word nBits
+// / 64), read without touching the bytes past (nBits + 7) / 8, and written
+// back keeping the bits past nBits of the last byte. Both make the same
+// accesses, so that a load of the tail just stored is forwarded.
+//
+inline uint64_t load_tail(const void* ptr_src, const int32_t nBits)
+{
+    const int32_t bytes = (nBits % 64 + 7) / 8;
+    return load_bytes((const uint8_t*)ptr_src + 8 * (nBits / 64), bytes) & ((1ULL << (nBits % 64)) - 1);
+}
+
+inline void store_tail(void* ptr_dst, const int32_t nBits, const uint64_t value)
+{
+    const int32_t bytes = (nBits % 64 + 7) / 8;
+    uint8_t*      dst   = (uint8_t*)ptr_dst + 8 * (nBits / 64);
+    uint64_t      word  = value & ((1ULL << (nBits % 64)) - 1);
+    if( nBits % 8 != 0 )
+        word |= (uint64_t)(dst[bytes - 1] & (0xFF << (nBits % 8))) << (8 * (bytes - 1));
+    store_bytes(dst, bytes, word);
+}
+
+//
+// Rotation by 0 <= shift < nBits of any nBits, read straight from src.
+// Output word x starts at bit (64 * x - shift) mod nBits of src:
+//
+//   - the words below bit shift are one funnel copy from bit nBits - shift,
+//     but for the last two or three ones that reach the partial word of src
+//     or wrap around its end (the seam), which are assembled one by one,
+//   - the words above are a second funnel copy from bit 64 * x - shift.
+//
+// Every full word of dst is written once, the funnel ones (all but a few)
+// possibly with non-temporal stores, and no word past the full ones of src
+// is loaded. The last, partial output word is returned, not written.
+//
+inline uint64_t rotate_body(uint64_t* __restrict dst, const uint64_t* __restrict src, const int32_t nBits, const int32_t shift, rshift_funnel_t funnel)
+{
+    const int32_t  full = nBits / 64;
+    const uint64_t last = (nBits % 64 != 0) ? load_tail(src, nBits) : 0;
+    if( shift == 0 )
+    {
+        memcpy(dst, src, 8 * (size_t)full);
+        return last;
+    }
+
+    auto load = [&](const int32_t q) -> uint64_t
+    {
+        return (q < full) ? src[q] : (q == full) ? last : 0;
+    };
+    auto bits = [&](const int32_t pos) -> uint64_t
+    {
+        const int32_t q = pos / 64;
+        const int32_t b = pos % 64;
+        return (b == 0) ? load(q) : (load(q) >> b) | (load(q + 1) << (64 - b));
+    };
+    const int32_t offset = nBits - shift;
+    auto word = [&](const int32_t x) -> uint64_t
+    {
+        const int32_t pos = offset + 64 * x;
+        if( pos >= nBits )
+            return bits(pos - nBits);
+        const uint64_t lo = bits(pos);
+        return (pos + 64 <= nBits) ? lo : lo | (load(0) << (nBits - pos));
+    };
+
+    const int32_t below = ((shift + 63) / 64 < full) ? (shift + 63) / 64 : full;
+    const int32_t quick = (full - 1 - offset / 64 < below) ? full - 1 - offset / 64 : below;
+    if( quick > 0 )
+        funnel(dst, src + offset / 64, quick, offset % 64);
+    for(int32_t x = (quick > 0) ? quick : 0; x < below; x += 1)
+        dst[x] = word(x);
+    if( below < full )
+        funnel(dst + below, src, full - below, 64 * below - shift);
+
+    return word(full);
+}
+
+//
+// Out-of-place and in-place rotations of a frame of any nBits by 0 <= shift
+// < nBits. The bits past nBits of the last byte of the destination are
+// kept. In place, the words are rotated into a temporary buffer (on the
+// stack, or the thread's scratch for large frames) and copied back once.
+//
+inline void rotate_generic(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t shift, rshift_funnel_t funnel)
+{
+    const uint64_t last = rotate_body((uint64_t*)ptr_dst, (const uint64_t*)ptr_src, nBits, shift, funnel);
+    if( nBits % 64 != 0 )
+        store_tail(ptr_dst, nBits, last);
+}
+
+inline void rotate_generic(void* ptr_bit_array, const int32_t nBits, const int32_t shift, rshift_funnel_t funnel)
+{
+    const int32_t full = nBits / 64;
+
+    uint64_t  stack_buffer[128];
+    uint64_t* tmp = (full <= 128) ? stack_buffer : rshift_scratch(full);
+
+    const uint64_t last = rotate_body(tmp, (const uint64_t*)ptr_bit_array, nBits, shift, funnel);
+    memcpy(ptr_bit_array, tmp, 8 * (size_t)full);
+    if( nBits % 64 != 0 )
+        store_tail(ptr_bit_array, nBits, last);
+}
+
+//
+// Runtime entry points: every multiple of 64 bits up to RSHIFT_SIZED_BITS
+// goes to the compile-time sized template of the backend, through a table
+// indexed by nBits / 64 - 1 that RSHIFT_SIZED_TABLES(isa) instantiates once
+// the templates are declared (rotate_isa_sized(nBits), permutation_isa_sized
+// (nBits)). Larger frames go through rotate_generic.
+//
+#define RSHIFT_SIZED_BITS 2048
+
+typedef void (*rshift_sized_permutation_t)(void* ptr_bit_array);
+typedef void (*rshift_sized_rotate_t     )(void* ptr_bit_array, const int32_t k);
+
+//
+// Rotation by 0 <= shift < nBits of one frame of nBits % 64 != 0 bits, up
+// to RSHIFT_SIZED_BITS, dst == src being allowed (rotate_odd_avx2 and
+// rotate_odd_avx512). The other backends use rotate_generic.
+//
+typedef void (*rshift_odd_t)(uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t shift);
+
+#define RSHIFT_SIZED_TABLES(ISA)                                                                            \
+    template<int32_t... W>                                                                                  \
+    inline const rshift_sized_permutation_t* permutation_##ISA##_table(std::integer_sequence<int32_t, W...>) \
+    {                                                                                                       \
+        static constexpr rshift_sized_permutation_t table[] = { permutation_##ISA<64 * (W + 1)>... };        \
+        return table;                                                                                       \
+    }                                                                                                       \
+    template<int32_t... W>                                                                                  \
+    inline const rshift_sized_rotate_t* rotate_##ISA##_table(std::integer_sequence<int32_t, W...>)           \
+    {                                                                                                       \
+        static constexpr rshift_sized_rotate_t table[] = { rotate_##ISA<64 * (W + 1)>... };                  \
+        return table;                                                                                       \
+    }                                                                                                       \
+    inline rshift_sized_permutation_t permutation_##ISA##_sized(const int32_t nBits)                         \
+    {                                                                                                       \
+        return permutation_##ISA##_table(std::make_integer_sequence<int32_t, RSHIFT_SIZED_BITS / 64>())[nBits / 64 - 1]; \
+    }                                                                                                       \
+    inline rshift_sized_rotate_t rotate_##ISA##_sized(const int32_t nBits)                                   \
+    {                                                                                                       \
+        return rotate_##ISA##_table(std::make_integer_sequence<int32_t, RSHIFT_SIZED_BITS / 64>())[nBits / 64 - 1]; \
+    }
+
+//
+// Out-of-place rotation by 0 < shift < 64 * words of a frame made of whole
+// words. dst word x starts at bit 64 * words - shift + 64 * x of src taken
+// circularly: one funnel copy up to the word that straddles the end of src,
+// that seam word, then a second funnel copy from the start of src. Nothing
+// is copied to a temporary buffer and src is never read past its end.
+//
+inline void rotate_words(uint64_t* __restrict dst, const uint64_t* __restrict src, const int32_t words, const int32_t shift, rshift_funnel_t funnel)
+{
+    const int32_t offset = 64 * words - shift;
+    const int32_t q      = offset / 64;
+    const int32_t b      = offset % 64;
+    const int32_t seam   = words - 1 - q;
+
+    funnel(dst, src + q, seam, b);
+    dst[seam] = (b == 0) ? src[words - 1] : (src[words - 1] >> b) | (src[0] << (64 - b));
+    funnel(dst + seam + 1, src, q, b);
+}
+
+//
+// Out-of-place rotation of nFrames contiguous frames by 0 <= shift < nBits,
+// shared by the (dst, src) entry points of all the backends.
+//
+// With a non-temporal funnel_stream, the frames are rotated by chunks of
+// about 16 KiB into the thread's scratch with the regular funnel, each chunk
+// then being streamed to dst as one run of whole cache lines: per frame
+// non-temporal stores would leave partial lines, shared with the seam and
+// tail stores and with the next frame, which is several times slower than
+// regular stores. Outputs smaller than a chunk gain nothing from bypassing
+// the caches and frames with padding bits (nBits % 8 != 0) cannot be copied
+// as whole bytes: both use regular stores. The caller issues the sfence.
+// Frames of nBits % 64 != 0 bits go through the odd kernel of the backend
+// when it has one and they are small enough for it.
+//
+inline void rotate_copy(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t shift, const int32_t nFrames, rshift_funnel_t funnel, rshift_funnel_t funnel_stream = nullptr, rshift_odd_t odd = nullptr)
+{
+    const int32_t nBytes = (nBits + 7) / 8;
+    if( (funnel_stream != nullptr) && (nBits % 8 == 0) && ((size_t)nFrames * nBytes >= 16384) )
+    {
+        const int32_t chunk = (16384 / nBytes >= 16) ? 16384 / nBytes / 8 * 8 : 8;
+        uint64_t*     tmp   = rshift_scratch( (size_t)chunk * nBytes / 8 + 1 );
+        for(int32_t f = 0; f < nFrames; f += chunk)
+        {
+            const int32_t n     = (nFrames - f < chunk) ? nFrames - f : chunk;
+            const size_t  bytes = (size_t)n * nBytes;
+            uint8_t*      dst   = (uint8_t*)ptr_dst + (size_t)f * nBytes;
+            tmp[bytes / 8] = 0;
+            rotate_copy(tmp, (const uint8_t*)ptr_src + (size_t)f * nBytes, nBits, shift, n, funnel, nullptr, odd);
+            funnel_stream((uint64_t*)dst, tmp, (int32_t)(bytes / 8), 0);
+            memcpy(dst + bytes / 8 * 8, (const uint8_t*)tmp + bytes / 8 * 8, bytes % 8);
+        }
+    }
+    else if( (nBits % 64 != 0) && (odd != nullptr) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        for(int32_t f = 0; f < nFrames; f += 1)
+            odd(((uint8_t*)ptr_dst) + (size_t)f * nBytes, ((const uint8_t*)ptr_src) + (size_t)f * nBytes, nBits, shift);
+    }
+    else if( nBits % 64 != 0 )
+    {
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_dst) + (size_t)f * nBytes, ((const uint8_t*)ptr_src) + (size_t)f * nBytes, nBits, shift, funnel);
+    }
+    else if( shift == 0 )
+    {
+        memcpy(ptr_dst, ptr_src, (size_t)nFrames * nBytes);
+    }
+    else
+    {
+        const int32_t words = nBits / 64;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_words(((uint64_t*)ptr_dst) + (size_t)f * words, ((const uint64_t*)ptr_src) + (size_t)f * words, words, shift, funnel);
+    }
+}
+
+//
+// Non-cyclic shifts by 0 < k <= 64 bits with carry (shift_left_* and
+// shift_right_* of every backend). The backends provide the word kernels:
+//
+//     shl: w[x] = (w[x] << k) | (w[x - 1] >> (64 - k))    x = nWords - 1 .. 1
+//     shr: w[x] = (w[x] >> k) | (w[x + 1] << (64 - k))    x = 0 .. nWords - 2
+//
+// run in place (descending resp. ascending), k == 64 moving whole words.
+//
+typedef void (*rshift_words_t)(uint64_t* w, const int32_t nWords, const int32_t k);
+
+inline uint64_t funnel_left (const uint64_t hi, const uint64_t lo, const int32_t k)
+{
+    return (k == 64) ? lo : (hi << k) | (lo >> (64 - k));
+}
+
+inline uint64_t funnel_right(const uint64_t lo, const uint64_t hi, const int32_t k)
+{
+    return (k == 64) ? hi : (lo >> k) | (hi << (64 - k));
+}
+
+inline void check_shift_amount(const int32_t nBits, const int32_t k)
+{
+    if( (k < 0) || (k > 64) || (k > nBits) )
+    {
+        printf("(EE) The shift amount must satisfy 0 <= k <= 64 and k <= nBits (k = %d, nBits = %d) !\n", k, nBits);
+        exit( EXIT_FAILURE );
+    }
+}
+
+//
+// Shift toward the high bits: bit i moves to i + k, bits 0..k-1 receive the
+// k low bits of carry_in and the k bits pushed out of the top are returned
+// (in the low bits). Calling it on consecutive buffers from the lowest one,
+// each time with the carry returned by the previous call, shifts them as a
+// single big integer. Bits past nBits are left untouched.
+//
+inline uint64_t shift_left_generic(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in, rshift_words_t shl)
+{
+    check_shift_amount(nBits, k);
+    if( k == 0 )
+        return 0;
+
+    const int32_t full   = nBits / 64;
+    const int32_t tail   = nBits % 64;
+    const int32_t nBytes = (nBits + 7) / 8;
+    const uint64_t kmask = (k == 64) ? ~0ULL : (1ULL << k) - 1;
+    uint64_t* w = (uint64_t*)ptr_bit_array;
+
+    uint64_t old = 0;
+    uint64_t top = 0;
+    if( tail != 0 )
+    {
+        memcpy(&old, w + full, nBytes - 8 * full);
+        top = old & ((1ULL << tail) - 1);
+    }
+
+    // carry out: bits nBits - k .. nBits - 1
+    const int32_t  p   = nBits - k;
+    const uint64_t lo  = (p / 64 < full) ? w[p / 64] : top;
+    const uint64_t hi  = (p / 64 + 1 < full) ? w[p / 64 + 1] : ((p / 64 + 1 == full) ? top : 0);
+    const uint64_t out = ((p % 64 == 0) ? lo : (lo >> (p % 64)) | (hi << (64 - p % 64))) & kmask;
+
+    const uint64_t below = (k == 64) ? carry_in : carry_in << (64 - k);
+    if( tail != 0 )
+    {
+        const uint64_t mask   = (1ULL << tail) - 1;
+        const uint64_t value  = funnel_left(top, (full > 0) ? w[full - 1] : below, k);
+        const uint64_t merged = (value & mask) | (old & ~mask);
+        memcpy(w + full, &merged, nBytes - 8 * full);
+    }
+    if( full > 0 )
+    {
+        shl(w, full, k);
+        w[0] = funnel_left(w[0], below, k);
+    }
+    return out;
+}
+
+//
+// Shift toward the low bits: bit i moves to i - k, bits nBits - k .. nBits - 1
+// receive the k low bits of carry_in and the k bits pushed out of the bottom
+// are returned. Chained from the highest buffer down it shifts a big integer
+// spread over several buffers. Bits past nBits are left untouched.
+//
+inline uint64_t shift_right_generic(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in, rshift_words_t shr)
+{
+    check_shift_amount(nBits, k);
+    if( k == 0 )
+        return 0;
+
+    const int32_t full   = nBits / 64;
+    const int32_t tail   = nBits % 64;
+    const int32_t nBytes = (nBits + 7) / 8;
+    const uint64_t kmask = (k == 64) ? ~0ULL : (1ULL << k) - 1;
+    uint64_t* w = (uint64_t*)ptr_bit_array;
+
+    uint64_t old = 0;
+    uint64_t top = 0;
+    if( tail != 0 )
+    {
+        memcpy(&old, w + full, nBytes - 8 * full);
+        top = old & ((1ULL << tail) - 1);
+    }
+
+    // carry out: bits 0 .. k - 1
+    const uint64_t out = ((full > 0) ? w[0] : top) & kmask;
+
+    // the partial top word followed by carry_in, as words full and full + 1
+    const uint64_t above_lo = (tail == 0) ? (carry_in & kmask) : top | ((carry_in & kmask) << tail);
+    const uint64_t above_hi = (tail == 0) ? 0                  : (carry_in & kmask) >> (64 - tail);
+
+    if( full > 0 )
+    {
+        shr(w, full, k);
+        w[full - 1] = funnel_right(w[full - 1], above_lo, k);
+    }
+    if( tail != 0 )
+    {
+        const uint64_t mask   = (1ULL << tail) - 1;
+        const uint64_t value  = funnel_right(above_lo, above_hi, k);
+        const uint64_t merged = (value & mask) | (old & ~mask);
+        memcpy(w + full, &merged, nBytes - 8 * full);
+    }
+    return out;
+}
+
+//
+// Padded arrays (rshift_bitset, rshift_dynamic_bitset): the storage starts
+// on a 64-byte boundary and holds a whole number of cache lines, so the
+// kernels may load and store whole vectors up to its end.
+//
+constexpr int32_t rshift_padded_words(const int64_t nBits)
+{
+    return (int32_t)((((nBits + 63) / 64) + 7) / 8 * 8);
+}
+
+//
+// In-place rotation by 0 < shift < nBits of a padded array, on whole words
+// only: no byte copies and no merge of the last word. The array is doubled
+// in an aligned buffer (double_bits), then funnel_out, which may
+// store whole vectors past nWords as long as they stay in the padding,
+// writes the rotated words. The bits past nBits are left at 0.
+//
+inline void rotate_padded_generic(void* ptr_bit_array, const int32_t nBits, const int32_t shift, rshift_funnel_t funnel, rshift_funnel_t funnel_out)
+{
+    const int32_t words  = (nBits + 63) / 64;
+    const int32_t padded = rshift_padded_words(nBits);
+    const int32_t tail   = nBits % 64;
+    const int32_t size   = 2 * padded + 16;
+
+    alignas(64) uint64_t stack_buffer[2 * 64 + 16];
+    uint64_t* tmp = (size <= 2 * 64 + 16) ? stack_buffer : rshift_scratch(size);
+    uint64_t* w   = (uint64_t*)ptr_bit_array;
+
+    double_bits(tmp, w, nBits, funnel);
+    memset(tmp + 2 * words, 0, (size - 2 * words) * sizeof(uint64_t));
+
+    const int32_t offset = nBits - shift;
+    funnel_out(w, tmp + offset / 64, words, offset % 64);
+
+    if( tail != 0 )
+        w[words - 1] &= (1ULL << tail) - 1;
+    memset(w + words, 0, (padded - words) * sizeof(uint64_t));
+}
+
+//
+// Circulant products (rshift_qc): every block x of nBits bits is first
+// doubled (double_bits) so that rot(x, k) is the funnel copy taken at bit
+// nBits - k of the doubled block. A term gives the word and bit offset of
+// that copy in a buffer of doubled blocks.
+//
+struct rshift_circulant_term
+{
+    int32_t word;
+    int32_t b;
+};
+
+//
+// Words readable past 2 * words of a doubled block: the circulant_row
+// kernels read whole chunks of up to 32 words plus the funnel word.
+//
+static const int32_t rshift_doubled_slack = 32;
+
+//
+// dst = XOR of the nTerms rotated blocks (dst ^= ... when accumulate is
+// set), dst being an nBits bit array. The output is computed by chunks of
+// a few vector registers, each chunk accumulating every term before being
+// stored once; bits past nBits are not modified.
+//
+typedef void (*rshift_circulant_t)(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate);
+
+//
+// Stores the first nBits bits of w to dst, the bits of the last byte past
+// nBits being kept.
+//
+inline void store_bits(uint8_t* dst, const uint64_t* w, const int32_t nBits)
+{
+    const int32_t nBytes = nBits / 8;
+    memcpy(dst, w, nBytes);
+    if( nBits % 8 != 0 )
+    {
+        const uint8_t mask = (1 << (nBits % 8)) - 1;
+        const uint8_t v    = ((const uint8_t*)w)[nBytes];
+        dst[nBytes] = (v & mask) | (dst[nBytes] & ~mask);
+    }
+}
+
+// 0 < nBits bits of src to w, the following bits of w up to its end being 0
+inline void load_bits(uint64_t* w, const int32_t nWords, const uint8_t* src, const int32_t nBits)
+{
+    memset(w, 0, nWords * sizeof(uint64_t));
+    memcpy(w, src, (nBits + 7) / 8);
+}
+
+//
+// dst ^= rot(src, shift) for 0 <= shift < nBits: src is doubled on the
+// stack (or in the thread's scratch for large arrays) and the rotated copy
+// is XORed into dst by the circulant kernel without being stored.
+//
+inline void rotate_xor_generic(void* ptr_dst, const void* ptr_src, const int32_t nBits, const int32_t shift, rshift_funnel_t funnel, rshift_circulant_t row)
+{
+    const int32_t words = (nBits + 63) / 64;
+    const int32_t size  = 2 * words + rshift_doubled_slack;
+
+    alignas(64) uint64_t stack_buffer[2 * 64 + rshift_doubled_slack];
+    uint64_t* tmp = (words <= 64) ? stack_buffer : rshift_scratch(size);
+
+    double_bits(tmp, ptr_src, nBits, funnel);
+    memset(tmp + 2 * words, 0, rshift_doubled_slack * sizeof(uint64_t));
+
+    const int32_t               offset = (nBits - shift) % nBits;
+    const rshift_circulant_term term   = { offset / 64, offset % 64 };
+    row((uint8_t*)ptr_dst, tmp, &term, 1, nBits, true);
+}
+
+//
+// Cyclic correlation (rshift_correlate): out[k - k0] = popcount(a & rot(b, k))
+// for k0 <= k < k1. a holds rshift_padded_words(nBits) words, the bits past
+// nBits being 0, which also clears the bits of the rotated window past
+// nBits. b is given doubled (double_bits) with rshift_doubled_slack words
+// after it, so that rot(b, k) is the funnel copy at bit (nBits - k) % nBits.
+//
+typedef void (*rshift_correlate_t)(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1);
+
+//
+// Fixed bit permutations (rshift_permute). A Beneš stage is a delta swap of
+// distance d (a power of 2) over nWords words: bits i and i + d are
+// exchanged wherever bit i of mask is set (mask bits are only set at
+// positions i with i & d == 0).
+//
+typedef void (*rshift_delta_swap_t)(uint64_t* w, const uint64_t* mask, const int32_t nWords, const int32_t d);
+
+//
+// A gather step moves the bits src_mask of word src to the bits dst_mask of
+// word dst (ORed in), keeping their order: pdep(pext(in[src], src_mask),
+// dst_mask). When dst_mask is src_mask shifted (a run of bits moved as a
+// block) the step is that shift, shift = first dst bit - first src bit
+// (contiguous set).
+//
+struct rshift_bit_step
+{
+    int32_t  src;
+    int32_t  dst;
+    uint64_t src_mask;
+    uint64_t dst_mask;
+    int32_t  shift;
+    bool     contiguous;
+};
+
+typedef void (*rshift_gather_t)(uint64_t* out, const uint64_t* in, const rshift_bit_step* steps, const int32_t nSteps);
+
+//
+// Rotation of small frames (rotate_batch in place, nBits <= 64): frame f of
+// the nFrames frames at ptr is rotated by shifts[(first + f) % nShifts].
+// The SIMD kernels move every frame into a vector lane of its own and
+// rotate all the lanes at once with per-lane shift counts.
+//
+typedef void (*rshift_small_t)(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first);
+
+// k reduced to [0, nBits), without a division in the usual case
+inline int32_t small_shift(const int32_t k, const int32_t nBits)
+{
+    return ((uint32_t)k < (uint32_t)nBits) ? k : ((k % nBits) + nBits) % nBits;
+}
+
+// one frame held in the low bits of x, its padding bits (up to the end of
+// the last byte) kept; x >> (nBits - k) is split to stay below 64
+inline uint64_t rotate_lane(const uint64_t x, const int32_t nBits, const int32_t k)
+{
+    const uint64_t mask = (nBits == 64) ? ~0ULL : ((1ULL << nBits) - 1);
+    const uint64_t bits = x & mask;
+    return (((bits << k) | ((bits >> 1) >> (nBits - 1 - k))) & mask) | (x ^ bits);
+}
+
+// one frame at a time, also the tail of the SIMD kernels
+inline void rotate_small_generic(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    const int32_t nBytes = (nBits + 7) / 8;
+    int32_t       j      = (int32_t)(first % nShifts);
+    for(int64_t f = 0; f < nFrames; f += 1)
+    {
+        uint64_t x = 0;
+        memcpy(&x, ptr + f * nBytes, nBytes);
+        x = rotate_lane(x, nBits, small_shift(shifts[j], nBits));
+        memcpy(ptr + f * nBytes, &x, nBytes);
+        j = (j + 1 == nShifts) ? 0 : (j + 1);
+    }
+}
+
+//
+// Bit transposes of the bit-sliced layout (rshift_sliced): four 64 x 64 bit
+// matrices interleaved word by word, a[4 * r + b] being row r of matrix b,
+// are transposed in place (bit c of row r moves to bit r of row c).
+//
+typedef void (*rshift_transpose_t)(uint64_t* a);
+
+// 8 x 8 bit matrix with row r in byte r, transposed by 3 delta swaps
+inline uint64_t transpose_8x8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >>  7)) & 0x00AA00AA00AA00AAULL; x ^= t ^ (t <<  7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL; x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL; x ^= t ^ (t << 28);
+    return x;
+}
+
+// masks of the 6 stages of a 64 x 64 transpose by delta swaps, the stage of
+// distance 32 >> s exchanging the bits of rows r and r + (32 >> s)
+static const uint64_t rshift_transpose_masks[6] =
+{
+    0x00000000FFFFFFFFULL, 0x0000FFFF0000FFFFULL, 0x00FF00FF00FF00FFULL,
+    0x0F0F0F0F0F0F0F0FULL, 0x3333333333333333ULL, 0x5555555555555555ULL
+};
+
+#endif
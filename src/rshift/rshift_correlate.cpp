@@ -0,0 +1,157 @@
+/*
+ *	Cyclic correlation of bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_correlate.hpp"
+#include "rshift_batch.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int32_t block_shifts = 64;     // shifts per task of the pool
+
+static rshift_correlate_t select_correlate()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 )
+    {
+  #if defined(RSHIFT_HAS_AVX512_POPCNT) && defined(RSHIFT_X86_DISPATCH)
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports("avx512vpopcntdq") )
+            return correlate_avx512_popcnt;
+  #elif defined(RSHIFT_HAS_AVX512_POPCNT)
+        return correlate_avx512_popcnt;
+  #endif
+        return correlate_avx512;
+    }
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return correlate_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return correlate_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return correlate_vec;
+#else
+    return correlate_x86;
+#endif
+}
+
+struct correlate_job
+{
+    int32_t*           out;
+    const uint64_t*    a;
+    const uint64_t*    doubled;
+    int32_t            nBits;
+    rshift_correlate_t kernel;
+};
+
+static void correlate_blocks(const void* ctx, const int64_t first, const int64_t count)
+{
+    const correlate_job& job = *(const correlate_job*)ctx;
+    const int32_t k0 = (int32_t)(first * block_shifts);
+    const int32_t k1 = (int32_t)std::min((first + count) * block_shifts, (int64_t)job.nBits);
+    job.kernel(job.out + k0, job.a, job.doubled, job.nBits, k0, k1);
+}
+
+static uint64_t* new_words(const int64_t nWords)
+{
+    const size_t size = (nWords * sizeof(uint64_t) + 63) / 64 * 64;
+    uint64_t* w = (uint64_t*)aligned_alloc(64, size);
+    if( w == nullptr )
+    {
+        printf("(EE) correlate: out of memory (%zu bytes)\n", size);
+        exit( EXIT_FAILURE );
+    }
+    memset(w, 0, size);
+    return w;
+}
+
+void correlate(int32_t* out, const void* ptr_a, const void* ptr_b, const int32_t nBits, const rshift_correlation op)
+{
+    if( nBits <= 0 )
+    {
+        printf("(EE) correlate: invalid size (nBits = %d)\n", nBits);
+        exit( EXIT_FAILURE );
+    }
+    static const rshift_correlate_t kernel = select_correlate();
+
+    const int32_t words  = (nBits + 63) / 64;
+    const int32_t padded = rshift_padded_words(nBits);
+
+    // a on whole vectors with the bits past nBits cleared, b doubled
+    uint64_t* a = new_words( padded );
+    memcpy(a, ptr_a, (nBits + 7) / 8);
+    if( nBits % 64 != 0 )
+        a[words - 1] &= (1ULL << (nBits % 64)) - 1;
+    uint64_t* doubled = new_words( 2 * words + rshift_doubled_slack );
+    double_bits(doubled, ptr_b, nBits, funnel_x86);
+
+    correlate_job job;
+    job.out     = out;
+    job.a       = a;
+    job.doubled = doubled;
+    job.nBits   = nBits;
+    job.kernel  = kernel;
+    const int64_t nBlocks = (nBits + block_shifts - 1) / block_shifts;
+    rshift_parallel_for(nBlocks, (int64_t)block_shifts * padded * sizeof(uint64_t), correlate_blocks, &job);
+
+    if( op == RSHIFT_CORR_XOR )
+    {
+        int32_t weight = 0;
+        for(int32_t x = 0; x < words; x += 1)
+            weight += __builtin_popcountll( a[x] ) + __builtin_popcountll( doubled[x] );
+        if( nBits % 64 != 0 )
+            weight -= __builtin_popcountll( doubled[words - 1] >> (nBits % 64) );   // start of the second copy
+        for(int32_t k = 0; k < nBits; k += 1)
+            out[k] = weight - 2 * out[k];
+    }
+
+    free( doubled );
+    free( a );
+}
+
+int32_t correlate_best(const void* a, const void* b, const int32_t nBits, int32_t* value, const rshift_correlation op)
+{
+    std::vector<int32_t> out( nBits > 0 ? nBits : 1 );
+    correlate(out.data(), a, b, nBits, op);
+
+    const auto best = (op == RSHIFT_CORR_XOR) ? std::min_element(out.begin(), out.end())
+                                              : std::max_element(out.begin(), out.end());
+    if( value != nullptr )
+        *value = *best;
+    return (int32_t)(best - out.begin());
+}
@@ -0,0 +1,60 @@
+/*
+ *	Cyclic correlation of bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_correlate_
+#define _rshift_correlate_
+
+#include <cstdint>
+
+enum rshift_correlation
+{
+    RSHIFT_CORR_XOR = 0,    // popcount(a ^ rot(b, k)): bits that differ
+    RSHIFT_CORR_AND = 1     // popcount(a & rot(b, k)): ones in common
+};
+
+//
+// Cyclic correlation of two nBits bit arrays for every rotation of b:
+//
+//     out[k] = popcount(a OP rot(b, k))    0 <= k < nBits
+//
+// rot being the rotation of rotate() (bit i of b moves to bit (i + k) %
+// nBits). b is doubled once so that every rot(b, k) is a funnel load
+// assembled in registers and never stored. Only the AND is computed, the
+// XOR following from the weights as popcount(a) + popcount(b) - 2 * AND.
+// The popcounts are vpopcntq when the CPU has it, otherwise a nibble lookup
+// (vpshufb) behind a Harley-Seal carry-save tree, or popcnt on SSE4.2. The
+// shifts are split between the threads of the batch pool (rshift_batch.hpp)
+// for large arrays.
+//
+extern void correlate(int32_t* out, const void* a, const void* b, const int32_t nBits, const rshift_correlation op = RSHIFT_CORR_XOR);
+
+//
+// Best rotation only: the k with the fewest differing bits (XOR) or the
+// most ones in common (AND), the smallest k on ties. Its correlation value
+// is written to *value when value is not null.
+//
+extern int32_t correlate_best(const void* a, const void* b, const int32_t nBits, int32_t* value = nullptr, const rshift_correlation op = RSHIFT_CORR_XOR);
+
+#endif
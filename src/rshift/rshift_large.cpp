@@ -0,0 +1,374 @@
+/*
+ *	Rotation of huge bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_large.hpp"
+#include "rshift_batch.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int64_t block_words    = 2048;    // 16 KiB of output per task
+static const int64_t prefetch_words =  512;    // source prefetched 4 KiB ahead
+
+static rshift_funnel_t select_funnel(const bool stream)
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return funnel_avx512_select(stream);
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return stream ? funnel_avx2_stream   : funnel_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return stream ? funnel_sse4_stream   : funnel_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return stream ? funnel_vec_stream : funnel_vec;
+#else
+    return stream ? funnel_x86_stream : funnel_x86;
+#endif
+}
+
+static rshift_words_t select_shl()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return shl_words_avx512;
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return shl_words_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return shl_words_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return shl_words_vec;
+#else
+    return shl_words_x86;
+#endif
+}
+
+static rshift_words_t select_shr()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return shr_words_avx512;
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return shr_words_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return shr_words_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return shr_words_vec;
+#else
+    return shr_words_x86;
+#endif
+}
+
+static void store_fence()
+{
+#if defined(__x86_64__)
+    _mm_sfence();
+#endif
+}
+
+struct large_job
+{
+    uint64_t*       dst;
+    const uint8_t*  src;
+    int64_t         nBits;
+    int64_t         nBytes;
+    int64_t         words;      // words of the array, the last one may be partial
+    int64_t         full;       // whole words
+    int64_t         shift;      // 0 < shift < nBits
+    rshift_funnel_t funnel;
+    bool            stream;
+};
+
+//
+// Word idx of src, the bytes past the end of the array being read as 0.
+//
+static uint64_t load_word(const large_job& job, const int64_t idx)
+{
+    uint64_t v = 0;
+    if( 8 * (idx + 1) <= job.nBytes )
+        memcpy(&v, job.src + 8 * idx, 8);
+    else if( 8 * idx < job.nBytes )
+        memcpy(&v, job.src + 8 * idx, job.nBytes - 8 * idx);
+    return v;
+}
+
+// 1 <= len <= 64 bits of src starting at bit o
+static uint64_t read_bits(const large_job& job, const int64_t o, const int64_t len)
+{
+    const int64_t b = o % 64;
+    uint64_t      v = load_word(job, o / 64) >> b;
+    if( (b != 0) && (b + len > 64) )
+        v |= load_word(job, o / 64 + 1) << (64 - b);
+    return (len == 64) ? v : v & ((1ULL << len) - 1);
+}
+
+//
+// Word j of the output: its bits below the shift come from the end of src,
+// the others from its start. Only the valid bits of a partial word are set.
+//
+static uint64_t rotated_word(const large_job& job, const int64_t j)
+{
+    const int64_t lo = 64 * j;
+    const int64_t hi = std::min(lo + 64, job.nBits);
+    uint64_t v = 0;
+    if( lo < job.shift )
+        v |= read_bits(job, job.nBits - job.shift + lo, std::min(job.shift, hi) - lo);
+    if( hi > job.shift )
+    {
+        const int64_t start = std::max(lo, job.shift);
+        v |= read_bits(job, start - job.shift, hi - start) << (start - lo);
+    }
+    return v;
+}
+
+//
+// Output words [j0, j1) made of the src bits starting at bit o. The funnel
+// reads one word past each output word, so the words that would read past
+// the whole words of src are computed one by one.
+//
+static void copy_segment(const large_job& job, const int64_t j0, const int64_t j1, const int64_t o)
+{
+    const uint64_t* src = (const uint64_t*)job.src;
+    const int64_t   q   = o / 64;
+    const int32_t   b   = (int32_t)(o % 64);
+    const int64_t   nf  = std::max((int64_t)0, std::min(j1 - j0, job.full - 1 - q));
+
+    for(int64_t x = 0; x < nf; x += prefetch_words)
+    {
+        const int64_t next = q + x + prefetch_words;
+        const int64_t last = std::min(next + prefetch_words, job.full);
+        for(int64_t p = next; p < last; p += 8)
+            __builtin_prefetch(src + p);
+        job.funnel(job.dst + j0 + x, src + q + x, (int32_t)std::min(prefetch_words, nf - x), b);
+    }
+    for(int64_t j = j0 + nf; j < j1; j += 1)
+        job.dst[j] = rotated_word(job, j);
+}
+
+static void rotate_blocks(const void* ctx, const int64_t first, const int64_t count)
+{
+    const large_job& job = *(const large_job*)ctx;
+
+    // whole output words made of a single piece of src
+    const int64_t b_end   = job.shift / 64;
+    const int64_t a_begin = (job.shift + 63) / 64;
+    const int64_t a_end   = job.full;
+
+    for(int64_t blk = first; blk < first + count; blk += 1)
+    {
+        const int64_t j0 = blk * block_words;
+        const int64_t j1 = std::min(j0 + block_words, job.words);
+        if( j0 < b_end )
+            copy_segment(job, j0, std::min(j1, b_end), job.nBits - job.shift + 64 * j0);
+        if( std::max(j0, a_begin) < std::min(j1, a_end) )
+            copy_segment(job, std::max(j0, a_begin), std::min(j1, a_end), 64 * std::max(j0, a_begin) - job.shift);
+    }
+    if( job.stream )
+        store_fence();
+}
+
+// seam word j (possibly the partial last one): the bits past nBits are kept
+static void write_word(const large_job& job, const int64_t j)
+{
+    const uint64_t v = rotated_word(job, j);
+    if( j < job.full )
+    {
+        job.dst[j] = v;
+    }
+    else
+    {
+        const int64_t  bytes = job.nBytes - 8 * j;
+        const uint64_t mask  = (1ULL << (job.nBits % 64)) - 1;
+        uint64_t old = 0;
+        memcpy(&old, job.dst + j, bytes);
+        const uint64_t merged = (v & mask) | (old & ~mask);
+        memcpy(job.dst + j, &merged, bytes);
+    }
+}
+
+void rotate_large(void* __restrict ptr_dst, const void* __restrict ptr_src, const int64_t nBits, const int64_t k, const bool stream)
+{
+    if( nBits <= 0 )
+    {
+        printf("(EE) rotate_large: invalid size (nBits = %lld)\n", (long long)nBits);
+        exit( EXIT_FAILURE );
+    }
+    const int64_t shift  = ((k % nBits) + nBits) % nBits;
+    const int64_t nBytes = (nBits + 7) / 8;
+
+    if( shift == 0 )
+    {
+        if( nBits % 8 == 0 )
+        {
+            memcpy(ptr_dst, ptr_src, nBytes);
+        }
+        else
+        {
+            memcpy(ptr_dst, ptr_src, nBytes - 1);
+            const uint8_t mask = (1 << (nBits % 8)) - 1;
+            uint8_t*       d   = (uint8_t*)ptr_dst + nBytes - 1;
+            const uint8_t  s   = ((const uint8_t*)ptr_src)[nBytes - 1];
+            *d = (s & mask) | (*d & ~mask);
+        }
+        return;
+    }
+
+    large_job job;
+    job.dst    = (uint64_t*)ptr_dst;
+    job.src    = (const uint8_t*)ptr_src;
+    job.nBits  = nBits;
+    job.nBytes = nBytes;
+    job.words  = (nBits + 63) / 64;
+    job.full   = nBits / 64;
+    job.shift  = shift;
+    job.funnel = select_funnel( stream );
+    job.stream = stream;
+
+    const int64_t nBlocks = (job.words + block_words - 1) / block_words;
+    rshift_parallel_for(nBlocks, 8 * block_words, rotate_blocks, &job);
+
+    // fix-up of the words left out by the blocks
+    const bool seam = (shift % 64 != 0);
+    if( seam )
+        write_word(job, shift / 64);
+    if( (nBits % 64 != 0) && ((seam == false) || (shift / 64 != job.full)) )
+        write_word(job, job.full);
+}
+
+struct shift_job
+{
+    uint64_t*            w;
+    int64_t              words;
+    int32_t              k;         // 0 < k < 64
+    bool                 left;
+    rshift_words_t       shift;
+    std::vector<uint64_t> carry;    // word next to each block, saved before any block runs
+};
+
+static void shift_blocks(const void* ctx, const int64_t first, const int64_t count)
+{
+    const shift_job& job = *(const shift_job*)ctx;
+    for(int64_t blk = first; blk < first + count; blk += 1)
+    {
+        const int64_t j0 = blk * block_words;
+        const int64_t j1 = std::min(j0 + block_words, job.words);
+        uint64_t*     w  = job.w + j0;
+        job.shift(w, (int32_t)(j1 - j0), job.k);
+        if( job.left )
+            w[0]           = funnel_left (w[0],           job.carry[blk], job.k);
+        else
+            w[j1 - j0 - 1] = funnel_right(w[j1 - j0 - 1], job.carry[blk], job.k);
+    }
+}
+
+struct copy_job
+{
+    uint8_t*       dst;
+    const uint8_t* src;
+    int64_t        nBytes;
+};
+
+static void copy_blocks(const void* ctx, const int64_t first, const int64_t count)
+{
+    const copy_job& job   = *(const copy_job*)ctx;
+    const int64_t   start = first * 8 * block_words;
+    const int64_t   end   = std::min((first + count) * 8 * block_words, job.nBytes);
+    memcpy(job.dst + start, job.src + start, end - start);
+}
+
+void rotate_large(void* ptr_bit_array, const int64_t nBits, const int64_t k)
+{
+    if( nBits <= 0 )
+    {
+        printf("(EE) rotate_large: invalid size (nBits = %lld)\n", (long long)nBits);
+        exit( EXIT_FAILURE );
+    }
+    const int64_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
+    if( (nBits % 64 == 0) && ((shift < 64) || (nBits - shift < 64)) )
+    {
+        shift_job job;
+        job.w     = (uint64_t*)ptr_bit_array;
+        job.words = nBits / 64;
+        job.left  = (shift < 64);
+        job.k     = (int32_t)(job.left ? shift : nBits - shift);
+        job.shift = job.left ? select_shl() : select_shr();
+
+        // carry in of a block: the word below it (left) or above it (right)
+        const int64_t nBlocks = (job.words + block_words - 1) / block_words;
+        job.carry.resize( nBlocks );
+        for(int64_t blk = 0; blk < nBlocks; blk += 1)
+        {
+            const int64_t j = job.left ? blk * block_words - 1 : std::min((blk + 1) * block_words, job.words);
+            job.carry[blk] = job.w[ (j + job.words) % job.words ];
+        }
+        rshift_parallel_for(nBlocks, 8 * block_words, shift_blocks, &job);
+        return;
+    }
+
+    const int64_t nBytes = (nBits + 7) / 8;
+    uint8_t* tmp = (uint8_t*)aligned_alloc(64, (nBytes + 63) / 64 * 64);
+    if( tmp == nullptr )
+    {
+        printf("(EE) rotate_large: unable to allocate %lld bytes\n", (long long)nBytes);
+        exit( EXIT_FAILURE );
+    }
+    const copy_job copy = { tmp, (const uint8_t*)ptr_bit_array, nBytes };
+    rshift_parallel_for((nBytes + 8 * block_words - 1) / (8 * block_words), 8 * block_words, copy_blocks, &copy);
+    rotate_large(ptr_bit_array, tmp, nBits, shift, false);
+    free( tmp );
+}
+
+void permutation_large(void* ptr_bit_array, const int64_t nBits)
+{
+    rotate_large(ptr_bit_array, nBits, 1);
+}
+
+void permutation_right_large(void* ptr_bit_array, const int64_t nBits)
+{
+    rotate_large(ptr_bit_array, nBits, nBits - 1);
+}
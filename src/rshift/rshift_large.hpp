@@ -0,0 +1,57 @@
+/*
+ *	Rotation of huge bit arrays - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_large_
+#define _rshift_large_
+
+#include <cstdint>
+
+//
+// Rotation of a single huge bit array (megabits to gigabits): bit i moves to
+// bit (i + k) % nBits as with rotate(), nBits being any 64-bit size.
+//
+// The destination is cut in blocks of 16 KiB spread over the threads of the
+// batch pool (rshift_batch.hpp). Inside a block the words come from one or
+// two funnel copies of the source with a constant bit offset, so a block
+// needs no carry from its neighbours; the source is prefetched 4 KiB ahead
+// and the output written with non-temporal stores when stream is set. The
+// words that mix the two pieces of the rotation (the seam at bit k and the
+// partial last word) are written once all the blocks are done.
+//
+extern void rotate_large(void* __restrict ptr_dst, const void* __restrict ptr_src, const int64_t nBits, const int64_t k, const bool stream = true);
+
+//
+// In-place variant. Shifts of less than 64 positions in either direction
+// on a whole number of words (permutation_large, permutation_right_large)
+// are done in place: the word next to each block boundary is saved first,
+// then every block shifts its words with the saved word as carry in. The
+// other rotations go through a temporary copy of the array.
+//
+extern void rotate_large(void* ptr_bit_array, const int64_t nBits, const int64_t k);
+
+extern void permutation_large      (void* ptr_bit_array, const int64_t nBits);
+extern void permutation_right_large(void* ptr_bit_array, const int64_t nBits);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ *	NEON intrinsics on SSE2 (emulation build mode) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_neon_emulation_
+#define _rshift_neon_emulation_
+
+//
+// Translation of the NEON intrinsics used by rshift_simd.hpp to SSE2, so
+// that the NEON code path can be built and checked on x86 Linux (build
+// with -DRSHIFT_NEON_EMULATION). Only the subset the backend needs is
+// provided, with the exact NEON semantics: the register types are
+// distinct, vshlq_u64 takes a signed per-lane count (negative shifting
+// right, |count| >= 64 giving 0) and vpaddlq_* add adjacent lanes into
+// lanes twice as wide.
+//
+#include <cstdint>
+#include <emmintrin.h>
+
+struct uint8x16_t  { __m128i v; };
+struct uint16x8_t  { __m128i v; };
+struct uint32x4_t  { __m128i v; };
+struct uint64x2_t  { __m128i v; };
+struct int64x2_t   { __m128i v; };
+
+inline uint64x2_t vld1q_u64(const uint64_t* p)
+{
+    return { _mm_loadu_si128( (const __m128i*)p ) };
+}
+
+inline void vst1q_u64(uint64_t* p, const uint64x2_t a)
+{
+    _mm_storeu_si128( (__m128i*)p, a.v );
+}
+
+inline uint64x2_t vdupq_n_u64(const uint64_t x) { return { _mm_set1_epi64x( (long long)x ) }; }
+inline int64x2_t  vdupq_n_s64(const int64_t  x) { return { _mm_set1_epi64x( (long long)x ) }; }
+
+inline uint64x2_t veorq_u64(const uint64x2_t a, const uint64x2_t b) { return { _mm_xor_si128(a.v, b.v) }; }
+inline uint64x2_t vorrq_u64(const uint64x2_t a, const uint64x2_t b) { return { _mm_or_si128 (a.v, b.v) }; }
+inline uint64x2_t vandq_u64(const uint64x2_t a, const uint64x2_t b) { return { _mm_and_si128(a.v, b.v) }; }
+inline uint64x2_t vaddq_u64(const uint64x2_t a, const uint64x2_t b) { return { _mm_add_epi64(a.v, b.v) }; }
+inline uint64x2_t vsubq_u64(const uint64x2_t a, const uint64x2_t b) { return { _mm_sub_epi64(a.v, b.v) }; }
+
+// the lane count is an immediate in NEON, only 1 is used here
+inline uint64x2_t vextq_u64(const uint64x2_t a, const uint64x2_t b, const int32_t n)
+{
+    (void)n;
+    return { _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(a.v), _mm_castsi128_pd(b.v), 1) ) };
+}
+
+inline uint64_t vgetq_lane_u64(const uint64x2_t a, const int32_t lane)
+{
+    return (uint64_t)_mm_cvtsi128_si64( (lane == 0) ? a.v : _mm_unpackhi_epi64(a.v, a.v) );
+}
+
+// psllq / psrlq already give 0 for counts >= 64
+inline __m128i neon_shift_lane(const __m128i a, const int64_t count)
+{
+    return (count >= 0) ? _mm_sll_epi64(a, _mm_cvtsi64_si128(count)) : _mm_srl_epi64(a, _mm_cvtsi64_si128(-count));
+}
+
+// the count is the signed low byte of each lane
+inline uint64x2_t vshlq_u64(const uint64x2_t a, const int64x2_t count)
+{
+    const int64_t c0 = (int8_t)_mm_cvtsi128_si64( count.v );
+    const int64_t c1 = (int8_t)_mm_cvtsi128_si64( _mm_unpackhi_epi64(count.v, count.v) );
+    if( c0 == c1 )
+        return { neon_shift_lane(a.v, c0) };
+    const __m128i r0 = neon_shift_lane(a.v, c0);
+    const __m128i r1 = neon_shift_lane(a.v, c1);
+    return { _mm_castpd_si128( _mm_move_sd(_mm_castsi128_pd(r1), _mm_castsi128_pd(r0)) ) };
+}
+
+inline uint8x16_t vreinterpretq_u8_u64(const uint64x2_t a) { return { a.v }; }
+inline uint64x2_t vreinterpretq_u64_u8(const uint8x16_t a) { return { a.v }; }
+inline int64x2_t  vreinterpretq_s64_u64(const uint64x2_t a) { return { a.v }; }
+
+inline int64x2_t vnegq_s64(const int64x2_t a) { return { _mm_sub_epi64(_mm_setzero_si128(), a.v) }; }
+
+// per-byte population count (SWAR, SSE2 having no pshufb)
+inline uint8x16_t vcntq_u8(const uint8x16_t a)
+{
+    const __m128i m1 = _mm_set1_epi8( 0x55 );
+    const __m128i m2 = _mm_set1_epi8( 0x33 );
+    const __m128i m4 = _mm_set1_epi8( 0x0F );
+    __m128i x = _mm_sub_epi8( a.v, _mm_and_si128(_mm_srli_epi16(a.v, 1), m1) );
+    x = _mm_add_epi8( _mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2) );
+    x = _mm_and_si128( _mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4 );
+    return { x };
+}
+
+inline uint16x8_t vpaddlq_u8(const uint8x16_t a)
+{
+    const __m128i m = _mm_set1_epi16( 0x00FF );
+    return { _mm_add_epi16( _mm_and_si128(a.v, m), _mm_srli_epi16(a.v, 8) ) };
+}
+
+inline uint32x4_t vpaddlq_u16(const uint16x8_t a)
+{
+    const __m128i m = _mm_set1_epi32( 0x0000FFFF );
+    return { _mm_add_epi32( _mm_and_si128(a.v, m), _mm_srli_epi32(a.v, 16) ) };
+}
+
+inline uint64x2_t vpaddlq_u32(const uint32x4_t a)
+{
+    const __m128i m = _mm_set1_epi64x( 0x00000000FFFFFFFFLL );
+    return { _mm_add_epi64( _mm_and_si128(a.v, m), _mm_srli_epi64(a.v, 32) ) };
+}
+
+#endif
@@ -0,0 +1,411 @@
+/*
+ *	Fixed bit permutations (interleavers) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_permute.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_avx512.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void select_gather(const int32_t level, rshift_gather_t& gather, bool& native)
+{
+    gather = gather_bits_x86;
+    native = false;
+#if defined(RSHIFT_HAS_BMI2) && defined(__x86_64__)
+  #ifdef RSHIFT_X86_DISPATCH
+    __builtin_cpu_init();
+    if( (level >= RSHIFT_AVX2) && __builtin_cpu_supports("bmi2") )
+  #else
+    if( level >= RSHIFT_AVX2 )
+  #endif
+    {
+        gather = gather_bits_bmi2;
+        native = true;
+    }
+#endif
+    (void)level;
+}
+
+static bool select_vbmi(const int32_t level)
+{
+#ifdef RSHIFT_HAS_AVX512_VBMI
+  #ifdef RSHIFT_X86_DISPATCH
+    __builtin_cpu_init();
+    return (level >= RSHIFT_AVX512) && __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("gfni");
+  #else
+    return level >= RSHIFT_AVX512;
+  #endif
+#else
+    (void)level;
+    return false;
+#endif
+}
+
+rshift_permutation_plan::rshift_permutation_plan(const std::vector<int32_t>& map, const int32_t nIn, const int32_t level)
+    : rshift_permutation_plan(map.data(), nIn, (int32_t)map.size(), level)
+{
+
+}
+
+rshift_permutation_plan::rshift_permutation_plan(const int32_t* map, const int32_t nIn, const int32_t nOut, const int32_t level)
+    : nIn( nIn ), nOut( nOut ), level( (level < 0) ? rshift_isa_level() : level ), kind( PLAN_PEXT ),
+      identity( true ), matrix( 0 ), vbmi( false ), gather( nullptr ), words( 0 ), swap( nullptr ), work( nullptr )
+{
+    if( (nIn <= 0) || (nOut <= 0) )
+    {
+        printf("(EE) rshift_permutation_plan: invalid sizes (%d -> %d bits)\n", nIn, nOut);
+        exit( EXIT_FAILURE );
+    }
+    for(int32_t i = 0; i < nOut; i += 1)
+    {
+        if( (map[i] < 0) || (map[i] >= nIn) )
+        {
+            printf("(EE) rshift_permutation_plan: map[%d] = %d is not an input bit (%d bits)\n", i, map[i], nIn);
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    //
+    // A byte permutation is always the cheapest, otherwise the gather steps
+    // compete with the Beneš stages: a shift or a pext / pdep pair per step
+    // (a bit loop without BMI2), about 3 operations per word (per register)
+    // and per stage.
+    //
+    bool native;
+    select_gather(this->level, gather, native);
+
+    build_bytes( map );
+    if( kind != PLAN_BYTES )
+    {
+        build_pext( map );
+        int64_t pext_cost = 0;
+        for(const rshift_bit_step& s : list)
+            pext_cost += s.contiguous ? 2 : (native ? 4 : 4 * __builtin_popcountll(s.src_mask));
+
+        if( build_benes( map ) )
+        {
+            const int32_t lanes = (this->level >= RSHIFT_VEC_LEVEL) ? simd_lanes : 1;
+            const int64_t benes_cost = (int64_t)distance.size() * 3 * ((words + lanes - 1) / lanes) + words;
+            if( benes_cost < pext_cost )
+            {
+                kind = PLAN_BENES;
+                list.clear();
+            }
+            else
+            {
+                distance.clear();
+                masks.clear();
+            }
+        }
+    }
+
+    const int32_t inWords  = (nIn  + 63) / 64;
+    const int32_t outWords = (nOut + 63) / 64;
+    const int32_t size     = (inWords + outWords > words) ? (inWords + outWords) : words;
+    work = (uint64_t*)aligned_alloc(64, ((size_t)size * sizeof(uint64_t) + 63) / 64 * 64);
+    if( work == nullptr )
+    {
+        printf("(EE) rshift_permutation_plan: out of memory\n");
+        exit( EXIT_FAILURE );
+    }
+    memset(work, 0, (size_t)size * sizeof(uint64_t));
+}
+
+rshift_permutation_plan::~rshift_permutation_plan()
+{
+    free( work );
+}
+
+const char* rshift_permutation_plan::method() const
+{
+    switch( kind )
+    {
+        case PLAN_BYTES : return "bytes";
+        case PLAN_PEXT  : return "pext";
+        default         : return "benes";
+    }
+}
+
+int32_t rshift_permutation_plan::steps() const
+{
+    switch( kind )
+    {
+        case PLAN_BYTES : return (int32_t)index.size();
+        case PLAN_PEXT  : return (int32_t)list.size();
+        default         : return (int32_t)distance.size();
+    }
+}
+
+//
+// Whole output bytes, output byte b being input byte index[b] with the bit
+// j of the output taken from the bit p[j] of the input, p the same for all
+// of them.
+//
+void rshift_permutation_plan::build_bytes(const int32_t* map)
+{
+    if( nOut % 8 != 0 )
+        return;
+    int32_t p[8];
+    for(int32_t j = 0; j < 8; j += 1)
+        p[j] = map[j] % 8;
+    for(int32_t b = 0; b < nOut / 8; b += 1)
+    {
+        const int32_t source = map[8 * b] / 8;
+        for(int32_t j = 0; j < 8; j += 1)
+        {
+            if( map[8 * b + j] != 8 * source + p[j] )
+            {
+                index.clear();
+                return;
+            }
+        }
+        index.push_back( source );
+    }
+
+    for(int32_t j = 0; j < 8; j += 1)
+    {
+        identity &= (p[j] == j);
+        matrix   |= (uint64_t)(1u << p[j]) << (8 * (7 - j));
+    }
+    for(int32_t v = 0; v < 256; v += 1)
+    {
+        uint8_t r = 0;
+        for(int32_t j = 0; j < 8; j += 1)
+            r |= ((v >> p[j]) & 1) << j;
+        lut[v] = r;
+    }
+
+    vbmi = select_vbmi(level) && ((nIn + 7) / 8 <= 64) && (nOut / 8 <= 64);
+    for(const int32_t b : index)
+        index8.push_back( (uint8_t)b );
+    kind = PLAN_BYTES;
+}
+
+//
+// Greedy gather steps: the output bits are taken in order, each one joining
+// the last step of its (output word, input word) pair as long as the input
+// bits stay increasing.
+//
+void rshift_permutation_plan::build_pext(const int32_t* map)
+{
+    std::vector<int32_t> last((nIn + 63) / 64, -1);    // step of each input word, current output word
+    for(int32_t w = 0; w < (nOut + 63) / 64; w += 1)
+    {
+        const int32_t first = (int32_t)list.size();
+        const int32_t end   = (64 * w + 64 < nOut) ? (64 * w + 64) : nOut;
+        for(int32_t i = 64 * w; i < end; i += 1)
+        {
+            const int32_t src = map[i] / 64;
+            const int32_t bit = map[i] % 64;
+            int32_t       s   = last[src];
+            if( (s < first) || ((list[s].src_mask >> bit) != 0) )
+            {
+                s = (int32_t)list.size();
+                list.push_back( { src, w, 0, 0, 0, false } );
+                last[src] = s;
+            }
+            list[s].src_mask |= 1ULL << bit;
+            list[s].dst_mask |= 1ULL << (i % 64);
+        }
+    }
+
+    for(rshift_bit_step& s : list)
+    {
+        s.shift      = __builtin_ctzll(s.dst_mask) - __builtin_ctzll(s.src_mask);
+        s.contiguous = ((s.shift >= 0) ? (s.src_mask << s.shift) : (s.src_mask >> -s.shift)) == s.dst_mask;
+    }
+}
+
+//
+// Beneš network on N = 2^m positions, stages 0 .. 2m - 2 of distances
+// N/2, ..., 2, 1, 2, ..., N/2, routed by the looping algorithm: pi[x] is
+// the output position of input bit x, side[x] the half of the network it
+// crosses. The bits of an input pair (x, x ^ h) cross different halves, as
+// do the bits of an output pair, which chains the choices.
+//
+static void benes_route(const std::vector<int32_t>& pi, const int32_t base, const int32_t first, const int32_t last, uint64_t* masks, const int32_t words)
+{
+    const int32_t n = (int32_t)pi.size();
+    if( n == 2 )
+    {
+        if( pi[0] == 1 )
+            masks[first * words + base / 64] |= 1ULL << (base % 64);
+        return;
+    }
+
+    const int32_t        h = n / 2;
+    std::vector<int32_t> inv(n);
+    std::vector<int8_t>  side(n, -1);
+    for(int32_t x = 0; x < n; x += 1)
+        inv[pi[x]] = x;
+    for(int32_t start = 0; start < h; start += 1)
+    {
+        int32_t x = start;
+        while( side[x] < 0 )
+        {
+            side[x]     = 0;
+            side[x ^ h] = 1;
+            x = inv[pi[x ^ h] ^ h];
+        }
+    }
+
+    // a bit crossing the half it does not start (end) in is swapped by the
+    // first (last) stage
+    std::vector<int32_t> sub[2] = { std::vector<int32_t>(h), std::vector<int32_t>(h) };
+    for(int32_t x = 0; x < n; x += 1)
+        sub[side[x]][x % h] = pi[x] % h;
+    for(int32_t a = 0; a < h; a += 1)
+    {
+        if( side[a] == 1 )
+            masks[first * words + (base + a) / 64] |= 1ULL << ((base + a) % 64);
+        if( side[inv[a]] == 1 )
+            masks[last  * words + (base + a) / 64] |= 1ULL << ((base + a) % 64);
+    }
+    benes_route(sub[0], base,     first + 1, last - 1, masks, words);
+    benes_route(sub[1], base + h, first + 1, last - 1, masks, words);
+}
+
+bool rshift_permutation_plan::build_benes(const int32_t* map)
+{
+    if( nIn != nOut )
+        return false;
+
+    int32_t m = 6;
+    while( (1 << m) < nIn )
+        m += 1;
+    const int32_t N = 1 << m;
+
+    std::vector<int32_t> pi(N, -1);
+    for(int32_t i = 0; i < nOut; i += 1)
+    {
+        if( pi[map[i]] >= 0 )
+            return false;    // not a bijection
+        pi[map[i]] = i;
+    }
+    for(int32_t x = nIn; x < N; x += 1)
+        pi[x] = x;
+
+    const int32_t        stages = 2 * m - 1;
+    std::vector<uint64_t> all((size_t)stages * (N / 64), 0);
+    benes_route(pi, 0, 0, stages - 1, all.data(), N / 64);
+
+    words = N / 64;
+    for(int32_t s = 0; s < stages; s += 1)
+    {
+        const uint64_t* mask = all.data() + (size_t)s * words;
+        bool            used = false;
+        for(int32_t x = 0; x < words; x += 1)
+            used |= (mask[x] != 0);
+        if( used == false )
+            continue;
+        distance.push_back( (s < m) ? (N >> (s + 1)) : (N >> (stages - s)) );
+        masks.insert( masks.end(), mask, mask + words );
+    }
+
+#ifdef RSHIFT_VEC_BASELINE
+    swap = delta_swap_vec;
+#else
+    swap = (level >= RSHIFT_VEC_LEVEL) ? delta_swap_vec : delta_swap_x86;
+#endif
+    return true;
+}
+
+void rshift_permutation_plan::execute(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nFrames)
+{
+    const int32_t inBytes  = (nIn  + 7) / 8;
+    const int32_t outBytes = (nOut + 7) / 8;
+    for(int32_t f = 0; f < nFrames; f += 1)
+    {
+        const uint8_t* src = (const uint8_t*)ptr_src + (size_t)f * inBytes;
+        uint8_t*       dst = (uint8_t*)      ptr_dst + (size_t)f * outBytes;
+
+        if( kind == PLAN_BYTES )
+        {
+#ifdef RSHIFT_HAS_AVX512_VBMI
+            if( vbmi )
+            {
+                permute_bytes_avx512(dst, src, index8.data(), inBytes, outBytes, matrix);
+                continue;
+            }
+#endif
+            permute_bytes_x86(dst, src, index.data(), outBytes, identity ? nullptr : lut);
+        }
+        else if( kind == PLAN_PEXT )
+        {
+            const int32_t inWords = (nIn + 63) / 64;
+            uint64_t*     out     = work + inWords;
+            memcpy(work, src, inBytes);
+            memset(out, 0, (size_t)(nOut + 63) / 64 * sizeof(uint64_t));
+            gather(out, work, list.data(), (int32_t)list.size());
+            memcpy(dst, out, outBytes);
+        }
+        else
+        {
+            // the padding bits are fixed points, they stay 0
+            memcpy(work, src, inBytes);
+            if( nIn % 8 != 0 )
+                ((uint8_t*)work)[inBytes - 1] &= (1 << (nIn % 8)) - 1;
+            for(size_t s = 0; s < distance.size(); s += 1)
+                swap(work, masks.data() + s * words, words, distance[s]);
+            memcpy(dst, work, outBytes);
+        }
+    }
+}
+
+std::vector<int32_t> rshift_interleaver_map(const int32_t rows, const int32_t cols)
+{
+    std::vector<int32_t> map((size_t)rows * cols);
+    for(int32_t i = 0; i < rows * cols; i += 1)
+        map[i] = (i % rows) * cols + i / rows;
+    return map;
+}
+
+std::vector<int32_t> rshift_bit_reversal_map(const int32_t log2n)
+{
+    std::vector<int32_t> map((size_t)1 << log2n);
+    for(int32_t i = 0; i < (1 << log2n); i += 1)
+    {
+        int32_t r = 0;
+        for(int32_t j = 0; j < log2n; j += 1)
+            r |= ((i >> j) & 1) << (log2n - 1 - j);
+        map[i] = r;
+    }
+    return map;
+}
+
+std::vector<int32_t> rshift_puncture_map(const uint8_t* keep, const int32_t nBits)
+{
+    std::vector<int32_t> map;
+    for(int32_t i = 0; i < nBits; i += 1)
+    {
+        if( keep[i] != 0 )
+            map.push_back( i );
+    }
+    return map;
+}
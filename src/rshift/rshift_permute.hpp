@@ -0,0 +1,125 @@
+/*
+ *	Fixed bit permutations (interleavers) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_permute_
+#define _rshift_permute_
+
+#include "rshift_common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//
+// Fixed bit permutation of frames, planned once and executed per frame:
+//
+//     bit i of the output = bit map[i] of the input    0 <= i < nOut
+//
+// map may repeat or drop input bits (puncturing, repetition). Input frames
+// are (nIn + 7) / 8 bytes apart and output frames (nOut + 7) / 8 bytes
+// apart (the layout of the nFrames argument of rotate); the bits past nOut
+// of the last output byte are written as 0.
+//
+// At plan time the permutation is decomposed into the cheapest of:
+//
+//   bytes : every output byte comes from one input byte with the same bit
+//           order inside all of them: a byte gather then a bit permutation
+//           within the bytes (one vpermb + gf2p8affineqb for frames of up
+//           to 64 bytes with AVX512-VBMI and GFNI, byte loads and a lookup
+//           table otherwise),
+//   pext  : blocks of bits moved between two words keeping their order,
+//           a shift when the block is a run of bits, pdep(pext()) with BMI2
+//           (a bit loop without it),
+//   benes : bijections only, a Beneš network of delta swaps on the frame
+//           padded to a power of 2 (at least 64 bits), the stages that
+//           swap nothing being dropped. Stages move whole vector registers
+//           when the swap distance is 64 bits or more.
+//
+// The plan owns its workspace, making execute() non-reentrant: use one plan
+// per thread.
+//
+class rshift_permutation_plan
+{
+public:
+    // level: ISA of the kernels, -1 for the one bound by the dispatcher
+    rshift_permutation_plan(const int32_t* map, const int32_t nIn, const int32_t nOut, const int32_t level = -1);
+    rshift_permutation_plan(const std::vector<int32_t>& map, const int32_t nIn, const int32_t level = -1);
+    ~rshift_permutation_plan();
+
+    rshift_permutation_plan(const rshift_permutation_plan&)            = delete;
+    rshift_permutation_plan& operator=(const rshift_permutation_plan&) = delete;
+
+    int32_t     in_bits () const { return nIn;  }
+    int32_t     out_bits() const { return nOut; }
+    const char* method  () const;
+    int32_t     steps   () const;    // output bytes, gather steps or Beneš stages
+
+    void execute(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nFrames = 1);
+
+private:
+    enum plan_method { PLAN_BYTES, PLAN_PEXT, PLAN_BENES };
+
+    void build_bytes(const int32_t* map);
+    void build_pext (const int32_t* map);
+    bool build_benes(const int32_t* map);
+
+    int32_t                      nIn;
+    int32_t                      nOut;
+    int32_t                      level;
+    plan_method                  kind;
+
+    // bytes
+    std::vector<int32_t>         index;       // source byte of each output byte
+    std::vector<uint8_t>         index8;      // same, vpermb operand
+    uint8_t                      lut[256];    // bit permutation within a byte
+    bool                         identity;    // lut is the identity
+    uint64_t                     matrix;      // lut as a gf2p8affineqb matrix
+    bool                         vbmi;
+
+    // pext
+    std::vector<rshift_bit_step> list;
+    rshift_gather_t              gather;
+
+    // benes
+    int32_t                      words;       // N / 64
+    std::vector<int32_t>         distance;    // swap distance of each stage
+    std::vector<uint64_t>        masks;       // words per stage
+    rshift_delta_swap_t          swap;
+
+    uint64_t*                    work;        // frame workspace (in, then out)
+};
+
+//
+// Maps of the usual permutations (map[i] is the input bit of output bit i):
+//
+//   interleaver : row-column interleaver written by rows, read by columns
+//                 (nBits = rows * cols): out[i] = in[(i % rows) * cols + i / rows],
+//   bit reversal: out[i] = in[reverse of the log2n bits of i],
+//   puncture    : the input bits i with keep[i] != 0, in order.
+//
+extern std::vector<int32_t> rshift_interleaver_map (const int32_t rows, const int32_t cols);
+extern std::vector<int32_t> rshift_bit_reversal_map(const int32_t log2n);
+extern std::vector<int32_t> rshift_puncture_map    (const uint8_t* keep, const int32_t nBits);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ *	Quasi-cyclic (circulant) products over GF(2) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_qc.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+typedef void (*rotate_xor_t)(void*, const void*, const int32_t, const int32_t);
+
+static rotate_xor_t select_rotate_xor()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) return rotate_xor_avx512;
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) return rotate_xor_avx2;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) return rotate_xor_sse4;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return rotate_xor_vec;
+#else
+    return rotate_xor_x86;
+#endif
+}
+
+void rotate_xor(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    static const rotate_xor_t kernel = select_rotate_xor();
+    kernel(ptr_dst, ptr_src, nBits, k);
+}
+
+static void select_circulant(const int32_t level, rshift_funnel_t& funnel, rshift_circulant_t& row)
+{
+#ifdef RSHIFT_VEC_BASELINE
+    funnel = funnel_vec;
+    row    = circulant_row_vec;
+#else
+    funnel = funnel_x86;
+    row    = circulant_row_x86;
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if( level >= RSHIFT_SSE4   ) { funnel = funnel_sse4;   row = circulant_row_sse4;   }
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2   ) { funnel = funnel_avx2;   row = circulant_row_avx2;   }
+#endif
+#ifdef RSHIFT_HAS_AVX512
+    if( level >= RSHIFT_AVX512 ) { funnel = funnel_avx512_select(); row = circulant_row_avx512; }
+#endif
+}
+
+rshift_qc_encoder::rshift_qc_encoder(const int16_t* base, const int32_t rows, const int32_t cols, const int32_t Z, const int32_t level)
+    : rows( rows ), cols( cols ), Z( Z )
+{
+    if( (rows <= 0) || (cols <= 0) || (Z <= 0) )
+    {
+        printf("(EE) rshift_qc_encoder: invalid base matrix (%d x %d, Z = %d)\n", rows, cols, Z);
+        exit( EXIT_FAILURE );
+    }
+    select_circulant((level < 0) ? rshift_isa_level() : level, funnel, row);
+
+    // doubled blocks on whole cache lines, with the slack read by the kernels
+    const int32_t words = (Z + 63) / 64;
+    stride  = (2 * words + rshift_doubled_slack + 7) / 8 * 8;
+    doubled = (uint64_t*)aligned_alloc(64, (size_t)cols * stride * sizeof(uint64_t));
+    if( doubled == nullptr )
+    {
+        printf("(EE) rshift_qc_encoder: out of memory\n");
+        exit( EXIT_FAILURE );
+    }
+    memset(doubled, 0, (size_t)cols * stride * sizeof(uint64_t));
+
+    // rot(x, k) starts at bit Z - k of the doubled block
+    first.push_back( 0 );
+    for(int32_t r = 0; r < rows; r += 1)
+    {
+        for(int32_t c = 0; c < cols; c += 1)
+        {
+            const int32_t v = base[r * cols + c];
+            if( v < 0 )
+                continue;
+            const int32_t offset = (Z - v % Z) % Z;
+            list.push_back( { c * stride + offset / 64, offset % 64 } );
+        }
+        first.push_back( (int32_t)list.size() );
+    }
+}
+
+rshift_qc_encoder::~rshift_qc_encoder()
+{
+    free( doubled );
+}
+
+void rshift_qc_encoder::encode(void* __restrict ptr_parity, const void* __restrict ptr_info, const int32_t nFrames)
+{
+    const int32_t nBytes = (Z + 7) / 8;
+    for(int32_t f = 0; f < nFrames; f += 1)
+    {
+        const uint8_t* info   = (const uint8_t*)ptr_info   + (size_t)f * cols * nBytes;
+        uint8_t*       parity = (uint8_t*)      ptr_parity + (size_t)f * rows * nBytes;
+
+        for(int32_t c = 0; c < cols; c += 1)
+            double_bits(doubled + c * stride, info + c * nBytes, Z, funnel);
+
+        for(int32_t r = 0; r < rows; r += 1)
+            row(parity + r * nBytes, doubled, list.data() + first[r], first[r + 1] - first[r], Z, false);
+    }
+}
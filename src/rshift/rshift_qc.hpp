@@ -0,0 +1,85 @@
+/*
+ *	Quasi-cyclic (circulant) products over GF(2) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_qc_
+#define _rshift_qc_
+
+#include "rshift_common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//
+// dst ^= rot(src, k) (bit i of src XORed into bit (i + k) % nBits of dst)
+// without storing the rotated array: the rotation is computed in registers
+// and XORed into dst. Bits past nBits of dst are not modified. The kernel
+// is chosen once from rshift_isa_level().
+//
+extern void rotate_xor(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k);
+
+//
+// Product of a quasi-cyclic matrix by a vector over GF(2), as used by the
+// encoders of QC-LDPC codes: parity block r is the XOR over the columns c of
+// rot(info block c, base[r * cols + c]), a negative entry being a zero
+// block. Shift values are taken modulo Z (5G NR base graphs store
+// V = shift mod Z for the largest lifting size).
+//
+// Blocks are Z bit arrays stored as frames of (Z + 7) / 8 bytes (the layout
+// of the nFrames argument of rotate), cols of them per codeword for the
+// information and rows for the parity. Each information block is doubled
+// once per codeword in a workspace owned by the encoder; then every parity
+// block is accumulated chunk by chunk in vector registers over all its
+// terms and stored once, with no rotated temporary. The workspace makes
+// encode() non-reentrant: use one encoder per thread.
+//
+class rshift_qc_encoder
+{
+public:
+    // level: ISA of the kernels, -1 for the one bound by the dispatcher
+    rshift_qc_encoder(const int16_t* base, const int32_t rows, const int32_t cols, const int32_t Z, const int32_t level = -1);
+    ~rshift_qc_encoder();
+
+    rshift_qc_encoder(const rshift_qc_encoder&)            = delete;
+    rshift_qc_encoder& operator=(const rshift_qc_encoder&) = delete;
+
+    int32_t info_bits  () const { return cols * Z; }
+    int32_t parity_bits() const { return rows * Z; }
+    int32_t terms      () const { return (int32_t)list.size(); }
+
+    void encode(void* __restrict ptr_parity, const void* __restrict ptr_info, const int32_t nFrames = 1);
+
+private:
+    int32_t                            rows;
+    int32_t                            cols;
+    int32_t                            Z;
+    int32_t                            stride;    // words per doubled block
+    uint64_t*                          doubled;
+    std::vector<int32_t>               first;     // terms of row r: [first[r], first[r + 1])
+    std::vector<rshift_circulant_term> list;
+    rshift_funnel_t                    funnel;
+    rshift_circulant_t                 row;
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ *	Portable vector abstraction of the rshift_vec backend - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_simd_
+#define _rshift_simd_
+
+#include <cstdint>
+#include <cstring>
+#include "rshift.hpp"
+#include "rshift_common.hpp"
+
+//
+// The handful of operations on 64-bit lanes the rshift_vec kernels are
+// written against, so that they exist once for every target:
+//
+//  - NEON (AArch64, or x86 through rshift_neon_emulation.hpp when built
+//    with RSHIFT_NEON_EMULATION): uint64x2_t registers.
+//  - anywhere else: GCC/clang vector extensions on 4 lanes, lowered by the
+//    compiler to whatever the target has (two SSE or NEON registers, one
+//    AVX2 register, SVE in its fixed-length mode, scalar code). In the x86
+//    dispatch build they are compiled for AVX2, see RSHIFT_TARGET_VEC.
+//
+// RSHIFT_VEC_BASELINE marks the builds in which these kernels replace the
+// x86 ones as the lowest level of the runtime dispatch (every non-x86
+// target, and the emulation mode), RSHIFT_VEC_NAME the name they are
+// reported under.
+//
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(RSHIFT_NEON_EMULATION)
+    #define RSHIFT_SIMD_NEON
+    #define RSHIFT_VEC_NAME "neon"
+#else
+    #define RSHIFT_VEC_NAME "vec"
+#endif
+
+#if defined(RSHIFT_NEON_EMULATION) || !(defined(__x86_64__) || defined(__i386__))
+    #define RSHIFT_VEC_BASELINE
+#endif
+
+#if defined(RSHIFT_X86_DISPATCH) && !defined(RSHIFT_SIMD_NEON)
+    #define RSHIFT_TARGET_VEC __attribute__((target("avx2,popcnt")))
+    #define RSHIFT_VEC_LEVEL  RSHIFT_AVX2
+#else
+    #define RSHIFT_TARGET_VEC
+    #define RSHIFT_VEC_LEVEL  RSHIFT_X86
+#endif
+
+#ifdef RSHIFT_SIMD_NEON
+
+#ifdef RSHIFT_NEON_EMULATION
+    #include "rshift_neon_emulation.hpp"
+#else
+    #include <arm_neon.h>
+#endif
+
+typedef uint64x2_t simd_t;
+
+constexpr int32_t simd_lanes = 2;
+
+inline simd_t simd_load (const uint64_t* p)         { return vld1q_u64(p);    }
+inline void   simd_store(uint64_t* p, const simd_t a) { vst1q_u64(p, a);      }
+inline simd_t simd_zero ()                           { return vdupq_n_u64(0); }
+inline simd_t simd_set1 (const uint64_t x)           { return vdupq_n_u64(x); }
+
+// non-temporal store to a 16-byte aligned p: movntdq under the emulation,
+// stnp on AArch64 (ordered like a regular store, the fence is a no-op)
+inline void simd_stream(uint64_t* p, const simd_t a)
+{
+#if defined(RSHIFT_NEON_EMULATION)
+    _mm_stream_si128( (__m128i*)p, a.v );
+#elif defined(__aarch64__)
+    __asm__ volatile( "stnp %d1, %d2, [%0]" : : "r"(p), "w"(vget_low_u64(a)), "w"(vget_high_u64(a)) : "memory" );
+#else
+    vst1q_u64(p, a);
+#endif
+}
+
+inline void simd_stream_fence()
+{
+#if defined(RSHIFT_NEON_EMULATION)
+    _mm_sfence();
+#endif
+}
+
+inline simd_t simd_xor(const simd_t a, const simd_t b) { return veorq_u64(a, b); }
+inline simd_t simd_or (const simd_t a, const simd_t b) { return vorrq_u64(a, b); }
+inline simd_t simd_and(const simd_t a, const simd_t b) { return vandq_u64(a, b); }
+inline simd_t simd_add(const simd_t a, const simd_t b) { return vaddq_u64(a, b); }
+inline simd_t simd_sub(const simd_t a, const simd_t b) { return vsubq_u64(a, b); }
+
+// words below those of b: { a[1], b[0] }
+inline simd_t simd_below(const simd_t a, const simd_t b) { return vextq_u64(a, b, 1); }
+
+// 0 <= c <= 64, ushl giving 0 for a count of 64
+inline simd_t simd_shl(const simd_t a, const int32_t c) { return vshlq_u64(a, vdupq_n_s64( c)); }
+inline simd_t simd_shr(const simd_t a, const int32_t c) { return vshlq_u64(a, vdupq_n_s64(-c)); }
+
+// per-lane counts, 0 <= c[l] < 64
+inline simd_t simd_shlv(const simd_t a, const simd_t c) { return vshlq_u64(a, vreinterpretq_s64_u64(c)); }
+inline simd_t simd_shrv(const simd_t a, const simd_t c) { return vshlq_u64(a, vnegq_s64( vreinterpretq_s64_u64(c) )); }
+
+// (a >> b) | (n << (64 - b)) for 0 <= b < 64
+inline simd_t simd_funnel(const simd_t a, const simd_t n, const int32_t b)
+{
+    return simd_or( simd_shr(a, b), simd_shl(n, 64 - b) );
+}
+
+// population count of every lane
+inline simd_t simd_popcount(const simd_t a)
+{
+    return vpaddlq_u32( vpaddlq_u16( vpaddlq_u8( vcntq_u8( vreinterpretq_u8_u64(a) ) ) ) );
+}
+
+inline uint64_t simd_sum(const simd_t a)
+{
+    return vgetq_lane_u64(a, 0) + vgetq_lane_u64(a, 1);
+}
+
+#else
+
+typedef uint64_t simd_t __attribute__((vector_size(32)));
+
+constexpr int32_t simd_lanes = 4;
+
+RSHIFT_TARGET_VEC inline simd_t simd_load(const uint64_t* p)
+{
+    simd_t a;
+    memcpy(&a, p, sizeof(simd_t));
+    return a;
+}
+
+RSHIFT_TARGET_VEC inline void simd_store(uint64_t* p, const simd_t a)
+{
+    memcpy(p, &a, sizeof(simd_t));
+}
+
+// non-temporal store to a 32-byte aligned p: vmovntdq in the x86 dispatch
+// build, the clang builtin elsewhere, a regular store with GCC
+RSHIFT_TARGET_VEC inline void simd_stream(uint64_t* p, const simd_t a)
+{
+#if defined(RSHIFT_X86_DISPATCH)
+    _mm256_stream_si256( (__m256i*)p, (__m256i)a );
+#elif defined(__clang__)
+    __builtin_nontemporal_store( a, (simd_t*)p );
+#else
+    simd_store(p, a);
+#endif
+}
+
+inline void simd_stream_fence()
+{
+#if defined(RSHIFT_X86_DISPATCH)
+    _mm_sfence();
+#endif
+}
+
+RSHIFT_TARGET_VEC inline simd_t simd_zero() { return simd_t{0, 0, 0, 0}; }
+RSHIFT_TARGET_VEC inline simd_t simd_set1(const uint64_t x) { return simd_t{x, x, x, x}; }
+
+RSHIFT_TARGET_VEC inline simd_t simd_xor(const simd_t a, const simd_t b) { return a ^ b; }
+RSHIFT_TARGET_VEC inline simd_t simd_or (const simd_t a, const simd_t b) { return a | b; }
+RSHIFT_TARGET_VEC inline simd_t simd_and(const simd_t a, const simd_t b) { return a & b; }
+RSHIFT_TARGET_VEC inline simd_t simd_add(const simd_t a, const simd_t b) { return a + b; }
+RSHIFT_TARGET_VEC inline simd_t simd_sub(const simd_t a, const simd_t b) { return a - b; }
+
+// words below those of b: { a[3], b[0], b[1], b[2] }
+RSHIFT_TARGET_VEC inline simd_t simd_below(const simd_t a, const simd_t b)
+{
+#if defined(__clang__)
+    return __builtin_shufflevector(a, b, 3, 4, 5, 6);
+#else
+    typedef int64_t index_t __attribute__((vector_size(32)));
+    return __builtin_shuffle(a, b, index_t{3, 4, 5, 6});
+#endif
+}
+
+// 0 <= c < 64, larger counts being undefined for vector extensions too
+RSHIFT_TARGET_VEC inline simd_t simd_shl(const simd_t a, const int32_t c) { return a << c; }
+RSHIFT_TARGET_VEC inline simd_t simd_shr(const simd_t a, const int32_t c) { return a >> c; }
+
+// per-lane counts, 0 <= c[l] < 64
+RSHIFT_TARGET_VEC inline simd_t simd_shlv(const simd_t a, const simd_t c) { return a << c; }
+RSHIFT_TARGET_VEC inline simd_t simd_shrv(const simd_t a, const simd_t c) { return a >> c; }
+
+// (a >> b) | (n << (64 - b)) for 0 <= b < 64, without a shift by 64
+RSHIFT_TARGET_VEC inline simd_t simd_funnel(const simd_t a, const simd_t n, const int32_t b)
+{
+    return (a >> b) | ((n << 1) << (63 - b));
+}
+
+RSHIFT_TARGET_VEC inline simd_t simd_popcount(const simd_t a)
+{
+    simd_t r;
+    for(int32_t l = 0; l < simd_lanes; l += 1)
+        r[l] = __builtin_popcountll( a[l] );
+    return r;
+}
+
+RSHIFT_TARGET_VEC inline uint64_t simd_sum(const simd_t a)
+{
+    return a[0] + a[1] + a[2] + a[3];
+}
+
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ *	Bit-sliced batches of frames - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_sliced.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_vec.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static rshift_transpose_t select_transpose()
+{
+    const int32_t level = rshift_isa_level();
+#ifdef RSHIFT_HAS_AVX2
+    if( level >= RSHIFT_AVX2 ) return transpose64x4_avx2;
+#endif
+    (void)level;
+#ifdef RSHIFT_VEC_BASELINE
+    return transpose64x4_vec;
+#else
+    return transpose64x4_x86;
+#endif
+}
+
+rshift_sliced::rshift_sliced(const int32_t nBits, const int64_t nFrames)
+    : size( nBits ), frames( nFrames ), offset( 0 )
+{
+    if( (nBits <= 0) || (nFrames <= 0) )
+    {
+        printf("(EE) rshift_sliced: invalid batch (%d bits, %lld frames)\n", nBits, (long long)nFrames);
+        exit( EXIT_FAILURE );
+    }
+    const size_t bytes = (size_t)groups() * size * 4 * sizeof(uint64_t);
+    w = (uint64_t*)aligned_alloc(64, (bytes + 63) / 64 * 64);
+    if( w == nullptr )
+    {
+        printf("(EE) rshift_sliced: out of memory\n");
+        exit( EXIT_FAILURE );
+    }
+    memset(w, 0, bytes);
+}
+
+rshift_sliced::~rshift_sliced()
+{
+    free( w );
+}
+
+//
+// Word c of the 256 frames of a group (zero past the last frame) makes four
+// 64 x 64 matrices, whose transposes are the slices 64 c to 64 c + 63.
+//
+void rshift_sliced::load(const void* ptr_frames)
+{
+    static const rshift_transpose_t transpose = select_transpose();
+
+    const uint8_t* src    = (const uint8_t*)ptr_frames;
+    const int32_t  nBytes = (size + 7) / 8;
+    alignas(64) uint64_t t[4 * 64];
+
+    offset = 0;
+    for(int64_t g = 0; g < groups(); g += 1)
+    {
+        for(int32_t c = 0; c < (size + 63) / 64; c += 1)
+        {
+            const int32_t len = (nBytes - 8 * c < 8) ? nBytes - 8 * c : 8;
+            for(int32_t b = 0; b < 4; b += 1)
+            {
+                for(int32_t r = 0; r < 64; r += 1)
+                {
+                    const int64_t f = group * g + 64 * b + r;
+                    uint64_t      v = 0;
+                    if( f < frames )
+                        memcpy(&v, src + f * nBytes + 8 * c, len);
+                    t[4 * r + b] = v;
+                }
+            }
+            transpose( t );
+            const int32_t rows = (size - 64 * c < 64) ? size - 64 * c : 64;
+            memcpy(w + 4 * (g * size + 64 * c), t, rows * 4 * sizeof(uint64_t));
+        }
+    }
+}
+
+void rshift_sliced::store(void* ptr_frames) const
+{
+    static const rshift_transpose_t transpose = select_transpose();
+
+    uint8_t*      dst    = (uint8_t*)ptr_frames;
+    const int32_t nBytes = (size + 7) / 8;
+    alignas(64) uint64_t t[4 * 64];
+
+    for(int64_t g = 0; g < groups(); g += 1)
+    {
+        for(int32_t c = 0; c < (size + 63) / 64; c += 1)
+        {
+            const int32_t rows = (size - 64 * c < 64) ? size - 64 * c : 64;
+            for(int32_t j = 0; j < rows; j += 1)
+                memcpy(t + 4 * j, slice(g, 64 * c + j), 4 * sizeof(uint64_t));
+            memset(t + 4 * rows, 0, (64 - rows) * 4 * sizeof(uint64_t));
+            transpose( t );
+
+            const int32_t len = (nBytes - 8 * c < 8) ? nBytes - 8 * c : 8;
+            for(int32_t b = 0; b < 4; b += 1)
+            {
+                for(int32_t r = 0; r < 64; r += 1)
+                {
+                    const int64_t f = group * g + 64 * b + r;
+                    if( f < frames )
+                        memcpy(dst + f * nBytes + 8 * c, t + 4 * r + b, len);
+                }
+            }
+        }
+    }
+}
+
+void rshift_sliced::apply()
+{
+    if( offset == 0 )
+        return;
+    uint64_t* tmp = (uint64_t*)malloc( (size_t)size * 4 * sizeof(uint64_t) );
+    if( tmp == nullptr )
+    {
+        printf("(EE) rshift_sliced: out of memory\n");
+        exit( EXIT_FAILURE );
+    }
+    for(int64_t g = 0; g < groups(); g += 1)
+    {
+        uint64_t* s = w + 4 * g * size;
+        memcpy(tmp, s, (size_t)size * 4 * sizeof(uint64_t));
+        memcpy(s + 4 * offset, tmp,                         (size_t)(size - offset) * 4 * sizeof(uint64_t));
+        memcpy(s,              tmp + 4 * (size - offset), (size_t)offset          * 4 * sizeof(uint64_t));
+    }
+    free( tmp );
+    offset = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ *	Bit-sliced batches of frames - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_sliced_
+#define _rshift_sliced_
+
+#include <cstdint>
+
+//
+// Batch of nFrames frames of nBits bits in bit-sliced (transposed) form:
+// slice i of a group of 256 consecutive frames holds bit i of each of them,
+// frame 256 g + f at bit f % 64 of word f / 64 of the slices of group g.
+// Rotating every frame by the same amount is then a relabelling of the
+// slices: rotate() only adds k to the offset modulo nBits, as rshift_view
+// does, and moves no data. Slice i is stored slice (i - offset) % nBits.
+//
+// load() and store() convert from and to the packed frames of rotate()
+// (frames (nBits + 7) / 8 bytes apart, the bit_pack_x86 layout) by 64 x 64
+// bit transposes of 256 frames at a time (vector delta swaps, one AVX2
+// register per row, or 8 x 8 blocks in scalar code); store() applies the
+// pending rotation on the way. The bits past nBits of the last byte of each
+// frame are written as 0. A slice operation (XOR of two batches, a parity
+// check...) works on 256 frames per AVX2 instruction.
+//
+// The conversions cost about as much as one rotation of the frames, so the
+// layout pays off when several rotations (or slice operations) happen
+// between a load() and a store(); the benchmark (--sliced) compares it with
+// permutation_avx2 over the batch sizes.
+//
+class rshift_sliced
+{
+public:
+    static constexpr int32_t group = 256;    // frames per slice
+
+    rshift_sliced(const int32_t nBits, const int64_t nFrames);
+    ~rshift_sliced();
+
+    rshift_sliced(const rshift_sliced&)            = delete;
+    rshift_sliced& operator=(const rshift_sliced&) = delete;
+
+    int32_t nBits  () const { return size;   }
+    int64_t nFrames() const { return frames; }
+    int64_t groups () const { return (frames + group - 1) / group; }
+    int32_t pending() const { return offset; }
+
+    void load (const void* ptr_frames);
+    void store(void* ptr_frames) const;
+
+    void rotate(const int32_t k)
+    {
+        offset = (int32_t)((((int64_t)offset + k) % size + size) % size);
+    }
+
+    void rotate_right(const int32_t k) { rotate( -(k % size) ); }
+    void permutation ()                { rotate( 1 );           }
+
+    // bit i of the frames of group g (4 words), the rotation included
+    uint64_t* slice(const int64_t g, const int32_t i)
+    {
+        const int32_t p = (i >= offset) ? i - offset : i - offset + size;
+        return w + 4 * (g * size + p);
+    }
+
+    const uint64_t* slice(const int64_t g, const int32_t i) const
+    {
+        const int32_t p = (i >= offset) ? i - offset : i - offset + size;
+        return w + 4 * (g * size + p);
+    }
+
+    // moves the slices so that the pending rotation becomes 0
+    void apply();
+
+private:
+    int32_t   size;
+    int64_t   frames;
+    int32_t   offset;
+    uint64_t* w;
+};
+
+#endif
@@ -25,252 +25,471 @@
 
 #ifndef _rshift_sse4_
 #define _rshift_sse4_
-#ifdef __SSE4_2__
+
+#include "rshift_common.hpp"
+#include "rshift_x86.hpp"
+#ifdef RSHIFT_HAS_SSE4
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstdint>
 #include <immintrin.h>
 
-void permutation_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+RSHIFT_TARGET_SSE4 inline void funnel_sse4(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    int32_t x = 0;
+    for(; x + 2 <= nWords; x += 2)
+    {
+        const __m128i A = _mm_loadu_si128( (const __m128i*)(src + x    ) );
+        const __m128i B = _mm_loadu_si128( (const __m128i*)(src + x + 1) );
+        const __m128i D = _mm_or_si128( _mm_srl_epi64(A, cr), _mm_sll_epi64(B, cl) );
+        _mm_storeu_si128( (__m128i*)(dst + x), D );
+    }
+    if( x < nWords )
+        dst[x] = (b == 0) ? src[x] : (src[x] >> b) | (src[x + 1] << (64 - b));
+}
+
+//
+// Non-temporal variant of funnel_sse4: the words up to the first 16-byte
+// boundary of dst and the last odd word use regular stores, the others
+// movntdq. The caller issues the sfence.
+//
+RSHIFT_TARGET_SSE4 inline void funnel_sse4_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    if( ((uintptr_t)dst % 8 != 0) || (nWords < 4) )
+    {
+        funnel_sse4(dst, src, nWords, b);
+        return;
+    }
+    const int32_t head = ((uintptr_t)dst % 16) / 8;
+    funnel_sse4(dst, src, head, b);
+
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    int32_t x = head;
+    for(; x + 2 <= nWords; x += 2)
+    {
+        const __m128i A = _mm_loadu_si128( (const __m128i*)(src + x    ) );
+        const __m128i B = _mm_loadu_si128( (const __m128i*)(src + x + 1) );
+        _mm_stream_si128( (__m128i*)(dst + x), _mm_or_si128( _mm_srl_epi64(A, cr), _mm_sll_epi64(B, cl) ) );
+    }
+    funnel_sse4(dst + x, src + x, nWords - x, b);
+}
+
+//
+// Funnel copy to a 16-byte aligned dst that may be written up to the next
+// multiple of 2 words (padded arrays): aligned stores and no odd last word.
+//
+RSHIFT_TARGET_SSE4 inline void funnel_sse4_padded(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    const __m128i cr = _mm_cvtsi32_si128( b      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - b );
+    for(int32_t x = 0; x < nWords; x += 2)
+    {
+        const __m128i A = _mm_loadu_si128( (const __m128i*)(src + x    ) );
+        const __m128i B = _mm_loadu_si128( (const __m128i*)(src + x + 1) );
+        _mm_store_si128( (__m128i*)(dst + x), _mm_or_si128( _mm_srl_epi64(A, cr), _mm_sll_epi64(B, cl) ) );
+    }
+}
+
+//
+// Compile-time sized kernels, NBits being a multiple of 128 (other sizes are
+// forwarded to the x86 templates). Every register is processed by the same
+// unrolled loop body, the carry of register x coming from register x - 1.
+//
+template<int32_t NBits>
+RSHIFT_TARGET_SSE4 inline void permutation_sse4(void* ptr_bit_array)
+{
+    if constexpr ( NBits % 128 != 0 )
+    {
+        permutation_x86<NBits>(ptr_bit_array);
+    }
+    else
+    {
+        constexpr int32_t regs = NBits / 128;
+        __m128i A[regs], B[regs], C[regs];
+
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            A[x] = _mm_loadu_si128( ((const __m128i*)ptr_bit_array) + x );
+            B[x] = _mm_slli_epi64 (A[x],  1);
+            C[x] = _mm_srli_epi64 (A[x], 63);
+        }
+
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            const __m128d P = _mm_castsi128_pd( C[(x + regs - 1) % regs] );
+            const __m128i D = _mm_castpd_si128( _mm_shuffle_pd(P, _mm_castsi128_pd(C[x]), 1) );
+            _mm_storeu_si128( ((__m128i*)ptr_bit_array) + x, _mm_or_si128(B[x], D) );
+        }
+    }
+}
+
+template<int32_t NBits>
+RSHIFT_TARGET_SSE4 inline void rotate_sse4(void* ptr_bit_array, const int32_t k)
+{
+    if constexpr ( NBits % 128 != 0 )
+    {
+        rotate_x86<NBits>(ptr_bit_array, k);
+    }
+    else
+    {
+        const int32_t shift = ((k % NBits) + NBits) % NBits;
+        if( shift == 0 )
+            return;
+
+        constexpr int32_t words = NBits / 64;
+        uint64_t tmp[2 * words + 2];
+
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < words; x += 2)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(((uint64_t*)ptr_bit_array) + x) );
+            _mm_storeu_si128( (__m128i*)(tmp + x),         A );
+            _mm_storeu_si128( (__m128i*)(tmp + x + words), A );
+        }
+        tmp[2 * words    ] = 0;
+        tmp[2 * words + 1] = 0;
+
+        const uint64_t* src = tmp + (NBits - shift) / 64;
+        const __m128i   cr  = _mm_cvtsi32_si128( (NBits - shift) % 64      );
+        const __m128i   cl  = _mm_cvtsi32_si128( 64 - (NBits - shift) % 64 );
+
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < words; x += 2)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(src + x    ) );
+            const __m128i B = _mm_loadu_si128( (const __m128i*)(src + x + 1) );
+            const __m128i D = _mm_or_si128( _mm_srl_epi64(A, cr), _mm_sll_epi64(B, cl) );
+            _mm_storeu_si128( (__m128i*)(((uint64_t*)ptr_bit_array) + x), D );
+        }
+    }
+}
+
+RSHIFT_SIZED_TABLES(sse4)
+
+//
+// One-bit cyclic rotation of nFrames contiguous frames of nBits each (frames
+// are (nBits + 7) / 8 bytes apart). Four 32-bit or two 64-bit frames share
+// one register.
+//
+RSHIFT_TARGET_SSE4 inline void permutation_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(bit_array + f) );
+            const __m128i D = _mm_or_si128( _mm_slli_epi32(A, 1), _mm_srli_epi32(A, 31) );
+            _mm_storeu_si128( (__m128i*)(bit_array + f), D );
+        }
+        for(; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << 1) | (bit_array[f] >> 31);
+    }
+    else if( nBits == 64 )
+    {
+        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(bit_array + f) );
+            const __m128i D = _mm_or_si128( _mm_slli_epi64(A, 1), _mm_srli_epi64(A, 63) );
+            _mm_storeu_si128( (__m128i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+            bit_array[f] = (bit_array[f] << 1) | (bit_array[f] >> 63);
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_permutation_t kernel = permutation_sse4_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64) );
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1, funnel_sse4);
+    }
+
+}
+
+//
+// Cyclic rotation by k positions in a single pass (see rotate_x86), the
+// funnel copy working on 128-bit lanes. Any nBits is accepted and nFrames
+// contiguous frames are rotated by the same amount.
+//
+RSHIFT_TARGET_SSE4 inline void rotate_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
 {
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
     if( nBits == 32 )
     {
         uint32_t* bit_array = (uint32_t*)ptr_bit_array;
-        bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 31);
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 32 - shift );
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(bit_array + f) );
+            const __m128i D = _mm_or_si128( _mm_sll_epi32(A, cl), _mm_srl_epi32(A, cr) );
+            _mm_storeu_si128( (__m128i*)(bit_array + f), D );
+        }
+        for(; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (32 - shift));
     }
     else if( nBits == 64 )
     {
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 63);
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 64 - shift );
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(bit_array + f) );
+            const __m128i D = _mm_or_si128( _mm_sll_epi64(A, cl), _mm_srl_epi64(A, cr) );
+            _mm_storeu_si128( (__m128i*)(bit_array + f), D );
+        }
+        if( f < nFrames )
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (64 - shift));
     }
-    else if( nBits == 128 )
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
     {
-        const __m128i A  = _mm_loadu_si128((const __m128i*) ptr_bit_array);
-        const __m128i B0 = _mm_slli_epi64 (A,  1);
-        const __m128i B1 = _mm_srli_epi64 (A, 63);
-        const __m128i C0 = _mm_castpd_si128( _mm_permute_pd(_mm_castsi128_pd(B1), 1) );
-        const __m128i D0 = _mm_or_si128(B0, C0);
-        _mm_storeu_si128((__m128i*) ptr_bit_array, D0);
+        const rshift_sized_rotate_t kernel = rotate_sse4_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
     }
-    else if( nBits == 256 )
+    else
     {
-        const __m128i A0 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array))     );
-        const __m128i A1 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 1 );
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift, funnel_sse4);
+    }
+}
 
-        const __m128i B0 = _mm_slli_epi64 (A0,  1);
-        const __m128i B1 = _mm_srli_epi64 (A0, 63);     // B1
+//
+// Out-of-place variants (see rotate_x86 for the contract). 32- and 64-bit
+// frames are packed four or two per register as in place, streamed when
+// dst is 16-byte aligned; the other sizes go through rotate_copy.
+//
+RSHIFT_TARGET_SSE4 inline void rotate_sse4(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    const bool    nt    = stream && ((uintptr_t)ptr_dst % 16 == 0);
 
-        const __m128i B2 = _mm_slli_epi64 (A1,  1);
-        const __m128i B3 = _mm_srli_epi64 (A1, 63);     // B3
+    if( nBits == 32 )
+    {
+        const uint32_t* src = (const uint32_t*)ptr_src;
+        uint32_t*       dst = (uint32_t*)ptr_dst;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 32 - shift );
+        int32_t f = 0;
+        for(; f + 4 <= nFrames; f += 4)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(src + f) );
+            const __m128i D = _mm_or_si128( _mm_sll_epi32(A, cl), _mm_srl_epi32(A, cr) );
+            if( nt ) _mm_stream_si128( (__m128i*)(dst + f), D );
+            else     _mm_storeu_si128( (__m128i*)(dst + f), D );
+        }
+        for(; f < nFrames; f += 1)
+            dst[f] = (src[f] << shift) | (src[f] >> ((32 - shift) % 32));
+    }
+    else if( nBits == 64 )
+    {
+        const uint64_t* src = (const uint64_t*)ptr_src;
+        uint64_t*       dst = (uint64_t*)ptr_dst;
+        const __m128i cl = _mm_cvtsi32_si128( shift      );
+        const __m128i cr = _mm_cvtsi32_si128( 64 - shift );
+        int32_t f = 0;
+        for(; f + 2 <= nFrames; f += 2)
+        {
+            const __m128i A = _mm_loadu_si128( (const __m128i*)(src + f) );
+            const __m128i D = _mm_or_si128( _mm_sll_epi64(A, cl), _mm_srl_epi64(A, cr) );
+            if( nt ) _mm_stream_si128( (__m128i*)(dst + f), D );
+            else     _mm_storeu_si128( (__m128i*)(dst + f), D );
+        }
+        if( f < nFrames )
+            dst[f] = (src[f] << shift) | (src[f] >> ((64 - shift) % 64));
+    }
+    else
+    {
+        rotate_copy(ptr_dst, ptr_src, nBits, shift, nFrames, funnel_sse4, stream ? funnel_sse4_stream : nullptr);
+    }
+
+    if( stream )
+        _mm_sfence();
+}
 
-        const __m128i C0 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B3), _mm_castsi128_pd(B1), 1) );
-        const __m128i C1 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B1), _mm_castsi128_pd(B3), 1) );
+RSHIFT_TARGET_SSE4 inline void permutation_sse4(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_sse4(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+
+//
+// Rotations toward the low bits, the inverse of permutation_sse4 /
+// rotate_sse4.
+//
+RSHIFT_TARGET_SSE4 inline void rotate_right_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    rotate_sse4(ptr_bit_array, nBits, -(k % nBits), nFrames);
+}
 
-        const __m128i D0 = _mm_or_si128(B0, C0);
-        const __m128i D1 = _mm_or_si128(B2, C1);
+RSHIFT_TARGET_SSE4 inline void permutation_right_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    rotate_sse4(ptr_bit_array, nBits, nBits - 1, nFrames);
+}
 
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array),    D0);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 1, D1);
+//
+// Word kernels of the non-cyclic shifts, two words per register. Every
+// register is loaded before the overlapping store of the previous one, so
+// the descending (shl) and ascending (shr) orders work in place.
+//
+RSHIFT_TARGET_SSE4 inline void shl_words_sse4(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    const __m128i cl = _mm_cvtsi32_si128( k      );
+    const __m128i cr = _mm_cvtsi32_si128( 64 - k );
+    int32_t x = nWords - 2;
+    for(; x >= 1; x -= 2)
+    {
+        const __m128i A = _mm_loadu_si128( (const __m128i*)(w + x    ) );
+        const __m128i B = _mm_loadu_si128( (const __m128i*)(w + x - 1) );
+        _mm_storeu_si128( (__m128i*)(w + x), _mm_or_si128( _mm_sll_epi64(A, cl), _mm_srl_epi64(B, cr) ) );
     }
-    else if( nBits == 512 )
+    for(x = x + 1; x >= 1; x -= 1)
+        w[x] = funnel_left(w[x], w[x - 1], k);
+}
+
+RSHIFT_TARGET_SSE4 inline void shr_words_sse4(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    const __m128i cr = _mm_cvtsi32_si128( k      );
+    const __m128i cl = _mm_cvtsi32_si128( 64 - k );
+    int32_t x = 0;
+    for(; x + 2 < nWords; x += 2)
+    {
+        const __m128i A = _mm_loadu_si128( (const __m128i*)(w + x    ) );
+        const __m128i B = _mm_loadu_si128( (const __m128i*)(w + x + 1) );
+        _mm_storeu_si128( (__m128i*)(w + x), _mm_or_si128( _mm_srl_epi64(A, cr), _mm_sll_epi64(B, cl) ) );
+    }
+    for(; x < nWords - 1; x += 1)
+        w[x] = funnel_right(w[x], w[x + 1], k);
+}
+
+RSHIFT_TARGET_SSE4 inline uint64_t shift_left_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_left_generic(ptr_bit_array, nBits, k, carry_in, shl_words_sse4);
+}
+
+RSHIFT_TARGET_SSE4 inline uint64_t shift_right_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_right_generic(ptr_bit_array, nBits, k, carry_in, shr_words_sse4);
+}
+
+//
+// Rotation of a padded array (see rotate_padded_generic): the sizes handled
+// by the register-resident kernels go to rotate_sse4, the others are done
+// on whole words with aligned stores.
+//
+RSHIFT_TARGET_SSE4 inline void rotate_padded_sse4(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( (nBits % 64 == 0) || (nBits == 32) )
+        rotate_sse4(ptr_bit_array, nBits, shift);
+    else if( shift != 0 )
+        rotate_padded_generic(ptr_bit_array, nBits, shift, funnel_sse4, funnel_sse4_padded);
+}
+
+//
+// Circulant kernel (see rshift_circulant_t) on chunks of up to 4 xmm
+// accumulators (8 words), the last chunk of a block using only the V
+// registers it needs.
+//
+template<int32_t V>
+RSHIFT_TARGET_SSE4 inline void circulant_chunk_sse4(uint8_t* dst, const uint64_t* doubled, const int32_t j, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    const bool whole = (nBits >= 64 * 2 * V);
+    alignas(16) uint64_t tmp[2 * V];
+    const uint64_t* in = (const uint64_t*)dst;
+    if( accumulate && (whole == false) )
     {
-        const __m128i A0 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array))     );
-        const __m128i A1 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 1 );
-        const __m128i A2 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 2 );
-        const __m128i A3 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 3 );
-
-        const __m128i B0 = _mm_slli_epi64 (A0,  1);
-        const __m128i B2 = _mm_slli_epi64 (A1,  1);
-        const __m128i B4 = _mm_slli_epi64 (A2,  1);
-        const __m128i B6 = _mm_slli_epi64 (A3,  1);
-
-        const __m128i B1 = _mm_srli_epi64 (A0, 63);
-        const __m128i B3 = _mm_srli_epi64 (A1, 63);
-        const __m128i B5 = _mm_srli_epi64 (A2, 63);
-        const __m128i B7 = _mm_srli_epi64 (A3, 63);
-
-        const __m128i C0 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B7), _mm_castsi128_pd(B1), 1) );
-        const __m128i C1 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B1), _mm_castsi128_pd(B3), 1) );
-        const __m128i C2 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B3), _mm_castsi128_pd(B5), 1) );
-        const __m128i C3 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B5), _mm_castsi128_pd(B7), 1) );
-
-        const __m128i D0 = _mm_or_si128(B0, C0);
-        const __m128i D1 = _mm_or_si128(B2, C1);
-        const __m128i D2 = _mm_or_si128(B4, C2);
-        const __m128i D3 = _mm_or_si128(B6, C3);
-
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array),    D0);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 1, D1);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 2, D2);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 3, D3);
+        load_bits(tmp, 2 * V, dst, nBits);
+        in = tmp;
     }
-    else if( nBits == 1024 )
+
+    __m128i a[V];
+    for(int32_t v = 0; v < V; v += 1)
+        a[v] = _mm_setzero_si128();
+    if( accumulate )
     {
-        const __m128i A0 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array))     );
-        const __m128i A1 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 1 );
-        const __m128i A2 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 2 );
-        const __m128i A3 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 3 );
-        const __m128i A4 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 4 );
-        const __m128i A5 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 5 );
-        const __m128i A6 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 6 );
-        const __m128i A7 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 7 );
-
-        const __m128i B0  = _mm_slli_epi64 (A0,  1);
-        const __m128i B2  = _mm_slli_epi64 (A1,  1);
-        const __m128i B4  = _mm_slli_epi64 (A2,  1);
-        const __m128i B6  = _mm_slli_epi64 (A3,  1);
-        const __m128i B8  = _mm_slli_epi64 (A4,  1);
-        const __m128i B10 = _mm_slli_epi64 (A5,  1);
-        const __m128i B12 = _mm_slli_epi64 (A6,  1);
-        const __m128i B14 = _mm_slli_epi64 (A7,  1);
-
-        const __m128i B1  = _mm_srli_epi64 (A0, 63);
-        const __m128i B3  = _mm_srli_epi64 (A1, 63);
-        const __m128i B5  = _mm_srli_epi64 (A2, 63);
-        const __m128i B7  = _mm_srli_epi64 (A3, 63);
-        const __m128i B9  = _mm_srli_epi64 (A4, 63);
-        const __m128i B11 = _mm_srli_epi64 (A5, 63);
-        const __m128i B13 = _mm_srli_epi64 (A6, 63);
-        const __m128i B15 = _mm_srli_epi64 (A7, 63);
-
-        const __m128i C0 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B15), _mm_castsi128_pd(B1),  1) );
-        const __m128i C1 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B1),  _mm_castsi128_pd(B3),  1) );
-        const __m128i C2 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B3),  _mm_castsi128_pd(B5),  1) );
-        const __m128i C3 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B5),  _mm_castsi128_pd(B7),  1) );
-        const __m128i C4 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B7),  _mm_castsi128_pd(B9),  1) );
-        const __m128i C5 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B9),  _mm_castsi128_pd(B11), 1) );
-        const __m128i C6 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B11), _mm_castsi128_pd(B13), 1) );
-        const __m128i C7 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B13), _mm_castsi128_pd(B15), 1) );
-
-        const __m128i D0 = _mm_or_si128(B0,  C0);
-        const __m128i D1 = _mm_or_si128(B2,  C1);
-        const __m128i D2 = _mm_or_si128(B4,  C2);
-        const __m128i D3 = _mm_or_si128(B6,  C3);
-        const __m128i D4 = _mm_or_si128(B8,  C4);
-        const __m128i D5 = _mm_or_si128(B10, C5);
-        const __m128i D6 = _mm_or_si128(B12, C6);
-        const __m128i D7 = _mm_or_si128(B14, C7);
-
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array),    D0);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 1, D1);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 2, D2);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 3, D3);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 4, D4);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 5, D5);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 6, D6);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 7, D7);
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = _mm_loadu_si128( (const __m128i*)(in + 2 * v) );
     }
-    else if( nBits == 2048 )
+    for(int32_t t = 0; t < nTerms; t += 1)
     {
-        const __m128i A0  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array))        );
-        const __m128i A1  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  1 );
-        const __m128i A2  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  2 );
-        const __m128i A3  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  3 );
-        const __m128i A4  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  4 );
-        const __m128i A5  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  5 );
-        const __m128i A6  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  6 );
-        const __m128i A7  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  7 );
-        const __m128i A8  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  8 );
-        const __m128i A9  = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) +  9 );
-        const __m128i A10 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 10 );
-        const __m128i A11 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 11 );
-        const __m128i A12 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 12 );
-        const __m128i A13 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 13 );
-        const __m128i A14 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 14 );
-        const __m128i A15 = _mm_loadu_si128( ((const __m128i*) (ptr_bit_array)) + 15 );
-
-        const __m128i B0  = _mm_slli_epi64 (A0,   1);
-        const __m128i B2  = _mm_slli_epi64 (A1,   1);
-        const __m128i B4  = _mm_slli_epi64 (A2,   1);
-        const __m128i B6  = _mm_slli_epi64 (A3,   1);
-        const __m128i B8  = _mm_slli_epi64 (A4,   1);
-        const __m128i B10 = _mm_slli_epi64 (A5,   1);
-        const __m128i B12 = _mm_slli_epi64 (A6,   1);
-        const __m128i B14 = _mm_slli_epi64 (A7,   1);
-        const __m128i B16 = _mm_slli_epi64 (A8,   1);
-        const __m128i B18 = _mm_slli_epi64 (A9,   1);
-        const __m128i B20 = _mm_slli_epi64 (A10,  1);
-        const __m128i B22 = _mm_slli_epi64 (A11,  1);
-        const __m128i B24 = _mm_slli_epi64 (A12,  1);
-        const __m128i B26 = _mm_slli_epi64 (A13,  1);
-        const __m128i B28 = _mm_slli_epi64 (A14,  1);
-        const __m128i B30 = _mm_slli_epi64 (A15,  1);
-
-        const __m128i B1  = _mm_srli_epi64 (A0,  63);
-        const __m128i B3  = _mm_srli_epi64 (A1,  63);
-        const __m128i B5  = _mm_srli_epi64 (A2,  63);
-        const __m128i B7  = _mm_srli_epi64 (A3,  63);
-        const __m128i B9  = _mm_srli_epi64 (A4,  63);
-        const __m128i B11 = _mm_srli_epi64 (A5,  63);
-        const __m128i B13 = _mm_srli_epi64 (A6,  63);
-        const __m128i B15 = _mm_srli_epi64 (A7,  63);
-        const __m128i B17 = _mm_srli_epi64 (A8,  63);
-        const __m128i B19 = _mm_srli_epi64 (A9,  63);
-        const __m128i B21 = _mm_srli_epi64 (A10, 63);
-        const __m128i B23 = _mm_srli_epi64 (A11, 63);
-        const __m128i B25 = _mm_srli_epi64 (A12, 63);
-        const __m128i B27 = _mm_srli_epi64 (A13, 63);
-        const __m128i B29 = _mm_srli_epi64 (A14, 63);
-        const __m128i B31 = _mm_srli_epi64 (A15, 63);
-
-        const __m128i C0  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B31), _mm_castsi128_pd(B1),  1) );
-        const __m128i C1  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B1),  _mm_castsi128_pd(B3),  1) );
-        const __m128i C2  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B3),  _mm_castsi128_pd(B5),  1) );
-        const __m128i C3  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B5),  _mm_castsi128_pd(B7),  1) );
-        const __m128i C4  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B7),  _mm_castsi128_pd(B9),  1) );
-        const __m128i C5  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B9),  _mm_castsi128_pd(B11), 1) );
-        const __m128i C6  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B11), _mm_castsi128_pd(B13), 1) );
-        const __m128i C7  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B13), _mm_castsi128_pd(B15), 1) );
-        const __m128i C8  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B15), _mm_castsi128_pd(B17), 1) );
-        const __m128i C9  = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B17), _mm_castsi128_pd(B19), 1) );
-        const __m128i C10 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B19), _mm_castsi128_pd(B21), 1) );
-        const __m128i C11 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B21), _mm_castsi128_pd(B23), 1) );
-        const __m128i C12 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B23), _mm_castsi128_pd(B25), 1) );
-        const __m128i C13 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B25), _mm_castsi128_pd(B27), 1) );
-        const __m128i C14 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B27), _mm_castsi128_pd(B29), 1) );
-        const __m128i C15 = _mm_castpd_si128( _mm_shuffle_pd(_mm_castsi128_pd(B29), _mm_castsi128_pd(B31), 1) );
-
-        const __m128i D0  = _mm_or_si128(B0,  C0);
-        const __m128i D1  = _mm_or_si128(B2,  C1);
-        const __m128i D2  = _mm_or_si128(B4,  C2);
-        const __m128i D3  = _mm_or_si128(B6,  C3);
-        const __m128i D4  = _mm_or_si128(B8,  C4);
-        const __m128i D5  = _mm_or_si128(B10, C5);
-        const __m128i D6  = _mm_or_si128(B12, C6);
-        const __m128i D7  = _mm_or_si128(B14, C7);
-        const __m128i D8  = _mm_or_si128(B16, C8);
-        const __m128i D9  = _mm_or_si128(B18, C9);
-        const __m128i D10 = _mm_or_si128(B20, C10);
-        const __m128i D11 = _mm_or_si128(B22, C11);
-        const __m128i D12 = _mm_or_si128(B24, C12);
-        const __m128i D13 = _mm_or_si128(B26, C13);
-        const __m128i D14 = _mm_or_si128(B28, C14);
-        const __m128i D15 = _mm_or_si128(B30, C15);
-
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array),    D0);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  1, D1);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  2, D2);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  3, D3);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  4, D4);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  5, D5);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  6, D6);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  7, D7);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  8, D8);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) +  9, D9);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 10, D10);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 11, D11);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 12, D12);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 13, D13);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 14, D14);
-        _mm_storeu_si128( ((__m128i*)ptr_bit_array) + 15, D15);
+        const uint64_t* s  = doubled + terms[t].word + j;
+        const __m128i   cr = _mm_cvtsi32_si128( terms[t].b      );
+        const __m128i   cl = _mm_cvtsi32_si128( 64 - terms[t].b );
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = _mm_xor_si128(a[v], _mm_or_si128( _mm_srl_epi64(_mm_loadu_si128( (const __m128i*)(s + 2 * v) ), cr), _mm_sll_epi64(_mm_loadu_si128( (const __m128i*)(s + 2 * v + 1) ), cl) ));
     }
-    else
+
+    uint64_t* out = whole ? (uint64_t*)dst : tmp;
+    for(int32_t v = 0; v < V; v += 1)
+        _mm_storeu_si128( (__m128i*)(out + 2 * v), a[v] );
+    if( whole == false )
+        store_bits(dst, tmp, nBits);
+}
+
+RSHIFT_TARGET_SSE4 inline void circulant_row_sse4(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    for(int32_t j = 0; 64 * j < nBits; j += 4 * 2)
     {
-        printf("permutation_avx2(%d) : AVX2 IMPLEMENTATION NOT DONE YET !\n", nBits);
-        exit( EXIT_FAILURE );
+        const int32_t rest = nBits - 64 * j;
+        switch( (rest + 64 * 2 - 1) / (64 * 2) )
+        {
+            case  1 : circulant_chunk_sse4<1>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  2 : circulant_chunk_sse4<2>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  3 : circulant_chunk_sse4<3>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            default : circulant_chunk_sse4<4>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+        }
     }
+}
+
+RSHIFT_TARGET_SSE4 inline void rotate_xor_sse4(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    rotate_xor_generic(ptr_dst, ptr_src, nBits, shift, funnel_sse4, circulant_row_sse4);
+}
 
+//
+// Cyclic correlation kernel (see rshift_correlate_t) with the popcnt
+// instruction (every SSE4.2 CPU has it), on 4 independent words.
+//
+RSHIFT_TARGET_POPCNT inline void correlate_sse4(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = rshift_padded_words(nBits);
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o = (nBits - k) % nBits;
+        const uint64_t* s = doubled + o / 64;
+        const int32_t   b = o % 64;
+        uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        for(int32_t x = 0; x < words; x += 4)
+        {
+            c0 += _mm_popcnt_u64( a[x    ] & ((s[x    ] >> b) | ((s[x + 1] << 1) << (63 - b))) );
+            c1 += _mm_popcnt_u64( a[x + 1] & ((s[x + 1] >> b) | ((s[x + 2] << 1) << (63 - b))) );
+            c2 += _mm_popcnt_u64( a[x + 2] & ((s[x + 2] >> b) | ((s[x + 3] << 1) << (63 - b))) );
+            c3 += _mm_popcnt_u64( a[x + 3] & ((s[x + 3] >> b) | ((s[x + 4] << 1) << (63 - b))) );
+        }
+        out[k - k0] = (int32_t)(c0 + c1 + c2 + c3);
+    }
 }
 
 #endif
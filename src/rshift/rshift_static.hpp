@@ -0,0 +1,100 @@
+/*
+ *	Runtime dispatch of the bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_static_
+#define _rshift_static_
+
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+
+//
+// Compile-time front end: the frame size and the ISA are template arguments
+// so that the call resolves to one fully unrolled kernel, without the size
+// tests of the runtime entry points. NBits must be 32 or a multiple of 64;
+// sizes that are not a multiple of the vector width of ISA go to the widest
+// narrower ISA that handles them. The caller is responsible for running ISA
+// only on CPUs that support it (see rshift_cpu_level).
+//
+// The kernels carry the target attribute of their ISA, and GCC and clang
+// only inline them into code compiled for that ISA: a translation unit
+// built with RSHIFT_NATIVE (-march=native) or -mavx2 ..., or a caller with
+// a matching target attribute. In the default (x86-64 baseline) build a
+// call above x86 is a direct jump to the out-of-line kernel, still unrolled
+// and free of size tests (the runtime entry points call the same kernels
+// through their size tables). rshift_static_inlined<ISA>() tells which case
+// applies, so that a caller can static_assert it.
+//
+template<rshift_isa ISA>
+constexpr bool rshift_static_inlined()
+{
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    return true;
+#elif defined(__AVX2__)
+    return ISA <= RSHIFT_AVX2;
+#elif defined(__SSE4_2__)
+    return ISA <= RSHIFT_SSE4;
+#else
+    return ISA == RSHIFT_X86;
+#endif
+}
+
+template<int32_t NBits, rshift_isa ISA>
+inline void permutation(void* ptr_bit_array)
+{
+    static_assert( (NBits == 32) || ((NBits > 0) && (NBits % 64 == 0)), "NBits must be 32 or a multiple of 64" );
+
+#ifdef RSHIFT_HAS_AVX512
+    if constexpr ( ISA == RSHIFT_AVX512 ) { permutation_avx512<NBits>(ptr_bit_array); return; }
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if constexpr ( ISA >= RSHIFT_AVX2   ) { permutation_avx2  <NBits>(ptr_bit_array); return; }
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if constexpr ( ISA >= RSHIFT_SSE4   ) { permutation_sse4  <NBits>(ptr_bit_array); return; }
+#endif
+    permutation_x86<NBits>(ptr_bit_array);
+}
+
+template<int32_t NBits, rshift_isa ISA>
+inline void rotate(void* ptr_bit_array, const int32_t k)
+{
+    static_assert( (NBits == 32) || ((NBits > 0) && (NBits % 64 == 0)), "NBits must be 32 or a multiple of 64" );
+
+#ifdef RSHIFT_HAS_AVX512
+    if constexpr ( ISA == RSHIFT_AVX512 ) { rotate_avx512<NBits>(ptr_bit_array, k); return; }
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    if constexpr ( ISA >= RSHIFT_AVX2   ) { rotate_avx2  <NBits>(ptr_bit_array, k); return; }
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    if constexpr ( ISA >= RSHIFT_SSE4   ) { rotate_sse4  <NBits>(ptr_bit_array, k); return; }
+#endif
+    rotate_x86<NBits>(ptr_bit_array, k);
+}
+
+#endif
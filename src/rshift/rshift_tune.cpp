@@ -0,0 +1,629 @@
+/*
+ *	Auto-tuned rotation kernels - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#include "rshift_tune.hpp"
+#include "rshift.hpp"
+#include "rshift_x86.hpp"
+#include "rshift_sse4.hpp"
+#include "rshift_avx2.hpp"
+#include "rshift_avx512.hpp"
+#include "rshift_vec.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+typedef void (*permutation_t)(void*, const int32_t, const int32_t);
+typedef void (*rotate_t     )(void*, const int32_t, const int32_t, const int32_t);
+
+typedef void (*permutation_copy_t)(void*, const void*, const int32_t, const int32_t, const bool);
+typedef void (*rotate_copy_t     )(void*, const void*, const int32_t, const int32_t, const int32_t, const bool);
+
+//
+// Candidate kernels, the same set as the dispatcher's (rshift.cpp).
+//
+struct tune_isa
+{
+    const char*        name;
+    int32_t            level;
+    permutation_t      p;
+    rotate_t           r;
+    permutation_copy_t pc;
+    rotate_copy_t      rc;
+    rshift_funnel_t    funnel;
+};
+
+static const tune_isa isas[] =
+{
+#ifdef RSHIFT_VEC_BASELINE
+    { RSHIFT_VEC_NAME, RSHIFT_X86, permutation_vec, rotate_vec, permutation_vec, rotate_vec, funnel_vec },
+#else
+    { "x86", RSHIFT_X86, permutation_x86, rotate_x86, permutation_x86, rotate_x86, funnel_x86 },
+#endif
+#ifdef RSHIFT_HAS_SSE4
+    { "sse4", RSHIFT_SSE4, permutation_sse4, rotate_sse4, permutation_sse4, rotate_sse4, funnel_sse4 },
+#endif
+#ifdef RSHIFT_HAS_AVX2
+    { "avx2", RSHIFT_AVX2, permutation_avx2, rotate_avx2, permutation_avx2, rotate_avx2, funnel_avx2 },
+#endif
+#if defined(RSHIFT_HAS_AVX512_VBMI2)
+    // the kernels bound by rshift.cpp on the CPUs that have VBMI2
+    { "avx512", RSHIFT_AVX512,
+      rshift_has_avx512_vbmi2() ? (permutation_t     )permutation_avx512_vbmi2 : (permutation_t     )permutation_avx512,
+      rshift_has_avx512_vbmi2() ? (rotate_t          )rotate_avx512_vbmi2      : (rotate_t          )rotate_avx512,
+      rshift_has_avx512_vbmi2() ? (permutation_copy_t)permutation_avx512_vbmi2 : (permutation_copy_t)permutation_avx512,
+      rshift_has_avx512_vbmi2() ? (rotate_copy_t     )rotate_avx512_vbmi2      : (rotate_copy_t     )rotate_avx512,
+      funnel_avx512_select() },
+#elif defined(RSHIFT_HAS_AVX512)
+    { "avx512", RSHIFT_AVX512, permutation_avx512, rotate_avx512, permutation_avx512, rotate_avx512, funnel_avx512_select() },
+#endif
+};
+
+static const char* class_names [] = { "zero", "one", "word", "byte", "any" };
+static const char* method_names[] = { "unrolled", "loop", "unrolled_staged", "loop_staged" };
+
+static const tune_isa* find_isa(const int32_t level)
+{
+    for(const tune_isa& isa : isas)
+        if( isa.level == level )
+            return &isa;
+    return nullptr;
+}
+
+static int32_t shift_class(const int32_t shift)
+{
+    if( shift == 0      ) return 0;
+    if( shift == 1      ) return 1;
+    if( shift % 64 == 0 ) return 2;
+    if( shift %  8 == 0 ) return 3;
+    return 4;
+}
+
+//
+// Wisdom of the process: (nBits, shift class, in place, batch) -> kernel.
+//
+typedef std::tuple<int32_t, int32_t, bool, bool> tune_key;
+
+struct tune_choice
+{
+    int32_t level;
+    bool    loop;
+    bool    staged;
+    double  ns;
+};
+
+static std::mutex                        wisdom_lock;
+static std::map<tune_key, tune_choice>   wisdom;
+static bool                              wisdom_read = false;   // default file loaded
+
+//
+// One call of the selected variant. The staged variants need frames without
+// padding bits: the whole-byte copies would overwrite the ones of dst. A
+// null scratch stands for a buffer of the thread, only touched by the staged
+// in-place case.
+//
+static std::vector<uint8_t>& thread_scratch()
+{
+    thread_local std::vector<uint8_t> scratch;
+    return scratch;
+}
+
+static void run(const tune_isa& isa, const bool loop, const bool staged, uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t shift, const int32_t nFrames, const bool inplace, std::vector<uint8_t>* scratch)
+{
+    const int32_t nBytes = (nBits + 7) / 8;
+
+    auto rotate_inplace = [&](uint8_t* ptr, const int32_t n)
+    {
+        if( loop == false )
+        {
+            if( shift == 1 ) isa.p(ptr, nBits, n);
+            else             isa.r(ptr, nBits, shift, n);
+        }
+        else
+        {
+            for(int32_t f = 0; f < n; f += 1)
+                rotate_generic(ptr + (size_t)f * nBytes, nBits, shift, isa.funnel);
+        }
+    };
+    auto rotate_outofplace = [&](uint8_t* d, const uint8_t* s, const int32_t n)
+    {
+        if( loop == false )
+        {
+            if( shift == 1 ) isa.pc(d, s, nBits, n, false);
+            else             isa.rc(d, s, nBits, shift, n, false);
+        }
+        else
+        {
+            rotate_copy(d, s, nBits, shift, n, isa.funnel);
+        }
+    };
+
+    if( inplace && ((staged == false) || (nBits % 8 != 0)) )
+    {
+        rotate_inplace(dst, nFrames);
+    }
+    else if( inplace )
+    {
+        std::vector<uint8_t>& buffer = (scratch == nullptr) ? thread_scratch() : *scratch;
+        const int32_t chunk = std::max(1, 16384 / nBytes);
+        buffer.resize( (size_t)std::min(chunk, nFrames) * nBytes );
+        for(int32_t f = 0; f < nFrames; f += chunk)
+        {
+            const int32_t n = std::min(chunk, nFrames - f);
+            rotate_outofplace(buffer.data(), dst + (size_t)f * nBytes, n);
+            memcpy(dst + (size_t)f * nBytes, buffer.data(), (size_t)n * nBytes);
+        }
+    }
+    else if( (staged == false) || (nBits % 8 != 0) )
+    {
+        rotate_outofplace(dst, src, nFrames);
+    }
+    else
+    {
+        memcpy(dst, src, (size_t)nFrames * nBytes);
+        rotate_inplace(dst, nFrames);
+    }
+}
+
+//
+// Out-of-place rotation by 0: the frames are copied, the padding bits of
+// the last byte of each dst frame being kept.
+//
+static void copy_frames(uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t nFrames)
+{
+    if( nBits % 8 == 0 )
+        memcpy(dst, src, (size_t)nFrames * (nBits / 8));
+    else
+        rotate_copy(dst, src, nBits, 0, nFrames, funnel_x86);
+}
+
+//
+// Times every candidate on an L1 resident buffer: the number of calls is
+// doubled until a run lasts 100 us, then the best of 5 runs is kept. A
+// candidate that does not reproduce rotate_x86 bit for bit, padding bits of
+// dst included, is never selected. The
+// dispatcher's choice (widest ISA, unrolled, not staged) is timed first and
+// a candidate has to be 5% faster than the best so far to replace it, so
+// that timing noise does not pick an equivalent kernel.
+//
+static tune_choice tune(const int32_t nBits, const int32_t shift, const bool inplace, const bool batch)
+{
+    const int32_t nBytes  = (nBits + 7) / 8;
+    const int32_t nFrames = batch ? std::max(2, 16384 / nBytes) : 1;
+    const size_t  size    = (size_t)nFrames * nBytes;
+
+    std::vector<uint8_t> src( size ), dst( size ), fill( size ), ref( size ), scratch;
+    uint64_t x = 0x9E3779B97F4A7C15ULL ^ (uint64_t)nBits;
+    for(size_t i = 0; i < size; i += 1)
+    {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        src [i] = (uint8_t)x;
+        fill[i] = (uint8_t)~x;
+    }
+
+    // in place the padding bits are those of src, out of place those of fill
+    const std::vector<uint8_t>& init = inplace ? src : fill;
+    ref = init;
+    rotate_x86(ref.data(), src.data(), nBits, shift, nFrames);
+
+    tune_choice best = { RSHIFT_X86, false, false, 0.0 };
+    bool        none = true;
+    const int32_t top = rshift_isa_level();
+
+    for(int32_t i = (int32_t)(sizeof(isas) / sizeof(isas[0])) - 1; i >= 0; i -= 1)
+    {
+        const tune_isa& isa = isas[i];
+        if( isa.level > top )
+            continue;
+        for(int32_t m = 0; m < 4; m += 1)
+        {
+            const bool loop   = (m % 2) == 1;
+            const bool staged = (m / 2) == 1;
+            if( staged && (nBits % 8 != 0) )
+                continue;
+
+            dst = init;
+            run(isa, loop, staged, dst.data(), src.data(), nBits, shift, nFrames, inplace, &scratch);
+            if( dst != ref )
+                continue;
+
+            auto measure = [&](const int32_t calls)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for(int32_t i = 0; i < calls; i += 1)
+                    run(isa, loop, staged, dst.data(), src.data(), nBits, shift, nFrames, inplace, &scratch);
+                auto end   = std::chrono::steady_clock::now();
+                return std::chrono::duration<double, std::nano>(end - start).count();
+            };
+
+            int32_t calls = 1;
+            while( (measure(calls) < 100000.0) && (calls < (1 << 24)) )
+                calls *= 2;
+            double t = measure(calls);
+            for(int32_t r = 1; r < 5; r += 1)
+                t = std::min(t, measure(calls));
+            const double ns = t / ((double)calls * nFrames);
+
+            if( none || (ns < 0.95 * best.ns) )
+            {
+                best = { isa.level, loop, staged, ns };
+                none = false;
+            }
+        }
+    }
+    return best;
+}
+
+std::string rshift_cpu_model()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t brand[12];
+    if( __get_cpuid_max(0x80000000, nullptr) >= 0x80000004 )
+    {
+        __get_cpuid(0x80000002, brand + 0, brand + 1, brand + 2,  brand + 3 );
+        __get_cpuid(0x80000003, brand + 4, brand + 5, brand + 6,  brand + 7 );
+        __get_cpuid(0x80000004, brand + 8, brand + 9, brand + 10, brand + 11);
+        std::string name( (const char*)brand, sizeof(brand) );
+        name = name.substr(0, name.find('\0'));
+        const size_t first = name.find_first_not_of(' ');
+        const size_t last  = name.find_last_not_of (' ');
+        if( first != std::string::npos )
+            return name.substr(first, last - first + 1);
+    }
+#endif
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if( f != nullptr )
+    {
+        char line[256];
+        while( fgets(line, sizeof(line), f) != nullptr )
+        {
+            if( (strncmp(line, "model name", 10) != 0) && (strncmp(line, "CPU part", 8) != 0) )
+                continue;
+            std::string name( strchr(line, ':') ? strchr(line, ':') + 1 : line );
+            const size_t first = name.find_first_not_of(" \t");
+            const size_t last  = name.find_last_not_of (" \t\r\n");
+            fclose( f );
+            return (first == std::string::npos) ? "unknown" : name.substr(first, last - first + 1);
+        }
+        fclose( f );
+    }
+    return "unknown";
+}
+
+std::string rshift_wisdom_path()
+{
+    const char* forced = getenv("RSHIFT_WISDOM");
+    if( forced != nullptr )
+        return forced;
+    const char* home = getenv("HOME");
+    return (home == nullptr) ? "" : std::string(home) + "/.rshift_wisdom";
+}
+
+//
+// File format, one key per line:
+//
+//     nBits class inplace|copy single|batch top isa method ns cpu model...
+//
+// top is the ISA of the dispatcher when the key was tuned: the winner under
+// RSHIFT_ISA=sse4 (or of the NEON emulation build) says nothing of the
+// AVX-512 kernels, so the entries of each (top, cpu) pair are kept apart.
+// top and cpu are set whenever the line has the right shape, even when it
+// names kernels this build does not have.
+//
+static bool parse_line(const char* line, tune_key& key, tune_choice& choice, std::string& top, std::string& cpu)
+{
+    int32_t nBits = 0;
+    double  ns    = 0.0;
+    int     end   = 0;
+    char    kclass[16], placement[16], frames[16], bound[16], isa[16], method[24];
+    if( sscanf(line, "%d %15s %15s %15s %15s %15s %23s %lf %n", &nBits, kclass, placement, frames, bound, isa, method, &ns, &end) != 8 )
+        return false;
+
+    top = bound;
+    cpu = line + end;
+    cpu = cpu.substr(0, cpu.find_last_not_of(" \t\r\n") + 1);
+
+    int32_t c = -1, m = -1, level = -1;
+    for(int32_t i = 0; i < 5; i += 1)
+        if( strcmp(kclass, class_names[i]) == 0 ) c = i;
+    for(int32_t i = 0; i < 4; i += 1)
+        if( strcmp(method, method_names[i]) == 0 ) m = i;
+    for(const tune_isa& candidate : isas)
+        if( strcmp(isa, candidate.name) == 0 ) level = candidate.level;
+    if( (nBits <= 0) || (c < 0) || (m < 0) || (level < 0) )
+        return false;
+
+    key    = tune_key( nBits, c, strcmp(placement, "inplace") == 0, strcmp(frames, "batch") == 0 );
+    choice = { level, (m % 2) == 1, (m / 2) == 1, ns };
+    return true;
+}
+
+static bool load_file(const std::string& path)
+{
+    FILE* f = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if( f == nullptr )
+        return false;
+
+    const std::string model = rshift_cpu_model();
+    char line[512];
+    while( fgets(line, sizeof(line), f) != nullptr )
+    {
+        tune_key    key;
+        tune_choice choice;
+        std::string top, cpu;
+        if( (line[0] != '#') && parse_line(line, key, choice, top, cpu) && (top == rshift_isa_name()) && (cpu == model) )
+            wisdom[key] = choice;
+    }
+    fclose( f );
+    return true;
+}
+
+//
+// The lines of the other (top, cpu) pairs are copied over, then the file is
+// replaced at once: written to a unique temporary file of the same directory
+// (mkstemp) and renamed, so that a concurrent reader never sees half of it
+// and concurrent writers do not share the temporary file.
+//
+static bool save_file(const std::string& path)
+{
+    if( path.empty() )
+        return false;
+
+    const std::string model = rshift_cpu_model();
+    std::vector<std::string> others;
+    FILE* in = fopen(path.c_str(), "r");
+    if( in != nullptr )
+    {
+        char line[512];
+        while( fgets(line, sizeof(line), in) != nullptr )
+        {
+            tune_key    key;
+            tune_choice choice;
+            std::string top, cpu;
+            parse_line(line, key, choice, top, cpu);
+            if( (top.empty() == false) && ((top != rshift_isa_name()) || (cpu != model)) )
+                others.push_back( line );
+        }
+        fclose( in );
+    }
+
+    std::string tmp = path + ".XXXXXX";
+    const int fd = mkstemp( &tmp[0] );
+    if( fd < 0 )
+        return false;
+    FILE* out = fdopen(fd, "w");
+    if( out == nullptr )
+    {
+        close( fd );
+        unlink( tmp.c_str() );
+        return false;
+    }
+    fprintf(out, "# rshift wisdom: nBits class placement frames top isa method ns/frame cpu\n");
+    for(const std::string& line : others)
+        fputs(line.c_str(), out);
+    for(const auto& entry : wisdom)
+    {
+        const tune_key&    key    = entry.first;
+        const tune_choice& choice = entry.second;
+        fprintf(out, "%d %s %s %s %s %s %s %.3f %s\n", std::get<0>(key), class_names[std::get<1>(key)],
+                std::get<2>(key) ? "inplace" : "copy", std::get<3>(key) ? "batch" : "single",
+                rshift_isa_name(), find_isa(choice.level)->name, method_names[(choice.staged ? 2 : 0) + (choice.loop ? 1 : 0)],
+                choice.ns, model.c_str());
+    }
+    const bool ok = (fclose(out) == 0) && (rename(tmp.c_str(), path.c_str()) == 0);
+    if( ok == false )
+        unlink( tmp.c_str() );
+    return ok;
+}
+
+bool rshift_wisdom_load(const char* path)
+{
+    std::lock_guard<std::mutex> lock(wisdom_lock);
+    wisdom_read = true;
+    return load_file( (path == nullptr) ? rshift_wisdom_path() : path );
+}
+
+bool rshift_wisdom_save(const char* path)
+{
+    std::lock_guard<std::mutex> lock(wisdom_lock);
+    return save_file( (path == nullptr) ? rshift_wisdom_path() : path );
+}
+
+void rshift_wisdom_forget()
+{
+    std::lock_guard<std::mutex> lock(wisdom_lock);
+    wisdom.clear();
+    wisdom_read = true;
+}
+
+//
+// Choice of a key: the wisdom when it holds an entry for it, a new tuning
+// otherwise, saved right away. The tuning runs without the lock, so that the
+// other threads keep using the known keys; when two threads tune the same
+// key, the first result published is kept.
+//
+static tune_choice plan(const int32_t nBits, const int32_t shift, const bool inplace, const bool batch)
+{
+    const tune_key key( nBits, shift_class(shift), inplace, batch );
+    auto known = [&](tune_choice& choice)
+    {
+        if( wisdom_read == false )
+        {
+            wisdom_read = true;
+            load_file( rshift_wisdom_path() );
+        }
+        auto it = wisdom.find(key);
+        if( (it == wisdom.end()) || (it->second.level > rshift_isa_level()) )
+            return false;
+        choice = it->second;
+        return true;
+    };
+
+    tune_choice choice;
+    {
+        std::lock_guard<std::mutex> lock(wisdom_lock);
+        if( known(choice) )
+            return choice;
+    }
+
+    const tune_choice tuned = tune(nBits, shift, inplace, batch);
+
+    std::lock_guard<std::mutex> lock(wisdom_lock);
+    if( known(choice) )
+        return choice;
+    wisdom[key] = tuned;
+    save_file( rshift_wisdom_path() );
+    return tuned;
+}
+
+rshift_rotation_plan::rshift_rotation_plan(const int32_t nBits, const int32_t k, const bool inplace, const int32_t nFrames)
+{
+    if( nBits <= 0 )
+    {
+        printf("(EE) rshift_rotation_plan: invalid frame size (%d bits)\n", nBits);
+        exit( EXIT_FAILURE );
+    }
+
+    this->nBits = nBits;
+    this->k     = ((k % nBits) + nBits) % nBits;
+    level       = -1;
+    loop        = false;
+    staged      = false;
+    time        = 0.0;
+    if( this->k == 0 )
+        return;
+
+    const tune_choice choice = plan(nBits, this->k, inplace, nFrames > 1);
+    level  = choice.level;
+    loop   = choice.loop;
+    staged = choice.staged;
+    time   = choice.ns;
+}
+
+const char* rshift_rotation_plan::isa() const
+{
+    return (level < 0) ? "none" : find_isa(level)->name;
+}
+
+const char* rshift_rotation_plan::method() const
+{
+    return (level < 0) ? "none" : method_names[(staged ? 2 : 0) + (loop ? 1 : 0)];
+}
+
+void rshift_rotation_plan::execute(void* ptr_bit_array, const int32_t nFrames)
+{
+    if( level >= 0 )
+        run(*find_isa(level), loop, staged, (uint8_t*)ptr_bit_array, nullptr, nBits, k, nFrames, true, &scratch);
+}
+
+void rshift_rotation_plan::execute(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nFrames)
+{
+    if( level >= 0 )
+        run(*find_isa(level), loop, staged, (uint8_t*)ptr_dst, (const uint8_t*)ptr_src, nBits, k, nFrames, false, &scratch);
+    else
+        copy_frames((uint8_t*)ptr_dst, (const uint8_t*)ptr_src, nBits, nFrames);
+}
+
+//
+// The *_tuned functions remember the choices of the last frame size of the
+// thread (every shift class and placement), so that a loop of calls on the
+// same frames takes the lock once per key.
+//
+struct tune_slot
+{
+    const tune_isa*      isa    = nullptr;
+    bool                 loop   = false;
+    bool                 staged = false;
+};
+
+struct tune_cache
+{
+    int32_t              nBits  = 0;
+    tune_slot            slots[5][2][2];    // shift class, in place, batch
+};
+
+static void run_tuned(uint8_t* dst, const uint8_t* src, const int32_t nBits, const int32_t k, const int32_t nFrames, const bool inplace)
+{
+    thread_local tune_cache cache;
+
+    // the divisions cost as much as a small rotation: skipped when 0 <= k < nBits
+    const int32_t shift = ((uint32_t)k < (uint32_t)nBits) ? k : ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+    {
+        if( inplace == false )
+            copy_frames(dst, src, nBits, nFrames);
+        return;
+    }
+
+    if( cache.nBits != nBits )
+    {
+        cache.nBits = nBits;
+        for(auto& by_class : cache.slots)
+            for(auto& by_placement : by_class)
+                for(tune_slot& slot : by_placement)
+                    slot.isa = nullptr;
+    }
+
+    tune_slot& slot = cache.slots[shift_class(shift)][inplace][nFrames > 1];
+    if( slot.isa == nullptr )
+    {
+        const tune_choice choice = plan(nBits, shift, inplace, nFrames > 1);
+        slot.isa    = find_isa(choice.level);
+        slot.loop   = choice.loop;
+        slot.staged = choice.staged;
+    }
+    run(*slot.isa, slot.loop, slot.staged, dst, src, nBits, shift, nFrames, inplace, nullptr);
+}
+
+void permutation_tuned(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames)
+{
+    run_tuned((uint8_t*)ptr_bit_array, nullptr, nBits, 1, nFrames, true);
+}
+
+void rotate_tuned(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames)
+{
+    run_tuned((uint8_t*)ptr_bit_array, nullptr, nBits, k, nFrames, true);
+}
+
+void permutation_tuned(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames)
+{
+    run_tuned((uint8_t*)ptr_dst, (const uint8_t*)ptr_src, nBits, 1, nFrames, false);
+}
+
+void rotate_tuned(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames)
+{
+    run_tuned((uint8_t*)ptr_dst, (const uint8_t*)ptr_src, nBits, k, nFrames, false);
+}
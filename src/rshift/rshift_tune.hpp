@@ -0,0 +1,111 @@
+/*
+ *	Auto-tuned rotation kernels - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_tune_
+#define _rshift_tune_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Auto-tuned rotations. The kernel bound by the dispatcher is the widest
+// ISA, which is not always the fastest one: 128-bit frames may go faster
+// with the SSE4 or scalar code than with AVX2, and the out-of-place kernels
+// may beat the in-place ones (or the reverse) for some sizes. A plan times
+// the candidates on first use for its (nBits, shift class, placement,
+// single frame or batch) key and keeps the fastest:
+//
+//   isa      : every level up to rshift_isa_level() (RSHIFT_ISA applies),
+//   unroll   : the entry point of the ISA (fully unrolled code for the
+//              power of 2 sizes and several small frames per register), or
+//              the plain funnel loop of rotate_generic / rotate_copy,
+//   staging  : the kernel of the requested placement, or the other one
+//              (an out-of-place rotation into a scratch buffer copied back,
+//              or a copy followed by an in-place rotation), only for frames
+//              of whole bytes as these copies would overwrite the padding
+//              bits of dst.
+//
+// As with the other kernels, the bits past nBits of the last byte of each
+// dst frame are never modified.
+//
+// The shift classes are 0, 1, multiples of 64, multiples of 8 and the rest.
+//
+// The winners (the "wisdom") are kept for the process and written to a
+// text file, one line per key, tagged with the CPU model (cpuid brand
+// string, or /proc/cpuinfo) and the ISA of the dispatcher, so that one file
+// can serve several hosts and RSHIFT_ISA settings. Lines of the others are
+// kept when the file is rewritten. The file is $RSHIFT_WISDOM,
+// $HOME/.rshift_wisdom when it is not set, and nothing is read nor written
+// when RSHIFT_WISDOM is set to an empty string. It is read on the first
+// plan and rewritten each time a key is tuned, so the tuning cost (10 to
+// 20 ms per key) is paid once per host.
+//
+// execute() may use the plan's scratch buffer: use one plan per thread.
+// The *_tuned functions keep a per thread cache of the last plan.
+//
+class rshift_rotation_plan
+{
+public:
+    rshift_rotation_plan(const int32_t nBits, const int32_t k, const bool inplace = true, const int32_t nFrames = 1);
+
+    int32_t     bits  () const { return nBits; }
+    int32_t     shift () const { return k;     }
+    const char* isa   () const;
+    const char* method() const;     // unrolled, loop, unrolled_staged or loop_staged
+    double      ns    () const { return time; }     // per frame, when tuned
+
+    void execute(void* ptr_bit_array, const int32_t nFrames = 1);
+    void execute(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nFrames = 1);
+
+private:
+    int32_t              nBits;
+    int32_t              k;             // 0 <= k < nBits
+    int32_t              level;         // -1: nothing to do (k == 0)
+    bool                 loop;
+    bool                 staged;
+    double               time;
+    std::vector<uint8_t> scratch;
+};
+
+extern void permutation_tuned(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1);
+extern void rotate_tuned     (void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1);
+extern void permutation_tuned(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1);
+extern void rotate_tuned     (void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1);
+
+//
+// Wisdom file management: load() merges the entries of this CPU from a file
+// (false when it cannot be read), save() rewrites it, forget() drops what is
+// known in the process (the next plans are tuned again). nullptr stands for
+// the default file (see above), rshift_wisdom_path() returns it ("" when
+// disabled).
+//
+extern bool        rshift_wisdom_load  (const char* path = nullptr);
+extern bool        rshift_wisdom_save  (const char* path = nullptr);
+extern void        rshift_wisdom_forget();
+extern std::string rshift_wisdom_path  ();
+extern std::string rshift_cpu_model    ();
+
+#endif
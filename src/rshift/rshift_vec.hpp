@@ -0,0 +1,511 @@
+/*
+ *	Portable bit-shifting functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_vec_
+#define _rshift_vec_
+
+#include <cstdint>
+#include "rshift_common.hpp"
+#include "rshift_simd.hpp"
+
+//
+// Portable backend: the kernels of rshift_x86 .. rshift_avx512 written once
+// against the simd_* operations of rshift_simd.hpp, with the same contracts
+// and signatures. On x86 it stands next to the intrinsic backends (as
+// "vec", compiled for AVX2); on ARM it is the NEON backend and the level
+// the runtime dispatch binds.
+//
+RSHIFT_TARGET_VEC inline void funnel_vec(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    int32_t x = 0;
+    for(; x + simd_lanes <= nWords; x += simd_lanes)
+        simd_store( dst + x, simd_funnel(simd_load(src + x), simd_load(src + x + 1), b) );
+    for(; x < nWords; x += 1)
+        dst[x] = (src[x] >> b) | ((src[x + 1] << 1) << (63 - b));
+}
+
+//
+// Non-temporal variant of funnel_vec: regular stores up to the first
+// register boundary of dst and for the last words, simd_stream for the
+// others. The caller issues simd_stream_fence.
+//
+RSHIFT_TARGET_VEC inline void funnel_vec_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+    if( ((uintptr_t)dst % 8 != 0) || (nWords < 2 * simd_lanes) )
+    {
+        funnel_vec(dst, src, nWords, b);
+        return;
+    }
+    const int32_t head = ((sizeof(simd_t) - (uintptr_t)dst % sizeof(simd_t)) % sizeof(simd_t)) / 8;
+    funnel_vec(dst, src, head, b);
+
+    int32_t x = head;
+    for(; x + simd_lanes <= nWords; x += simd_lanes)
+        simd_stream( dst + x, simd_funnel(simd_load(src + x), simd_load(src + x + 1), b) );
+    funnel_vec(dst + x, src + x, nWords - x, b);
+}
+
+//
+// Compile-time sized kernels, NBits being a multiple of 64: the doubling
+// and the funnel copy have constant trip counts and are unrolled. The
+// one-bit rotation is a funnel by the constant 63 of every word with the
+// one below it, the words below a register being taken from it and the
+// previous one (the last one for register 0) by simd_below.
+//
+template<int32_t NBits>
+RSHIFT_TARGET_VEC inline void permutation_vec(void* ptr_bit_array)
+{
+    static_assert( (NBits > 0) && (NBits % 64 == 0), "permutation_vec<NBits> : NBits must be a multiple of 64" );
+
+    constexpr int32_t words = NBits / 64;
+    uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+
+    if constexpr ( words % simd_lanes != 0 )
+    {
+        const uint64_t last = bit_array[words - 1];
+        #pragma GCC unroll 32
+        for(int32_t x = words - 1; x >= 1; x -= 1)
+            bit_array[x] = (bit_array[x] << 1) | (bit_array[x - 1] >> 63);
+        bit_array[0] = (bit_array[0] << 1) | (last >> 63);
+    }
+    else
+    {
+        constexpr int32_t regs = words / simd_lanes;
+        simd_t A[regs];
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < regs; x += 1)
+            A[x] = simd_load(bit_array + simd_lanes * x);
+
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < regs; x += 1)
+        {
+            const simd_t B = simd_below( A[(x + regs - 1) % regs], A[x] );
+            simd_store( bit_array + simd_lanes * x, simd_funnel(B, A[x], 63) );
+        }
+    }
+}
+
+template<int32_t NBits>
+RSHIFT_TARGET_VEC inline void rotate_vec(void* ptr_bit_array, const int32_t k)
+{
+    static_assert( (NBits > 0) && (NBits % 64 == 0), "rotate_vec<NBits> : NBits must be a multiple of 64" );
+
+    const int32_t shift = ((k % NBits) + NBits) % NBits;
+    if( shift == 0 )
+        return;
+
+    constexpr int32_t words = NBits / 64;
+    uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+    if constexpr ( words == 2 )
+    {
+        // word swap when shift >= 64, then one funnel shift by shift % 64
+        const uint64_t lo = bit_array[(shift >= 64) ? 1 : 0];
+        const uint64_t hi = bit_array[(shift >= 64) ? 0 : 1];
+        const int32_t  s  = shift % 64;
+        bit_array[0] = (lo << s) | ((hi >> 1) >> (63 - s));
+        bit_array[1] = (hi << s) | ((lo >> 1) >> (63 - s));
+        return;
+    }
+    uint64_t tmp[2 * words + simd_lanes];
+
+    #pragma GCC unroll 32
+    for(int32_t x = 0; x < words; x += 1)
+    {
+        tmp[x]         = bit_array[x];
+        tmp[x + words] = bit_array[x];
+    }
+    for(int32_t x = 2 * words; x < 2 * words + simd_lanes; x += 1)
+        tmp[x] = 0;
+
+    const uint64_t* src = tmp + (NBits - shift) / 64;
+    const int32_t   b   = (NBits - shift) % 64;
+    if constexpr ( words % simd_lanes == 0 )
+    {
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < words; x += simd_lanes)
+            simd_store( bit_array + x, simd_funnel(simd_load(src + x), simd_load(src + x + 1), b) );
+    }
+    else
+    {
+        #pragma GCC unroll 32
+        for(int32_t x = 0; x < words; x += 1)
+            bit_array[x] = (src[x] >> b) | ((src[x + 1] << 1) << (63 - b));
+    }
+}
+
+RSHIFT_SIZED_TABLES(vec)
+
+//
+// Cyclic rotation by k positions of nFrames contiguous frames (see
+// rotate_x86). 64-bit frames are packed one per lane, 32-bit ones are left
+// to the compiler, the multiples of 64 up to RSHIFT_SIZED_BITS use the sized
+// kernels and the other sizes go through rotate_generic.
+//
+RSHIFT_TARGET_VEC inline void rotate_vec(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
+
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (32 - shift));
+    }
+    else if( nBits == 64 )
+    {
+        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
+        int32_t f = 0;
+        for(; f + simd_lanes <= nFrames; f += simd_lanes)
+        {
+            const simd_t A = simd_load(bit_array + f);
+            simd_store( bit_array + f, simd_or(simd_shl(A, shift), simd_shr(A, 64 - shift)) );
+        }
+        for(; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (64 - shift));
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_rotate_t kernel = rotate_vec_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift, funnel_vec);
+    }
+}
+
+RSHIFT_TARGET_VEC inline void permutation_vec(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_permutation_t kernel = permutation_vec_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64) );
+    }
+    else
+    {
+        rotate_vec(ptr_bit_array, nBits, 1, nFrames);
+    }
+}
+
+//
+// Out-of-place variants (see rotate_x86 for the contract). With stream,
+// the 64-bit frames are written by simd_stream when dst is register
+// aligned and the other sizes through funnel_vec_stream (see rotate_copy),
+// the 32-bit ones keeping regular stores.
+//
+RSHIFT_TARGET_VEC inline void rotate_vec(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    const bool    nt    = stream && ((uintptr_t)ptr_dst % sizeof(simd_t) == 0);
+
+    if( nBits == 32 )
+    {
+        const uint32_t* src = (const uint32_t*)ptr_src;
+        uint32_t*       dst = (uint32_t*)ptr_dst;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            dst[f] = (src[f] << shift) | (src[f] >> ((32 - shift) % 32));
+    }
+    else if( nBits == 64 )
+    {
+        const uint64_t* src = (const uint64_t*)ptr_src;
+        uint64_t*       dst = (uint64_t*)ptr_dst;
+        int32_t f = 0;
+        if( shift != 0 )
+        {
+            for(; f + simd_lanes <= nFrames; f += simd_lanes)
+            {
+                const simd_t A = simd_load(src + f);
+                const simd_t D = simd_or(simd_shl(A, shift), simd_shr(A, 64 - shift));
+                if( nt ) simd_stream( dst + f, D );
+                else     simd_store ( dst + f, D );
+            }
+        }
+        for(; f < nFrames; f += 1)
+            dst[f] = (src[f] << shift) | (src[f] >> ((64 - shift) % 64));
+    }
+    else
+    {
+        rotate_copy(ptr_dst, ptr_src, nBits, shift, nFrames, funnel_vec, stream ? funnel_vec_stream : nullptr);
+    }
+
+    if( stream )
+        simd_stream_fence();
+}
+
+RSHIFT_TARGET_VEC inline void permutation_vec(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_vec(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+
+RSHIFT_TARGET_VEC inline void rotate_right_vec(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    rotate_vec(ptr_bit_array, nBits, -(k % nBits), nFrames);
+}
+
+RSHIFT_TARGET_VEC inline void permutation_right_vec(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    rotate_vec(ptr_bit_array, nBits, nBits - 1, nFrames);
+}
+
+//
+// Word kernels of the non-cyclic shifts (see rshift_words_t), the funnel
+// being taken with 64 - k resp. k so that k == 64 needs no special case
+// on the left and a word move on the right.
+//
+RSHIFT_TARGET_VEC inline void shl_words_vec(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    int32_t x = nWords - simd_lanes;
+    for(; x >= 1; x -= simd_lanes)
+        simd_store( w + x, simd_funnel(simd_load(w + x - 1), simd_load(w + x), 64 - k) );
+    for(x = x + simd_lanes - 1; x >= 1; x -= 1)
+        w[x] = funnel_left(w[x], w[x - 1], k);
+}
+
+RSHIFT_TARGET_VEC inline void shr_words_vec(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    int32_t x = 0;
+    if( k < 64 )
+    {
+        for(; x + simd_lanes < nWords; x += simd_lanes)
+            simd_store( w + x, simd_funnel(simd_load(w + x), simd_load(w + x + 1), k) );
+    }
+    for(; x < nWords - 1; x += 1)
+        w[x] = funnel_right(w[x], w[x + 1], k);
+}
+
+RSHIFT_TARGET_VEC inline uint64_t shift_left_vec(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_left_generic(ptr_bit_array, nBits, k, carry_in, shl_words_vec);
+}
+
+RSHIFT_TARGET_VEC inline uint64_t shift_right_vec(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_right_generic(ptr_bit_array, nBits, k, carry_in, shr_words_vec);
+}
+
+RSHIFT_TARGET_VEC inline void rotate_padded_vec(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( (nBits % 64 == 0) || (nBits == 32) )
+        rotate_vec(ptr_bit_array, nBits, shift);
+    else if( shift != 0 )
+        rotate_padded_generic(ptr_bit_array, nBits, shift, funnel_vec, funnel_vec);
+}
+
+//
+// Circulant kernel (see rshift_circulant_t) on chunks of up to 4 vector
+// accumulators, the last chunk of a block using only the V registers it
+// needs.
+//
+template<int32_t V>
+RSHIFT_TARGET_VEC inline void circulant_chunk_vec(uint8_t* dst, const uint64_t* doubled, const int32_t j, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    const bool whole = (nBits >= 64 * simd_lanes * V);
+    alignas(64) uint64_t tmp[simd_lanes * V];
+    if( accumulate && (whole == false) )
+        load_bits(tmp, simd_lanes * V, dst, nBits);
+    uint64_t* io = whole ? (uint64_t*)dst : tmp;
+
+    simd_t a[V];
+    for(int32_t v = 0; v < V; v += 1)
+        a[v] = accumulate ? simd_load(io + simd_lanes * v) : simd_zero();
+    for(int32_t t = 0; t < nTerms; t += 1)
+    {
+        const uint64_t* s = doubled + terms[t].word + j;
+        const int32_t   b = terms[t].b;
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] = simd_xor( a[v], simd_funnel(simd_load(s + simd_lanes * v), simd_load(s + simd_lanes * v + 1), b) );
+    }
+
+    for(int32_t v = 0; v < V; v += 1)
+        simd_store(io + simd_lanes * v, a[v]);
+    if( whole == false )
+        store_bits(dst, tmp, nBits);
+}
+
+RSHIFT_TARGET_VEC inline void circulant_row_vec(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    for(int32_t j = 0; 64 * j < nBits; j += 4 * simd_lanes)
+    {
+        const int32_t rest = nBits - 64 * j;
+        switch( (rest + 64 * simd_lanes - 1) / (64 * simd_lanes) )
+        {
+            case  1 : circulant_chunk_vec<1>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  2 : circulant_chunk_vec<2>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  3 : circulant_chunk_vec<3>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            default : circulant_chunk_vec<4>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+        }
+    }
+}
+
+RSHIFT_TARGET_VEC inline void rotate_xor_vec(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    rotate_xor_generic(ptr_dst, ptr_src, nBits, shift, funnel_vec, circulant_row_vec);
+}
+
+//
+// Cyclic correlation kernel (see rshift_correlate_t). a being padded to a
+// multiple of 8 words, whole vectors are read past the last word.
+//
+RSHIFT_TARGET_VEC inline void correlate_vec(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = (nBits + 63) / 64;
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o = (nBits - k) % nBits;
+        const uint64_t* s = doubled + o / 64;
+        const int32_t   b = o % 64;
+        simd_t sum = simd_zero();
+        for(int32_t x = 0; x < words; x += simd_lanes)
+        {
+            const simd_t W = simd_funnel( simd_load(s + x), simd_load(s + x + 1), b );
+            sum = simd_add( sum, simd_popcount(simd_and(simd_load(a + x), W)) );
+        }
+        out[k - k0] = (int32_t)simd_sum(sum);
+    }
+}
+
+//
+// Beneš stage (see rshift_delta_swap_t), whole registers when the arrays
+// or the word distance are at least one register wide.
+//
+RSHIFT_TARGET_VEC inline void delta_swap_vec(uint64_t* w, const uint64_t* mask, const int32_t nWords, const int32_t d)
+{
+    if( d < 64 )
+    {
+        int32_t x = 0;
+        for(; x + simd_lanes <= nWords; x += simd_lanes)
+        {
+            const simd_t W = simd_load(w + x);
+            const simd_t t = simd_and( simd_xor(simd_shr(W, d), W), simd_load(mask + x) );
+            simd_store( w + x, simd_xor(W, simd_xor(t, simd_shl(t, d))) );
+        }
+        for(; x < nWords; x += 1)
+        {
+            const uint64_t t = ((w[x] >> d) ^ w[x]) & mask[x];
+            w[x] ^= t ^ (t << d);
+        }
+    }
+    else if( d / 64 >= simd_lanes )
+    {
+        const int32_t D = d / 64;
+        for(int32_t x = 0; x < nWords; x += 2 * D)
+        {
+            for(int32_t y = x; y < x + D; y += simd_lanes)
+            {
+                const simd_t A = simd_load(w + y);
+                const simd_t B = simd_load(w + y + D);
+                const simd_t t = simd_and( simd_xor(A, B), simd_load(mask + y) );
+                simd_store( w + y,     simd_xor(A, t) );
+                simd_store( w + y + D, simd_xor(B, t) );
+            }
+        }
+    }
+    else
+    {
+        const int32_t D = d / 64;
+        for(int32_t x = 0; x < nWords; x += 2 * D)
+        {
+            for(int32_t y = x; y < x + D; y += 1)
+            {
+                const uint64_t t = (w[y] ^ w[y + D]) & mask[y];
+                w[y]     ^= t;
+                w[y + D] ^= t;
+            }
+        }
+    }
+}
+
+//
+// Small frames (see rshift_small_t), one per 64-bit lane.
+//
+RSHIFT_TARGET_VEC inline void rotate_small_vec(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    const int32_t  nBytes = (nBits + 7) / 8;
+    const uint64_t m      = (nBits == 64) ? ~0ULL : ((1ULL << nBits) - 1);
+    const simd_t   mask   = simd_set1( m );
+    const simd_t   top    = simd_set1( nBits - 1 );
+    int32_t        j      = (int32_t)(first % nShifts);
+
+    uint64_t x[simd_lanes];
+    uint64_t k[simd_lanes];
+    int64_t  f = 0;
+    for(; f + simd_lanes <= nFrames; f += simd_lanes)
+    {
+        uint8_t* p = ptr + f * nBytes;
+        for(int32_t l = 0; l < simd_lanes; l += 1)
+        {
+            x[l] = 0;
+            memcpy(x + l, p + l * nBytes, nBytes);
+            k[l] = small_shift(shifts[j], nBits);
+            j    = (j + 1 == nShifts) ? 0 : (j + 1);
+        }
+        const simd_t v    = simd_load( x );
+        const simd_t c    = simd_load( k );
+        const simd_t bits = simd_and( v, mask );
+        const simd_t rot  = simd_or( simd_shlv(bits, c), simd_shrv(simd_shr(bits, 1), simd_sub(top, c)) );
+        simd_store( x, simd_or( simd_and(rot, mask), simd_xor(v, bits) ) );
+        for(int32_t l = 0; l < simd_lanes; l += 1)
+            memcpy(p + l * nBytes, x + l, nBytes);
+    }
+    rotate_small_generic(ptr + f * nBytes, nBits, nFrames - f, shifts, nShifts, first + f);
+}
+
+//
+// Bit transposes (see rshift_transpose_t): the 6 delta swap stages applied
+// to the four matrices at once, a row of the four being 4 / simd_lanes
+// registers.
+//
+RSHIFT_TARGET_VEC inline void transpose64x4_vec(uint64_t* a)
+{
+    for(int32_t s = 0; s < 6; s += 1)
+    {
+        const int32_t j = 32 >> s;
+        const simd_t  m = simd_set1( rshift_transpose_masks[s] );
+        for(int32_t r = 0; r < 64; r += 1)
+        {
+            if( r & j )
+                continue;
+            for(int32_t x = 0; x < 4; x += simd_lanes)
+            {
+                const simd_t A = simd_load(a + 4 * r + x);
+                const simd_t B = simd_load(a + 4 * (r + j) + x);
+                const simd_t t = simd_and( simd_xor(simd_shr(A, j), B), m );
+                simd_store( a + 4 * r + x,       simd_xor(A, simd_shl(t, j)) );
+                simd_store( a + 4 * (r + j) + x, simd_xor(B, t) );
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ *	Lazily rotated view of a bit array - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _rshift_view_
+#define _rshift_view_
+
+#include "rshift.hpp"
+
+#include <cstring>
+
+//
+// View of a bit array (not owned) with a pending rotation: rotate() only
+// adds k to the offset modulo nBits, and the bits are read through the
+// offset. The array itself is rotated once, by the accumulated amount,
+// when a contiguous buffer is requested with data(), or written to another
+// buffer by copy_to() without modifying it.
+//
+// Bit i of the view is bit (i - offset) % nBits of the array, as if the
+// array had been rotated by offset with rotate().
+//
+class rshift_view
+{
+public:
+    rshift_view(void* ptr_bit_array, const int32_t nBits)
+        : bits( (uint8_t*)ptr_bit_array ), size( nBits ), offset( 0 )
+    {
+    }
+
+    int32_t nBits  () const { return size;   }
+    int32_t pending() const { return offset; }
+
+    void rotate(const int32_t k)
+    {
+        offset = (int32_t)((((int64_t)offset + k) % size + size) % size);
+    }
+
+    void rotate_right(const int32_t k) { rotate( -(k % size) ); }
+    void permutation ()                { rotate( 1 );           }
+
+    bool test(const int32_t i) const
+    {
+        const int32_t j = (i >= offset) ? i - offset : i - offset + size;
+        return (bits[j / 8] >> (j % 8)) & 1;
+    }
+
+    //
+    // Bits 64 * x to 64 * x + 63 of the view, the bits past nBits being 0.
+    // The range starts at bit 64 * x - offset of the array and wraps around
+    // its end (several times when nBits < 64).
+    //
+    uint64_t word(const int32_t x) const
+    {
+        const int32_t len = (size - 64 * x < 64) ? size - 64 * x : 64;
+        int32_t       o   = 64 * x - offset;
+        if( o < 0 )
+            o += size;
+
+        uint64_t v   = 0;
+        int32_t  got = 0;
+        while( got < len )
+        {
+            const int32_t chunk = (len - got < size - o) ? len - got : size - o;
+            v   |= read_bits(o, chunk) << got;
+            got += chunk;
+            o    = 0;
+        }
+        return v;
+    }
+
+    //
+    // Applies the pending rotation to the array (a single call to the
+    // dispatched rotate kernel) and returns it.
+    //
+    void* data()
+    {
+        if( offset != 0 )
+        {
+            ::rotate(bits, size, offset);
+            offset = 0;
+        }
+        return bits;
+    }
+
+    //
+    // Writes the view to dst (nBits bits, must not overlap the array), the
+    // array and the pending rotation being left unchanged.
+    //
+    void copy_to(void* dst) const
+    {
+        ::rotate(dst, (const void*)bits, size, offset);
+    }
+
+private:
+    // 1 <= len <= 64 bits starting at bit o, without reading past the array
+    uint64_t read_bits(const int32_t o, const int32_t len) const
+    {
+        const int32_t first = o / 8;
+        const int32_t last  = (o + len - 1) / 8;
+        uint64_t lo = 0;
+        memcpy(&lo, bits + first, (last - first + 1 < 8) ? last - first + 1 : 8);
+        uint64_t v = lo >> (o % 8);
+        if( last - first + 1 > 8 )
+            v |= (uint64_t)bits[first + 8] << (64 - o % 8);
+        return (len == 64) ? v : v & ((1ULL << len) - 1);
+    }
+
+    uint8_t* bits;
+    int32_t  size;
+    int32_t  offset;
+};
+
+#endif
@@ -27,84 +27,508 @@
 #define _rshift_x86_
 
 #include <cstdint>
+#include "rshift_common.hpp"
+#if defined(__x86_64__)
+    #include <immintrin.h>
+#endif
 
-void permutation_x86(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+inline void funnel_x86(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
 {
-    if( nBits == 32 )
+    if( b == 0 )
+    {
+        for(int32_t x = 0; x < nWords; x += 1)
+            dst[x] = src[x];
+    }
+    else
+    {
+        for(int32_t x = 0; x < nWords; x += 1)
+            dst[x] = (src[x] >> b) | (src[x + 1] << (64 - b));
+    }
+}
+
+//
+// Same as funnel_x86 with non-temporal stores (movnti), so that a large
+// output does not evict the working set from the caches. Callers issue the
+// sfence once the whole output is written.
+//
+inline void funnel_x86_stream(uint64_t* dst, const uint64_t* src, const int32_t nWords, const int32_t b)
+{
+#if defined(__x86_64__)
+    for(int32_t x = 0; x < nWords; x += 1)
+    {
+        const uint64_t value = (b == 0) ? src[x] : (src[x] >> b) | (src[x + 1] << (64 - b));
+        _mm_stream_si64( (long long*)(dst + x), (long long)value );
+    }
+#else
+    funnel_x86(dst, src, nWords, b);
+#endif
+}
+
+//
+// Compile-time sized kernels (32 bits or any multiple of 64 bits): the loops
+// have constant trip counts and are fully unrolled into straight-line code,
+// so a caller that knows its size pays no dispatch and can inline them.
+//
+template<int32_t NBits>
+inline void permutation_x86(void* ptr_bit_array)
+{
+    static_assert( (NBits == 32) || ((NBits > 0) && (NBits % 64 == 0)), "permutation_x86<NBits> : NBits must be 32 or a multiple of 64" );
+
+    if constexpr ( NBits == 32 )
     {
         uint32_t* bit_array = (uint32_t*)ptr_bit_array;
         bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 31);
     }
-    else if( nBits == 64 )
+    else
     {
+        constexpr int32_t words = NBits / 64;
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        bit_array[0] = (bit_array[0] << 1) | (bit_array[0] >> 63);
+        uint64_t tmp[words];
+
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < words; x += 1)
+            tmp[x] = bit_array[x];
+        bit_array[0] = (tmp[0] << 1) | (tmp[words-1] >> 63);
+
+        #pragma GCC unroll 64
+        for(int32_t x = 1; x < words; x += 1)
+            bit_array[x] = (tmp[x] << 1) | (tmp[x-1] >> 63);
     }
-    else if( nBits == 128 )
+}
+
+template<int32_t NBits>
+inline void rotate_x86(void* ptr_bit_array, const int32_t k)
+{
+    static_assert( (NBits == 32) || ((NBits > 0) && (NBits % 64 == 0)), "rotate_x86<NBits> : NBits must be 32 or a multiple of 64" );
+
+    const int32_t shift = ((k % NBits) + NBits) % NBits;
+    if( shift == 0 )
+        return;
+
+    if constexpr ( NBits == 32 )
     {
-        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        const uint64_t outbit_1  = bit_array[0];
-        const uint64_t outbit_2  = bit_array[1];
-        bit_array[0] = (bit_array[0] << 1) | (outbit_2 >> 63);
-        bit_array[1] = (bit_array[1] << 1) | (outbit_1 >> 63);
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        bit_array[0] = (bit_array[0] << shift) | (bit_array[0] >> (32 - shift));
     }
-    else if( nBits == 256 )
+    else
     {
+        constexpr int32_t words = NBits / 64;
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        const uint64_t outbit_1  = bit_array[0];
-        const uint64_t outbit_2  = bit_array[1];
-        const uint64_t outbit_3  = bit_array[2];
-        const uint64_t outbit_4  = bit_array[3];
-        bit_array[0] = (bit_array[0] << 1) | (outbit_4 >> 63);
-        bit_array[1] = (bit_array[1] << 1) | (outbit_1 >> 63);
-        bit_array[2] = (bit_array[2] << 1) | (outbit_2 >> 63);
-        bit_array[3] = (bit_array[3] << 1) | (outbit_3 >> 63);
-    }
-    else if( nBits == 512 )
-    {
-        constexpr int32_t bytes = 8;
-        uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        uint64_t tmp[bytes];
+        uint64_t tmp[2 * words + 1];
 
-        #pragma unroll
-        for(int32_t x = 0; x < bytes; x += 1)
-            tmp[x] = bit_array[x];
-        bit_array[0] = (tmp[0] << 1) | (tmp[bytes-1] >> 63);
+        #pragma GCC unroll 64
+        for(int32_t x = 0; x < words; x += 1)
+        {
+            tmp[x]         = bit_array[x];
+            tmp[x + words] = bit_array[x];
+        }
+        tmp[2 * words] = 0;
 
-        #pragma unroll
-        for(int32_t x = 1; x < bytes; x += 1)
-            bit_array[x] = (tmp[x] << 1) | (tmp[x-1] >> 63);
+        const uint64_t* src = tmp + (NBits - shift) / 64;
+        const int32_t   b   = (NBits - shift) % 64;
+        if( b == 0 )
+        {
+            #pragma GCC unroll 64
+            for(int32_t x = 0; x < words; x += 1)
+                bit_array[x] = src[x];
+        }
+        else
+        {
+            #pragma GCC unroll 64
+            for(int32_t x = 0; x < words; x += 1)
+                bit_array[x] = (src[x] >> b) | (src[x + 1] << (64 - b));
+        }
+    }
+}
+
+RSHIFT_SIZED_TABLES(x86)
+
+//
+// One-bit cyclic rotation of nFrames contiguous frames of nBits each (frames
+// are (nBits + 7) / 8 bytes apart). The size dispatch is done once for the
+// whole batch.
+//
+inline void permutation_x86(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << 1) | (bit_array[f] >> 31);
     }
-    else if( nBits == 1024 )
+    else if( nBits == 64 )
     {
-        constexpr int32_t bytes = 16;
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        uint64_t tmp[bytes];
+        for(int32_t f = 0; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << 1) | (bit_array[f] >> 63);
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_permutation_t kernel = permutation_x86_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64) );
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, 1, funnel_x86);
+    }
+}
 
-        #pragma unroll
-        for(int32_t x = 0; x < bytes; x += 1)
-            tmp[x] = bit_array[x];
-        bit_array[0] = (tmp[0] << 1) | (tmp[bytes-1] >> 63);
+//
+// Cyclic rotation of the bit array by k positions in a single pass (bit i
+// moves to position (i + k) % nBits, as k calls to permutation_x86 would).
+// Any nBits is accepted, see rotate_generic for the word move + funnel
+// shift scheme. nFrames contiguous frames are rotated by the same amount.
+//
+inline void rotate_x86(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( shift == 0 )
+        return;
 
-        #pragma unroll
-        for(int32_t x = 1; x < bytes; x += 1)
-            bit_array[x] = (tmp[x] << 1) | (tmp[x-1] >> 63);
+    if( nBits == 32 )
+    {
+        uint32_t* bit_array = (uint32_t*)ptr_bit_array;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (32 - shift));
     }
-    else if( nBits == 2048 )
+    else if( nBits == 64 )
     {
-        constexpr int32_t bytes = 32;
         uint64_t* bit_array = (uint64_t*)ptr_bit_array;
-        uint64_t tmp[bytes];
+        for(int32_t f = 0; f < nFrames; f += 1)
+            bit_array[f] = (bit_array[f] << shift) | (bit_array[f] >> (64 - shift));
+    }
+    else if( (nBits % 64 == 0) && (nBits <= RSHIFT_SIZED_BITS) )
+    {
+        const rshift_sized_rotate_t kernel = rotate_x86_sized(nBits);
+        for(int32_t f = 0; f < nFrames; f += 1)
+            kernel( ((uint64_t*)ptr_bit_array) + (size_t)f * (nBits / 64), shift );
+    }
+    else
+    {
+        const int32_t nBytes = (nBits + 7) / 8;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            rotate_generic(((uint8_t*)ptr_bit_array) + (size_t)f * nBytes, nBits, shift, funnel_x86);
+    }
+}
 
-        #pragma unroll
-        for(int32_t x = 0; x < bytes; x += 1)
-            tmp[x] = bit_array[x];
-        bit_array[0] = (tmp[0] << 1) | (tmp[bytes-1] >> 63);
+//
+// Out-of-place variants: the nFrames rotated frames of src are written to
+// dst, the two buffers must not overlap. Nothing is copied beforehand and
+// dst is only written, which saves the memcpy + in-place rotation of a
+// ping-pong pipeline. With stream set the output is written with
+// non-temporal stores, for outputs larger than the caches.
+//
+inline void rotate_x86(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k, const int32_t nFrames = 1, const bool stream = false)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
 
-        #pragma unroll
-        for(int32_t x = 1; x < bytes; x += 1)
-            bit_array[x] = (tmp[x] << 1) | (tmp[x-1] >> 63);
+    if( nBits == 32 )
+    {
+        const uint32_t* src = (const uint32_t*)ptr_src;
+        uint32_t*       dst = (uint32_t*)ptr_dst;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            dst[f] = (src[f] << shift) | (src[f] >> ((32 - shift) % 32));
+    }
+    else if( nBits == 64 )
+    {
+        const uint64_t* src = (const uint64_t*)ptr_src;
+        uint64_t*       dst = (uint64_t*)ptr_dst;
+        for(int32_t f = 0; f < nFrames; f += 1)
+            dst[f] = (src[f] << shift) | (src[f] >> ((64 - shift) % 64));
+    }
+    else
+    {
+        rotate_copy(ptr_dst, ptr_src, nBits, shift, nFrames, funnel_x86, stream ? funnel_x86_stream : nullptr);
+#if defined(__x86_64__)
+        if( stream )
+            _mm_sfence();
+#endif
+    }
+}
+
+inline void permutation_x86(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t nFrames = 1, const bool stream = false)
+{
+    rotate_x86(ptr_dst, ptr_src, nBits, 1, nFrames, stream);
+}
+
+//
+// Rotations toward the low bits (bit i moves to (i - k) % nBits), the
+// inverse of permutation_x86 / rotate_x86.
+//
+inline void rotate_right_x86(void* ptr_bit_array, const int32_t nBits, const int32_t k, const int32_t nFrames = 1)
+{
+    rotate_x86(ptr_bit_array, nBits, -(k % nBits), nFrames);
+}
+
+inline void permutation_right_x86(void* ptr_bit_array, const int32_t nBits, const int32_t nFrames = 1)
+{
+    rotate_x86(ptr_bit_array, nBits, nBits - 1, nFrames);
+}
+
+inline void shl_words_x86(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    for(int32_t x = nWords - 1; x >= 1; x -= 1)
+        w[x] = funnel_left(w[x], w[x - 1], k);
+}
+
+inline void shr_words_x86(uint64_t* w, const int32_t nWords, const int32_t k)
+{
+    for(int32_t x = 0; x < nWords - 1; x += 1)
+        w[x] = funnel_right(w[x], w[x + 1], k);
+}
+
+//
+// Non-cyclic shifts by 0 <= k <= 64 with carry in/out, see
+// shift_left_generic and shift_right_generic for the exact contract.
+//
+inline uint64_t shift_left_x86(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_left_generic(ptr_bit_array, nBits, k, carry_in, shl_words_x86);
+}
+
+inline uint64_t shift_right_x86(void* ptr_bit_array, const int32_t nBits, const int32_t k, const uint64_t carry_in = 0)
+{
+    return shift_right_generic(ptr_bit_array, nBits, k, carry_in, shr_words_x86);
+}
+
+//
+// Rotation of a padded array (see rotate_padded_generic): whole words only,
+// the plain funnel having no tail to handle.
+//
+inline void rotate_padded_x86(void* ptr_bit_array, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    if( (nBits % 64 == 0) || (nBits == 32) )
+        rotate_x86(ptr_bit_array, nBits, shift);
+    else if( shift != 0 )
+        rotate_padded_generic(ptr_bit_array, nBits, shift, funnel_x86, funnel_x86);
+}
+
+//
+// Circulant kernel (see rshift_circulant_t) on chunks of up to 4 words held
+// in general purpose registers, the last chunk of a block using only the V
+// words it needs. The funnel shift is written so that b == 0 needs no
+// branch.
+//
+template<int32_t V>
+inline void circulant_chunk_x86(uint8_t* dst, const uint64_t* doubled, const int32_t j, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    const bool whole = (nBits >= 64 * 1 * V);
+    alignas(8) uint64_t tmp[1 * V];
+    const uint64_t* in = (const uint64_t*)dst;
+    if( accumulate && (whole == false) )
+    {
+        load_bits(tmp, 1 * V, dst, nBits);
+        in = tmp;
+    }
+
+    uint64_t a[V];
+    for(int32_t v = 0; v < V; v += 1)
+        a[v] = 0;
+    if( accumulate )
+    {
+        for(int32_t v = 0; v < V; v += 1)
+            memcpy(&a[v], in + v, sizeof(uint64_t));
+    }
+    for(int32_t t = 0; t < nTerms; t += 1)
+    {
+        const uint64_t* s = doubled + terms[t].word + j;
+        const int32_t   b = terms[t].b;
+        for(int32_t v = 0; v < V; v += 1)
+            a[v] ^= (s[v] >> b) | ((s[v + 1] << 1) << (63 - b));
+    }
+
+    uint64_t* out = whole ? (uint64_t*)dst : tmp;
+    for(int32_t v = 0; v < V; v += 1)
+        memcpy(out + v, &a[v], sizeof(uint64_t));
+    if( whole == false )
+        store_bits(dst, tmp, nBits);
+}
+
+inline void circulant_row_x86(uint8_t* dst, const uint64_t* doubled, const rshift_circulant_term* terms, const int32_t nTerms, const int32_t nBits, const bool accumulate)
+{
+    for(int32_t j = 0; 64 * j < nBits; j += 4 * 1)
+    {
+        const int32_t rest = nBits - 64 * j;
+        switch( (rest + 64 * 1 - 1) / (64 * 1) )
+        {
+            case  1 : circulant_chunk_x86<1>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  2 : circulant_chunk_x86<2>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            case  3 : circulant_chunk_x86<3>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+            default : circulant_chunk_x86<4>(dst + 8 * j, doubled, j, terms, nTerms, rest, accumulate); break;
+        }
+    }
+}
+
+//
+// dst ^= rot(src, k): the rotated copy of src is never stored, it is XORed
+// into dst as it is computed. Bits past nBits of dst are not modified.
+//
+inline void rotate_xor_x86(void* __restrict ptr_dst, const void* __restrict ptr_src, const int32_t nBits, const int32_t k)
+{
+    const int32_t shift = ((k % nBits) + nBits) % nBits;
+    rotate_xor_generic(ptr_dst, ptr_src, nBits, shift, funnel_x86, circulant_row_x86);
+}
+
+//
+// Cyclic correlation kernel (see rshift_correlate_t), one word at a time.
+//
+inline void correlate_x86(int32_t* out, const uint64_t* a, const uint64_t* doubled, const int32_t nBits, const int32_t k0, const int32_t k1)
+{
+    const int32_t words = (nBits + 63) / 64;
+    for(int32_t k = k0; k < k1; k += 1)
+    {
+        const int32_t   o = (nBits - k) % nBits;
+        const uint64_t* s = doubled + o / 64;
+        const int32_t   b = o % 64;
+        int32_t sum = 0;
+        for(int32_t x = 0; x < words; x += 1)
+            sum += __builtin_popcountll( a[x] & ((s[x] >> b) | ((s[x + 1] << 1) << (63 - b))) );
+        out[k - k0] = sum;
+    }
+}
+
+//
+// Kernels of the fixed bit permutations (rshift_permute). Beneš stage, see
+// rshift_delta_swap_t: inside each word for d < 64, between the words x
+// and x + d / 64 otherwise.
+//
+inline void delta_swap_x86(uint64_t* w, const uint64_t* mask, const int32_t nWords, const int32_t d)
+{
+    if( d < 64 )
+    {
+        for(int32_t x = 0; x < nWords; x += 1)
+        {
+            const uint64_t t = ((w[x] >> d) ^ w[x]) & mask[x];
+            w[x] ^= t ^ (t << d);
+        }
+    }
+    else
+    {
+        const int32_t D = d / 64;
+        for(int32_t x = 0; x < nWords; x += 2 * D)
+        {
+            for(int32_t y = x; y < x + D; y += 1)
+            {
+                const uint64_t t = (w[y] ^ w[y + D]) & mask[y];
+                w[y]     ^= t;
+                w[y + D] ^= t;
+            }
+        }
+    }
+}
+
+// pext / pdep one set bit of the mask at a time
+inline uint64_t pext_soft(const uint64_t v, uint64_t m)
+{
+    uint64_t r = 0;
+    for(uint64_t bit = 1; m != 0; bit <<= 1)
+    {
+        const uint64_t low = m & (~m + 1);
+        if( v & low )
+            r |= bit;
+        m ^= low;
+    }
+    return r;
+}
+
+inline uint64_t pdep_soft(const uint64_t v, uint64_t m)
+{
+    uint64_t r = 0;
+    for(uint64_t bit = 1; m != 0; bit <<= 1)
+    {
+        const uint64_t low = m & (~m + 1);
+        if( v & bit )
+            r |= low;
+        m ^= low;
+    }
+    return r;
+}
+
+//
+// Gather steps (see rshift_bit_step), out being cleared by the caller.
+//
+inline void gather_bits_x86(uint64_t* out, const uint64_t* in, const rshift_bit_step* steps, const int32_t nSteps)
+{
+    for(int32_t i = 0; i < nSteps; i += 1)
+    {
+        const rshift_bit_step& s = steps[i];
+        const uint64_t v = in[s.src] & s.src_mask;
+        if( s.contiguous )
+            out[s.dst] |= (s.shift >= 0) ? (v << s.shift) : (v >> -s.shift);
+        else
+            out[s.dst] |= pdep_soft( pext_soft(v, s.src_mask), s.dst_mask );
+    }
+}
+
+#if defined(RSHIFT_HAS_BMI2) && defined(__x86_64__)
+RSHIFT_TARGET_BMI2 inline void gather_bits_bmi2(uint64_t* out, const uint64_t* in, const rshift_bit_step* steps, const int32_t nSteps)
+{
+    for(int32_t i = 0; i < nSteps; i += 1)
+    {
+        const rshift_bit_step& s = steps[i];
+        const uint64_t v = in[s.src] & s.src_mask;
+        if( s.contiguous )
+            out[s.dst] |= (s.shift >= 0) ? (v << s.shift) : (v >> -s.shift);
+        else
+            out[s.dst] |= _pdep_u64( _pext_u64(v, s.src_mask), s.dst_mask );
+    }
+}
+#endif
+
+//
+// Byte permutation: dst[b] = lut[src[index[b]]], lut (nullptr for the
+// identity) permuting the bits inside every byte.
+//
+inline void permute_bytes_x86(uint8_t* dst, const uint8_t* src, const int32_t* index, const int32_t nOut, const uint8_t* lut)
+{
+    if( lut == nullptr )
+    {
+        for(int32_t b = 0; b < nOut; b += 1)
+            dst[b] = src[index[b]];
+    }
+    else
+    {
+        for(int32_t b = 0; b < nOut; b += 1)
+            dst[b] = lut[ src[index[b]] ];
+    }
+}
+
+// small frames (see rshift_small_t)
+inline void rotate_small_x86(uint8_t* ptr, const int32_t nBits, const int64_t nFrames, const int32_t* shifts, const int32_t nShifts, const int64_t first)
+{
+    rotate_small_generic(ptr, nBits, nFrames, shifts, nShifts, first);
+}
+
+//
+// Bit transposes (see rshift_transpose_t), by 8 x 8 blocks: block (R, C) is
+// gathered from byte C of rows 8R to 8R + 7, transposed in a word and
+// scattered to byte R of rows 8C to 8C + 7.
+//
+inline void transpose64x4_x86(uint64_t* a)
+{
+    uint64_t t[64];
+    for(int32_t b = 0; b < 4; b += 1)
+    {
+        memset(t, 0, sizeof(t));
+        for(int32_t R = 0; R < 8; R += 1)
+        {
+            for(int32_t C = 0; C < 8; C += 1)
+            {
+                uint64_t x = 0;
+                for(int32_t i = 0; i < 8; i += 1)
+                    x |= ((a[4 * (8 * R + i) + b] >> (8 * C)) & 0xFF) << (8 * i);
+                x = transpose_8x8(x);
+                for(int32_t i = 0; i < 8; i += 1)
+                    t[8 * C + i] |= ((x >> (8 * i)) & 0xFF) << (8 * R);
+            }
+        }
+        for(int32_t r = 0; r < 64; r += 1)
+            a[4 * r + b] = t[r];
     }
 }
 
-#endif
\ No newline at end of file
+#endif
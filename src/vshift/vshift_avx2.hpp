@@ -0,0 +1,89 @@
+/*
+ *	Soft-value cyclic shift functions (AVX2) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _vshift_avx2_
+#define _vshift_avx2_
+
+#include "vshift_common.hpp"
+#include "vshift_sse4.hpp"
+#ifdef RSHIFT_HAS_AVX2
+
+#include <immintrin.h>
+
+//
+// 32 bytes per load/store with an overlapping last vector, ranges shorter
+// than one ymm going through the SSE4 copy.
+//
+RSHIFT_TARGET_AVX2 inline void vcopy_avx2(uint8_t* dst, const uint8_t* src, const int32_t nBytes)
+{
+    if( nBytes < 32 )
+    {
+        vcopy_sse4(dst, src, nBytes);
+        return;
+    }
+    int32_t x = 0;
+    for(; x + 32 <= nBytes; x += 32)
+        _mm256_storeu_si256( (__m256i*)(dst + x), _mm256_loadu_si256( (const __m256i*)(src + x) ) );
+    if( x < nBytes )
+        _mm256_storeu_si256( (__m256i*)(dst + nBytes - 32), _mm256_loadu_si256( (const __m256i*)(src + nBytes - 32) ) );
+}
+
+//
+// Frames of at most 32 bytes are rotated through a doubled copy kept on the
+// stack: the frame is stored twice in a row and the result is one unaligned
+// load at offset nBytes - shift.
+//
+template<typename T>
+RSHIFT_TARGET_AVX2 inline void vrotate_avx2(T* ptr, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t nBytes = Z * (int32_t)sizeof(T);
+    if( (uint32_t)nBytes > 32 )
+    {
+        vrotate_frames(ptr, Z, k, nFrames, vcopy_avx2);
+        return;
+    }
+
+    const int32_t shift = (((k % Z) + Z) % Z) * (int32_t)sizeof(T);
+    if( shift == 0 )
+        return;
+
+    alignas(32) uint8_t tmp[64];
+    for(int32_t f = 0; f < nFrames; f += 1)
+    {
+        uint8_t* frame = (uint8_t*)(ptr + (size_t)f * Z);
+        vcopy_sse4(tmp,          frame, nBytes);
+        vcopy_sse4(tmp + nBytes, frame, nBytes);
+        vcopy_sse4(frame, tmp + nBytes - shift, nBytes);
+    }
+}
+
+template<typename T>
+RSHIFT_TARGET_AVX2 inline void vrotate_avx2(T* __restrict dst, const T* __restrict src, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(dst, src, Z, k, nFrames, vcopy_avx2);
+}
+
+#endif
+#endif
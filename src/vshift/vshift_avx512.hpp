@@ -0,0 +1,137 @@
+/*
+ *	Soft-value cyclic shift functions (AVX-512) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _vshift_avx512_
+#define _vshift_avx512_
+
+#include "vshift_common.hpp"
+#include "vshift_avx2.hpp"
+#ifdef RSHIFT_HAS_AVX512
+
+#include <immintrin.h>
+
+//
+// 64 bytes per load/store, the tail being a single masked vmovdqu8.
+//
+RSHIFT_TARGET_AVX512 inline void vcopy_avx512(uint8_t* dst, const uint8_t* src, const int32_t nBytes)
+{
+    int32_t x = 0;
+    for(; x + 64 <= nBytes; x += 64)
+        _mm512_storeu_si512( dst + x, _mm512_loadu_si512( src + x ) );
+    if( x < nBytes )
+    {
+        const __mmask64 M = (1ULL << (nBytes - x)) - 1;
+        _mm512_mask_storeu_epi8( dst + x, M, _mm512_maskz_loadu_epi8( M, src + x ) );
+    }
+}
+
+#ifdef RSHIFT_HAS_AVX512_VBMI
+//
+// Byte frames of at most 64 bytes rotated inside one zmm by vpermb, compiled
+// for VBMI whatever the -m flags and only called when the CPU has it.
+//
+RSHIFT_TARGET_AVX512_VBMI inline void vrotate_avx512_vbmi(uint8_t* ptr, const int32_t Z, const int32_t shift, const int32_t nFrames)
+{
+    const __mmask64 M    = (Z == 64) ? ~0ULL : (1ULL << Z) - 1;
+    const __m512i   lane = _mm512_set_epi64(0x3F3E3D3C3B3A3938, 0x3736353433323130, 0x2F2E2D2C2B2A2928, 0x2726252423222120,
+                                            0x1F1E1D1C1B1A1918, 0x1716151413121110, 0x0F0E0D0C0B0A0908, 0x0706050403020100);
+    const __m512i   t    = _mm512_add_epi8( lane, _mm512_set1_epi8(Z - shift) );
+    const __m512i   idx  = _mm512_mask_sub_epi8( t, _mm512_cmpge_epu8_mask(t, _mm512_set1_epi8(Z)), t, _mm512_set1_epi8(Z) );
+    for(int32_t f = 0; f < nFrames; f += 1)
+    {
+        const __m512i A = _mm512_maskz_loadu_epi8( M, ptr + (size_t)f * Z );
+        _mm512_mask_storeu_epi8( ptr + (size_t)f * Z, M, _mm512_permutexvar_epi8( idx, A ) );
+    }
+}
+#endif
+
+//
+// True when vrotate_avx512_vbmi may run: checked once on the CPU in the
+// dispatch build, known at compile time otherwise.
+//
+inline bool vshift_has_avx512_vbmi()
+{
+#if defined(RSHIFT_HAS_AVX512_VBMI) && defined(RSHIFT_X86_DISPATCH) && !(defined(__AVX512VBMI__) && defined(__GFNI__))
+    static const bool vbmi = (__builtin_cpu_init(), __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("gfni"));
+    return vbmi;
+#elif defined(RSHIFT_HAS_AVX512_VBMI)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//
+// Frames of at most 64 bytes are rotated inside one zmm: a single permute
+// with the index (j - shift) mod Z, vpermw for 16-bit elements and vpermb
+// (vrotate_avx512_vbmi) for bytes on the CPUs with VBMI, between a masked
+// load and a masked store. The other cases go through the copy kernel.
+//
+template<typename T>
+RSHIFT_TARGET_AVX512 inline void vrotate_avx512(T* ptr, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    const int32_t shift = ((k % Z) + Z) % Z;
+    if( shift == 0 )
+        return;
+
+#ifdef RSHIFT_HAS_AVX512_VBMI
+    if constexpr ( sizeof(T) == 1 )
+    {
+        if( (Z <= 64) && vshift_has_avx512_vbmi() )
+        {
+            vrotate_avx512_vbmi((uint8_t*)ptr, Z, shift, nFrames);
+            return;
+        }
+    }
+#endif
+    if constexpr ( sizeof(T) == 2 )
+    {
+        if( Z <= 32 )
+        {
+            const __mmask64 M    = (Z == 32) ? ~0ULL : (1ULL << (2 * Z)) - 1;
+            const __m512i   lane = _mm512_setr_epi32(0x00010000, 0x00030002, 0x00050004, 0x00070006, 0x00090008, 0x000B000A, 0x000D000C, 0x000F000E,
+                                                     0x00110010, 0x00130012, 0x00150014, 0x00170016, 0x00190018, 0x001B001A, 0x001D001C, 0x001F001E);
+            const __m512i   t    = _mm512_add_epi16( lane, _mm512_set1_epi16(Z - shift) );
+            const __m512i   idx  = _mm512_mask_sub_epi16( t, _mm512_cmpge_epu16_mask(t, _mm512_set1_epi16(Z)), t, _mm512_set1_epi16(Z) );
+            for(int32_t f = 0; f < nFrames; f += 1)
+            {
+                const __m512i A = _mm512_maskz_loadu_epi8( M, ptr + (size_t)f * Z );
+                _mm512_mask_storeu_epi8( ptr + (size_t)f * Z, M, _mm512_permutexvar_epi16( idx, A ) );
+            }
+            return;
+        }
+    }
+
+    vrotate_frames(ptr, Z, k, nFrames, vcopy_avx512);
+}
+
+template<typename T>
+RSHIFT_TARGET_AVX512 inline void vrotate_avx512(T* __restrict dst, const T* __restrict src, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(dst, src, Z, k, nFrames, vcopy_avx512);
+}
+
+#endif
+#endif
@@ -0,0 +1,124 @@
+/*
+ *	Soft-value cyclic shift functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _vshift_common_
+#define _vshift_common_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include "../rshift/rshift_common.hpp"
+
+//
+// Companion of src/rshift for vectors of soft values (int8_t / int16_t LLRs,
+// any trivially copyable type in fact): vrotate_<isa> moves element i to
+// (i + k) % Z, the same direction as rotate_<isa> on packed bits. A rotation
+// of Z elements of E bytes by s is a rotation of Z * E bytes by s * E, so
+// every backend works on bytes and only provides a copy kernel.
+//
+typedef void (*vshift_copy_t)(uint8_t* dst, const uint8_t* src, const int32_t nBytes);
+
+//
+// Copies of less than 16 bytes with at most two (overlapping) moves.
+//
+inline void vcopy_small(uint8_t* dst, const uint8_t* src, const int32_t nBytes)
+{
+    if( nBytes >= 8 )
+    {
+        uint64_t a, b;
+        memcpy(&a, src,              8);
+        memcpy(&b, src + nBytes - 8, 8);
+        memcpy(dst,              &a, 8);
+        memcpy(dst + nBytes - 8, &b, 8);
+    }
+    else if( nBytes >= 4 )
+    {
+        uint32_t a, b;
+        memcpy(&a, src,              4);
+        memcpy(&b, src + nBytes - 4, 4);
+        memcpy(dst,              &a, 4);
+        memcpy(dst + nBytes - 4, &b, 4);
+    }
+    else
+    {
+        for(int32_t x = 0; x < nBytes; x += 1)
+            dst[x] = src[x];
+    }
+}
+
+//
+// Out-of-place rotation of nBytes bytes by 0 <= shift < nBytes: the tail of
+// src goes to the head of dst and the head of src right after it, two
+// straight copies with no temporary buffer.
+//
+inline void vrotate_bytes(uint8_t* __restrict dst, const uint8_t* __restrict src, const int32_t nBytes, const int32_t shift, vshift_copy_t copy)
+{
+    copy(dst,         src + nBytes - shift, shift         );
+    copy(dst + shift, src,                  nBytes - shift);
+}
+
+//
+// In-place rotation: a single rotating pass into a temporary (on the stack
+// up to 4 KiB, the thread's rshift_scratch buffer otherwise), then one
+// straight copy back into place.
+//
+inline void vrotate_bytes(uint8_t* ptr, const int32_t nBytes, const int32_t shift, vshift_copy_t copy)
+{
+    if( shift == 0 )
+        return;
+
+    alignas(64) uint8_t stack_buffer[4096];
+    uint8_t* tmp = (nBytes <= 4096) ? stack_buffer : (uint8_t*)rshift_scratch( ((size_t)nBytes + 7) / 8 );
+
+    vrotate_bytes(tmp, ptr, nBytes, shift, copy);
+    copy(ptr, tmp, nBytes);
+}
+
+//
+// Batched front ends shared by the backends: nFrames frames of Z elements
+// stored back to back, all rotated by k (any sign).
+//
+template<typename T>
+inline void vrotate_frames(T* ptr, const int32_t Z, const int32_t k, const int32_t nFrames, vshift_copy_t copy)
+{
+    static_assert( std::is_trivially_copyable<T>::value, "vrotate : the elements must be trivially copyable" );
+    const int32_t shift = ((k % Z) + Z) % Z;
+    if( shift == 0 )
+        return;
+    for(int32_t f = 0; f < nFrames; f += 1)
+        vrotate_bytes((uint8_t*)(ptr + (size_t)f * Z), Z * (int32_t)sizeof(T), shift * (int32_t)sizeof(T), copy);
+}
+
+template<typename T>
+inline void vrotate_frames(T* __restrict dst, const T* __restrict src, const int32_t Z, const int32_t k, const int32_t nFrames, vshift_copy_t copy)
+{
+    static_assert( std::is_trivially_copyable<T>::value, "vrotate : the elements must be trivially copyable" );
+    const int32_t shift = ((k % Z) + Z) % Z;
+    for(int32_t f = 0; f < nFrames; f += 1)
+        vrotate_bytes((uint8_t*)(dst + (size_t)f * Z), (const uint8_t*)(src + (size_t)f * Z), Z * (int32_t)sizeof(T), shift * (int32_t)sizeof(T), copy);
+}
+
+#endif
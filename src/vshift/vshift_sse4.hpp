@@ -0,0 +1,65 @@
+/*
+ *	Soft-value cyclic shift functions (SSE4) - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _vshift_sse4_
+#define _vshift_sse4_
+
+#include "vshift_common.hpp"
+#ifdef RSHIFT_HAS_SSE4
+
+#include <immintrin.h>
+
+//
+// 16 bytes per load/store, the last (partial) vector being realigned on the
+// end of the range and overlapping the previous one.
+//
+RSHIFT_TARGET_SSE4 inline void vcopy_sse4(uint8_t* dst, const uint8_t* src, const int32_t nBytes)
+{
+    if( nBytes < 16 )
+    {
+        vcopy_small(dst, src, nBytes);
+        return;
+    }
+    int32_t x = 0;
+    for(; x + 16 <= nBytes; x += 16)
+        _mm_storeu_si128( (__m128i*)(dst + x), _mm_loadu_si128( (const __m128i*)(src + x) ) );
+    if( x < nBytes )
+        _mm_storeu_si128( (__m128i*)(dst + nBytes - 16), _mm_loadu_si128( (const __m128i*)(src + nBytes - 16) ) );
+}
+
+template<typename T>
+RSHIFT_TARGET_SSE4 inline void vrotate_sse4(T* ptr, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(ptr, Z, k, nFrames, vcopy_sse4);
+}
+
+template<typename T>
+RSHIFT_TARGET_SSE4 inline void vrotate_sse4(T* __restrict dst, const T* __restrict src, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(dst, src, Z, k, nFrames, vcopy_sse4);
+}
+
+#endif
+#endif
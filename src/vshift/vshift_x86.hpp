@@ -0,0 +1,69 @@
+/*
+ *	Soft-value cyclic shift functions - Copyright (c) 2021 Bertrand LE GAL
+ *
+ *  This software is provided 'as-is', without any express or
+ *  implied warranty. In no event will the authors be held
+ *  liable for any damages arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute
+ *  it freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented;
+ *  you must not claim that you wrote the original software.
+ *  If you use this software in a product, an acknowledgment
+ *  in the product documentation would be appreciated but
+ *  is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such,
+ *  and must not be misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any
+ *  source distribution.
+ *
+ */
+
+#ifndef _vshift_x86_
+#define _vshift_x86_
+
+#include "vshift_common.hpp"
+
+inline void vcopy_x86(uint8_t* dst, const uint8_t* src, const int32_t nBytes)
+{
+    if( nBytes < 16 )
+    {
+        vcopy_small(dst, src, nBytes);
+        return;
+    }
+    int32_t x = 0;
+    for(; x + 8 <= nBytes; x += 8)
+    {
+        uint64_t v;
+        memcpy(&v, src + x, 8);
+        memcpy(dst + x, &v, 8);
+    }
+    if( x < nBytes )
+    {
+        uint64_t v;
+        memcpy(&v, src + nBytes - 8, 8);
+        memcpy(dst + nBytes - 8, &v, 8);
+    }
+}
+
+//
+// Cyclic rotation of nFrames vectors of Z soft values by k (element i moves
+// to (i + k) % Z), in place or from src to dst.
+//
+template<typename T>
+inline void vrotate_x86(T* ptr, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(ptr, Z, k, nFrames, vcopy_x86);
+}
+
+template<typename T>
+inline void vrotate_x86(T* __restrict dst, const T* __restrict src, const int32_t Z, const int32_t k, const int32_t nFrames = 1)
+{
+    vrotate_frames(dst, src, Z, k, nFrames, vcopy_x86);
+}
+
+#endif